@@ -14,6 +14,10 @@
 #include <zephyr/net/wifi.h>
 #include <zephyr/net/wifi_mgmt.h>
 
+#if defined(CONFIG_GW_ENGINE_COAP)
+#include <gateway_engine/gw_coap.h>
+#endif
+#include <gateway_engine/gw_codec.h>
 #include <gateway_engine/gw_engine.h>
 #include <gateway_engine/gw_link_proto.h>
 
@@ -22,6 +26,7 @@ LOG_MODULE_REGISTER(hybrid_lighting_gateway, LOG_LEVEL_INF);
 #define LAB_WIFI_EVENTS (NET_EVENT_WIFI_CONNECT_RESULT | NET_EVENT_WIFI_DISCONNECT_RESULT)
 #define LAB_WIFI_RETRY_MS 5000U
 #define LAB_ENGINE_RETRY_MS 5000U
+#define LAB_LOOP_MS 20U
 
 #if DT_NODE_HAS_STATUS(DT_ALIAS(led_strip), okay)
 #define LAB_HAS_DEBUG_LED 1
@@ -36,6 +41,14 @@ typedef enum {
     DEBUG_LED_BLUE,
 } debug_led_state_t;
 
+/* Telemetry field ids (CBOR map keys). */
+enum {
+    LAB_FIELD_ON = 1,
+    LAB_FIELD_BRIGHTNESS = 2,
+    LAB_FIELD_SCENE = 3,
+    LAB_FIELD_HEARTBEAT = 4,
+};
+
 typedef struct {
     uint8_t is_on;
     uint8_t brightness;
@@ -79,12 +92,62 @@ static int edge_build_ack(const gw_link_frame_view_t *view, uint8_t *rx_data, si
     return gw_link_encode(0U, GW_LINK_CMD_ACK, view->seq, payload, sizeof(payload), rx_data, rx_cap, rx_len);
 }
 
+/* Desired values come from unauthenticated LAN clients; NaN and out-of-range floats saturate. */
+static uint8_t edge_clamp_u8(float value)
+{
+    if (!(value > 0.0f)) {
+        return 0U;
+    }
+    if (value >= 255.0f) {
+        return 255U;
+    }
+    return (uint8_t)value;
+}
+
+/* Shadow pushes arrive as a CBOR map of the telemetry field ids. */
+static void edge_apply_desired(edge_lighting_state_t *edge, const gw_link_frame_view_t *view)
+{
+    gw_codec_record_t rec;
+    size_t i;
+
+    if (gw_codec_decode_cbor(view->payload, view->payload_len, &rec) != 0) {
+        return;
+    }
+
+    for (i = 0U; i < rec.count; ++i) {
+        float value = gw_codec_field_as_float(&rec.fields[i]);
+
+        switch (rec.fields[i].id) {
+        case LAB_FIELD_ON:
+            edge->is_on = (value > 0.0f) ? 1U : 0U;
+            break;
+        case LAB_FIELD_BRIGHTNESS:
+            edge->brightness = edge_clamp_u8(value);
+            break;
+        case LAB_FIELD_SCENE:
+            edge->scene = edge_clamp_u8(value);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
 static void edge_apply_control(edge_lighting_state_t *edge, const gw_link_frame_view_t *view)
 {
     uint8_t op;
     uint8_t arg;
 
-    if (edge == NULL || view == NULL || view->payload_len < 2U) {
+    if (edge == NULL || view == NULL || view->payload_len == 0U) {
+        return;
+    }
+
+    if (gw_codec_detect(view->payload, view->payload_len) == GW_CODEC_FORMAT_CBOR) {
+        edge_apply_desired(edge, view);
+        return;
+    }
+
+    if (view->payload_len < 2U) {
         return;
     }
 
@@ -185,26 +248,27 @@ static int gateway_send_heartbeat(gw_engine_t *engine)
 
 static int gateway_send_lighting_telemetry(gw_engine_t *engine, const edge_lighting_state_t *edge)
 {
-    char payload[96];
-    int n;
+    gw_codec_record_t rec;
+    uint8_t payload[32];
+    size_t len = 0U;
+    int rc;
 
     if (engine == NULL || edge == NULL) {
         return -EINVAL;
     }
 
-    n = snprintk(
-        payload,
-        sizeof(payload),
-        "{\"on\":%u,\"brightness\":%u,\"scene\":%u,\"hb\":%u}",
-        (unsigned int)edge->is_on,
-        (unsigned int)edge->brightness,
-        (unsigned int)edge->scene,
-        (unsigned int)edge->heartbeat_count);
-    if (n <= 0 || (size_t)n >= sizeof(payload)) {
-        return -ENOSPC;
+    gw_codec_record_init(&rec);
+    (void)gw_codec_record_add_bool(&rec, LAB_FIELD_ON, edge->is_on != 0U);
+    (void)gw_codec_record_add_uint(&rec, LAB_FIELD_BRIGHTNESS, edge->brightness);
+    (void)gw_codec_record_add_uint(&rec, LAB_FIELD_SCENE, edge->scene);
+    (void)gw_codec_record_add_uint(&rec, LAB_FIELD_HEARTBEAT, edge->heartbeat_count);
+
+    rc = gw_codec_encode_cbor(&rec, payload, sizeof(payload), &len);
+    if (rc != 0) {
+        return rc;
     }
 
-    return gw_engine_send(engine, GW_LINK_CMD_TELEMETRY, (const uint8_t *)payload, (uint16_t)n);
+    return gw_engine_send(engine, GW_LINK_CMD_TELEMETRY, payload, (uint16_t)len);
 }
 
 static const struct device *lab_get_led_strip(void)
@@ -268,7 +332,7 @@ static void lab_refresh_debug_led(lab_ctx_t *lab)
         return;
     }
 
-    mqtt_connected = lab->wifi_connected && lab->engine_started && lab->engine.cloud.connected;
+    mqtt_connected = lab->wifi_connected && lab->engine_started && gw_cloud_is_connected(&lab->engine.cloud);
 
     if (lab->wifi_connected && mqtt_connected) {
         target = DEBUG_LED_BLUE;
@@ -446,13 +510,11 @@ static void lab_engine_poll(lab_ctx_t *lab, uint32_t now_ms)
         return;
     }
 
-    if (!lab->wifi_connected) {
-        if (lab->engine_started) {
-            (void)gw_engine_stop(&lab->engine);
-            lab->engine_started = false;
-            LOG_WRN("engine stopped due to wifi disconnect");
+    if (lab->engine.uplink_available != lab->wifi_connected) {
+        (void)gw_engine_set_uplink(&lab->engine, lab->wifi_connected);
+        if (!lab->wifi_connected) {
+            LOG_WRN("uplink lost; edge link kept running, cloud offline");
         }
-        return;
     }
 
     if (lab->engine_started) {
@@ -510,7 +572,7 @@ static int lab_init(lab_ctx_t *lab)
     (void)memset(&engine_cfg, 0, sizeof(engine_cfg));
     engine_cfg.profile = GW_PROFILE_LIGHTING_GATEWAY;
     engine_cfg.device_id = "hybrid-lighting-esp32s3";
-    engine_cfg.loop_period_ms = 20U;
+    engine_cfg.loop_period_ms = LAB_LOOP_MS;
 
     engine_cfg.cloud.device_id = "hybrid-lighting-esp32s3";
     engine_cfg.cloud.hardware_id = "3030F903AA1C";
@@ -519,6 +581,13 @@ static int lab_init(lab_ctx_t *lab)
     engine_cfg.cloud.bootstrap_timeout_ms = 1000U;
     engine_cfg.cloud.mqtt_connect_timeout_ms = 1000U;
 
+    /* Backs CoAP /edge/state and turns CBOR commands into desired state for the edge. */
+    engine_cfg.shadow.enabled = true;
+    engine_cfg.shadow.slot = 3U;
+    engine_cfg.shadow.delta_min_ms = 1000U;
+    engine_cfg.shadow.resync_idle_ms = 10000U;
+    engine_cfg.shadow.ack_timeout_ms = 500U;
+
     engine_cfg.ota.chunk_size = 1024U;
     engine_cfg.ota.timeout_ms = 3000U;
 
@@ -527,6 +596,17 @@ static int lab_init(lab_ctx_t *lab)
         return rc;
     }
 
+#if defined(CONFIG_GW_ENGINE_COAP)
+    {
+        gw_coap_config_t coap_cfg = { .port = 5683U, .notify_min_ms = 100U };
+
+        rc = gw_coap_start(&lab->engine, &coap_cfg);
+        if (rc != 0) {
+            LOG_WRN("coap server start failed: %d", rc);
+        }
+    }
+#endif
+
     rc = lab_wifi_init(lab);
     if (rc != 0) {
         return rc;
@@ -535,6 +615,28 @@ static int lab_init(lab_ctx_t *lab)
     return 0;
 }
 
+/* Sleeps until the next loop tick, serving CoAP requests as they arrive instead of once per tick. */
+static void lab_wait_tick(lab_ctx_t *lab, uint32_t deadline_ms)
+{
+    int32_t left;
+
+#if defined(CONFIG_GW_ENGINE_COAP)
+    while (lab->engine_started && (left = (int32_t)(deadline_ms - k_uptime_get_32())) > 0) {
+        if (gw_coap_wait((uint32_t)left) <= 0) {
+            break;
+        }
+        (void)gw_coap_poll();
+    }
+#else
+    ARG_UNUSED(lab);
+#endif
+
+    left = (int32_t)(deadline_ms - k_uptime_get_32());
+    if (left > 0) {
+        k_sleep(K_MSEC(left));
+    }
+}
+
 int main(void)
 {
     lab_ctx_t lab;
@@ -589,20 +691,32 @@ int main(void)
             }
         }
 
+#if defined(CONFIG_GW_ENGINE_COAP)
+        if (lab.engine_started) {
+            (void)gw_coap_poll();
+        }
+#endif
+
         if ((now_ms - lab.last_scene_log_ms) >= 1000U) {
+            gw_engine_metrics_t metrics;
+
+            (void)memset(&metrics, 0, sizeof(metrics));
+            (void)gw_engine_get_metrics(&lab.engine, &metrics);
+
             lab.last_scene_log_ms = now_ms;
             LOG_INF(
-                "edge state on=%u brightness=%u scene=%u hb=%u wifi=%u mqtt=%u",
+                "edge state on=%u brightness=%u scene=%u hb=%u wifi=%u mqtt=%u rx_err=%u/1000",
                 (unsigned int)lab.edge.is_on,
                 (unsigned int)lab.edge.brightness,
                 (unsigned int)lab.edge.scene,
                 (unsigned int)lab.edge.heartbeat_count,
                 (unsigned int)lab.wifi_connected,
-                (unsigned int)(lab.engine_started && lab.engine.cloud.connected));
+                (unsigned int)(lab.engine_started && gw_cloud_is_connected(&lab.engine.cloud)),
+                (unsigned int)metrics.rx_error_rate_permille);
         }
 
         loop_count++;
-        k_sleep(K_MSEC(20));
+        lab_wait_tick(&lab, now_ms + LAB_LOOP_MS);
     }
 
     (void)gw_engine_stop(&lab.engine);
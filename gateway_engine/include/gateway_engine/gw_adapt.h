@@ -0,0 +1,68 @@
+#ifndef GW_ADAPT_H
+#define GW_ADAPT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * AIMD control of the uplink publish rate. Every period_ms the uplink is
+ * congested when the PUBACK RTT or the send latency exceeds target_latency_ms,
+ * the backlog exceeds target_backlog or publishes were rejected. Congestion
+ * doubles the batch age and size (multiplicative decrease of the publish
+ * rate); a healthy period takes one step back (additive increase).
+ * degrade_after congested periods in a row enter degraded mode, the same
+ * number of healthy periods leave it.
+ */
+typedef struct {
+    bool enabled;
+    uint32_t period_ms;
+    uint32_t target_latency_ms;
+    uint16_t target_backlog;
+    uint32_t min_flush_ms;
+    uint32_t max_flush_ms;
+    uint32_t flush_step_ms;
+    uint16_t min_batch_points;
+    uint16_t max_batch_points;
+    uint16_t batch_step_points;
+    uint8_t degrade_after;
+} gw_adapt_config_t;
+
+typedef struct {
+    uint32_t rtt_ms;
+    uint32_t send_latency_ms;
+    uint32_t backlog;
+    /* Publishes rejected by the connector since the previous sample. */
+    uint32_t rejected;
+} gw_adapt_sample_t;
+
+typedef struct {
+    uint32_t periods;
+    uint32_t congested;
+    uint32_t degraded_entries;
+} gw_adapt_stats_t;
+
+typedef struct {
+    gw_adapt_config_t config;
+    uint32_t flush_ms;
+    uint16_t batch_points;
+    bool degraded;
+    uint8_t streak;
+    uint32_t next_ms;
+    gw_adapt_stats_t stats;
+} gw_adapt_t;
+
+int gw_adapt_init(gw_adapt_t *adapt, const gw_adapt_config_t *cfg, uint32_t now_ms);
+bool gw_adapt_enabled(const gw_adapt_t *adapt);
+/* Feeds one sample when a period elapsed; returns true when a period was evaluated. */
+bool gw_adapt_update(gw_adapt_t *adapt, uint32_t now_ms, const gw_adapt_sample_t *sample);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,138 @@
+#ifndef GW_AGG_H
+#define GW_AGG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <gateway_engine/gw_codec.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(CONFIG_GW_ENGINE_AGG_MAX_SIGNALS)
+#define GW_AGG_MAX_SIGNALS CONFIG_GW_ENGINE_AGG_MAX_SIGNALS
+#else
+#define GW_AGG_MAX_SIGNALS 8U
+#endif
+
+#if defined(CONFIG_GW_ENGINE_AGG_MAX_BUCKETS)
+#define GW_AGG_MAX_BUCKETS CONFIG_GW_ENGINE_AGG_MAX_BUCKETS
+#else
+#define GW_AGG_MAX_BUCKETS 4U
+#endif
+
+#if defined(CONFIG_GW_ENGINE_AGG_SKETCH_BINS)
+#define GW_AGG_SKETCH_BINS CONFIG_GW_ENGINE_AGG_SKETCH_BINS
+#else
+#define GW_AGG_SKETCH_BINS 0U
+#endif
+
+/* Maps (edge, field) lookups to signals; fields that are not aggregated are cached here too. */
+#define GW_AGG_INDEX_SIZE (GW_AGG_MAX_SIGNALS * 4U)
+
+#define GW_AGG_ANY_EDGE 0xFFFFU
+#define GW_AGG_ANY_FIELD 0xFFFFU
+
+/* Field ids of an emitted summary record. */
+#define GW_AGG_FIELD_SOURCE 1U
+#define GW_AGG_FIELD_COUNT 2U
+#define GW_AGG_FIELD_SUM 3U
+#define GW_AGG_FIELD_MIN 4U
+#define GW_AGG_FIELD_MAX 5U
+#define GW_AGG_FIELD_LAST 6U
+#define GW_AGG_FIELD_AVG 7U
+#define GW_AGG_FIELD_WINDOW_MS 8U
+#define GW_AGG_FIELD_P50 9U
+#define GW_AGG_FIELD_P90 10U
+#define GW_AGG_FIELD_P99 11U
+
+/* Worst-case CBOR size of a summary: 11 fields of at most 8 bytes plus the map head. */
+#define GW_AGG_SUMMARY_MAX_SIZE 96U
+
+/*
+ * hop_ms = 0 is a tumbling window of window_ms. Otherwise the window slides
+ * by hop_ms and window_ms / hop_ms (at most GW_AGG_MAX_BUCKETS) buckets are
+ * kept. sketch_min/sketch_max bound the percentile histogram when
+ * CONFIG_GW_ENGINE_AGG_SKETCH is enabled. pressure_only rules aggregate only
+ * while the uplink is degraded (gw_agg_set_degraded); otherwise their fields
+ * pass through.
+ */
+typedef struct {
+    uint16_t edge_id;
+    uint16_t field_id;
+    uint16_t slot;
+    uint32_t window_ms;
+    uint32_t hop_ms;
+    float sketch_min;
+    float sketch_max;
+    bool pressure_only;
+} gw_agg_rule_t;
+
+typedef struct {
+    const gw_agg_rule_t *rules;
+    size_t rule_count;
+} gw_agg_config_t;
+
+typedef struct {
+    uint32_t count;
+    float sum;
+    float min;
+    float max;
+    float last;
+#if GW_AGG_SKETCH_BINS > 0
+    uint16_t bins[GW_AGG_SKETCH_BINS];
+#endif
+} gw_agg_bucket_t;
+
+typedef struct {
+    uint16_t edge_id;
+    uint16_t field_id;
+    uint16_t rule;
+    uint8_t head;
+    uint8_t buckets_used;
+    uint32_t bucket_end_ms;
+    gw_agg_bucket_t buckets[GW_AGG_MAX_BUCKETS];
+} gw_agg_signal_t;
+
+typedef struct {
+    bool in_use;
+    uint16_t edge_id;
+    uint16_t field_id;
+    uint16_t signal;
+} gw_agg_index_t;
+
+typedef struct {
+    uint32_t samples;
+    uint32_t summaries;
+    uint32_t table_full;
+} gw_agg_stats_t;
+
+/* summary is only valid during the callback. */
+typedef void (*gw_agg_emit_cb)(void *user_data, uint16_t edge_id, uint16_t slot, const gw_codec_record_t *summary);
+
+typedef struct {
+    gw_agg_config_t config;
+    gw_agg_emit_cb emit;
+    void *user_data;
+    gw_agg_index_t index[GW_AGG_INDEX_SIZE];
+    gw_agg_signal_t signals[GW_AGG_MAX_SIGNALS];
+    uint16_t signal_count;
+    bool degraded;
+    gw_agg_stats_t stats;
+} gw_agg_t;
+
+int gw_agg_init(gw_agg_t *agg, const gw_agg_config_t *cfg, gw_agg_emit_cb emit, void *user_data);
+bool gw_agg_enabled(const gw_agg_t *agg);
+/* Consumes the aggregated fields of rec in place; what is left is forwarded as usual. */
+int gw_agg_feed(gw_agg_t *agg, uint16_t edge_id, uint32_t now_ms, gw_codec_record_t *rec);
+void gw_agg_set_degraded(gw_agg_t *agg, bool degraded);
+/* Closes windows that ended without new samples. */
+void gw_agg_poll(gw_agg_t *agg, uint32_t now_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -9,6 +9,29 @@
 extern "C" {
 #endif
 
+#if defined(CONFIG_GW_ENGINE_CLOUD_SLOTS)
+#define GW_CLOUD_SLOTS CONFIG_GW_ENGINE_CLOUD_SLOTS
+#else
+#define GW_CLOUD_SLOTS 4U
+#endif
+
+#if defined(CONFIG_GW_ENGINE_CLOUD_CMD_QUEUE_DEPTH)
+#define GW_CLOUD_CMD_QUEUE_DEPTH CONFIG_GW_ENGINE_CLOUD_CMD_QUEUE_DEPTH
+#else
+#define GW_CLOUD_CMD_QUEUE_DEPTH 4U
+#endif
+
+#if defined(CONFIG_GW_ENGINE_CLOUD_CMD_MAX_PAYLOAD)
+#define GW_CLOUD_CMD_MAX_PAYLOAD CONFIG_GW_ENGINE_CLOUD_CMD_MAX_PAYLOAD
+#else
+#define GW_CLOUD_CMD_MAX_PAYLOAD 256U
+#endif
+
+typedef enum {
+    GW_CLOUD_QUEUE_DROP_NEWEST = 0,
+    GW_CLOUD_QUEUE_DROP_OLDEST = 1,
+} gw_cloud_queue_policy_t;
+
 typedef struct {
     const char *api_base_url;
     const char *bootstrap_url;
@@ -27,6 +50,13 @@ typedef struct {
     uint16_t mqtt_keepalive_sec;
     uint32_t bootstrap_timeout_ms;
     uint32_t mqtt_connect_timeout_ms;
+    gw_cloud_queue_policy_t publish_queue_policy;
+    uint8_t publish_qos;
+    /* Broker quota: publishes and payload bytes per second, 0 = no limit. Bursts default to one second. */
+    uint32_t publish_rate_msgs;
+    uint32_t publish_rate_bytes;
+    uint32_t publish_burst_msgs;
+    uint32_t publish_burst_bytes;
 } gw_cloud_config_t;
 
 typedef enum {
@@ -39,6 +69,65 @@ typedef enum {
     GW_CLOUD_STATUS_REVOKED = 6,
 } gw_cloud_status_t;
 
+typedef enum {
+    GW_CLOUD_TLS_HANDSHAKE_NONE = 0,
+    GW_CLOUD_TLS_HANDSHAKE_FULL = 1,
+    /* A cached session for the same peer was offered; the server may still refuse it. */
+    GW_CLOUD_TLS_HANDSHAKE_SESSION_OFFERED = 2,
+} gw_cloud_tls_handshake_t;
+
+typedef struct {
+    uint32_t full;
+    uint32_t session_offered;
+    uint32_t last_duration_ms;
+    gw_cloud_tls_handshake_t last_type;
+} gw_cloud_tls_stats_t;
+
+typedef struct {
+    uint32_t publish_ok;
+    uint32_t publish_failed;
+    uint32_t queue_dropped;
+    uint16_t queue_high_watermark;
+    uint32_t cred_cache_hits;
+    uint32_t cred_cache_invalidations;
+    gw_cloud_tls_stats_t tls_http;
+    gw_cloud_tls_stats_t tls_mqtt;
+    uint16_t inflight;
+    uint16_t inflight_high_watermark;
+    uint32_t puback_count;
+    uint32_t puback_latency_last_ms;
+    uint32_t puback_latency_avg_ms;
+    uint32_t puback_latency_max_ms;
+    uint32_t qos1_retransmits;
+    uint32_t backpressure;
+    uint32_t topic_alias_hits;
+    uint32_t cmd_received;
+    uint32_t cmd_dropped;
+    /* Time spent inside mqtt_publish(), i.e. until the socket took the bytes. */
+    uint32_t send_latency_last_ms;
+    uint32_t send_latency_avg_ms;
+    /* Publishes waiting for the I/O thread. */
+    uint16_t queue_depth;
+    /* Publishes held back by the token bucket and the time they waited for tokens. */
+    uint32_t rate_deferred;
+    uint32_t rate_deferred_ms;
+    uint32_t rate_deferred_max_ms;
+} gw_cloud_stats_t;
+
+typedef struct {
+    uint32_t published;
+    uint32_t failed;
+    uint32_t bytes;
+} gw_cloud_slot_stats_t;
+
+/* A downlink command for one edge; received_ms is the uptime when the PUBLISH arrived. */
+typedef struct {
+    uint16_t edge_id;
+    uint16_t len;
+    uint32_t received_ms;
+    uint8_t payload[GW_CLOUD_CMD_MAX_PAYLOAD];
+} gw_cloud_command_t;
+
 typedef struct {
     gw_cloud_config_t config;
     bool initialized;
@@ -52,12 +141,26 @@ typedef struct {
     char resolved_mqtt_username[80];
     char resolved_device_secret[96];
     char resolved_topic_prefix[192];
+    gw_cloud_stats_t stats;
+    gw_cloud_slot_stats_t slot_stats[GW_CLOUD_SLOTS];
 } gw_cloud_client_t;
 
 int gw_cloud_init(gw_cloud_client_t *client, const gw_cloud_config_t *cfg);
 int gw_cloud_connect(gw_cloud_client_t *client);
+/*
+ * With CONFIG_GW_ENGINE_CLOUD_THREAD the I/O thread owns connected, stats and
+ * slot_stats; other threads read them through these two. out_slots may be
+ * NULL, otherwise it holds GW_CLOUD_SLOTS entries.
+ */
+bool gw_cloud_is_connected(const gw_cloud_client_t *client);
+void gw_cloud_get_stats(const gw_cloud_client_t *client, gw_cloud_stats_t *out, gw_cloud_slot_stats_t *out_slots);
 int gw_cloud_publish_telemetry(gw_cloud_client_t *client, const uint8_t *payload, size_t payload_len);
+int gw_cloud_publish_slot(gw_cloud_client_t *client, uint16_t slot, const uint8_t *payload, size_t payload_len);
+/* After a publish returned -EAGAIN: milliseconds until the token bucket can pay for it, 0 = unknown (QoS 1 window). */
+uint32_t gw_cloud_publish_wait_ms(const gw_cloud_client_t *client);
 int gw_cloud_pump(gw_cloud_client_t *client);
+/* Returns -EAGAIN when no command is queued. */
+int gw_cloud_poll_command(gw_cloud_client_t *client, gw_cloud_command_t *out);
 int gw_cloud_disconnect(gw_cloud_client_t *client);
 
 #ifdef __cplusplus
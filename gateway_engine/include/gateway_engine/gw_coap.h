@@ -0,0 +1,50 @@
+#ifndef GW_COAP_H
+#define GW_COAP_H
+
+#include <stdint.h>
+
+#include <gateway_engine/gw_engine.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Local CoAP API for LAN clients (Zephyr only):
+ *   GET  /edge/state  shadow document (CBOR), observable
+ *   POST /edge/cmd    CBOR map -> desired state, other payloads -> CONTROL frame
+ *   GET  /metrics     engine metrics (JSON)
+ */
+typedef struct {
+    uint16_t port;
+    /* Minimum spacing between observe notifications; 0 notifies on every change. */
+    uint32_t notify_min_ms;
+    /* Observers get a confirmable notification this often and are dropped if it is never ACKed; 0 = 60 s. */
+    uint32_t con_interval_ms;
+} gw_coap_config_t;
+
+typedef struct {
+    uint32_t requests;
+    uint32_t bad_requests;
+    uint32_t commands;
+    uint32_t notifications;
+    uint32_t observers;
+    uint32_t observers_evicted;
+    uint32_t con_retransmits;
+    uint32_t tx_errors;
+} gw_coap_stats_t;
+
+/* The server reads engine state in place; gw_coap_poll must run on the gw_engine_step thread. */
+int gw_coap_start(gw_engine_t *engine, const gw_coap_config_t *cfg);
+/* Serves queued requests and notifications without blocking. */
+int gw_coap_poll(void);
+/* Blocks up to timeout_ms for a datagram: 1 when one is queued, 0 on timeout. */
+int gw_coap_wait(uint32_t timeout_ms);
+void gw_coap_stop(void);
+int gw_coap_get_stats(gw_coap_stats_t *out_stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,100 @@
+#ifndef GW_CODEC_H
+#define GW_CODEC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(CONFIG_GW_ENGINE_CODEC_MAX_FIELDS)
+#define GW_CODEC_MAX_FIELDS CONFIG_GW_ENGINE_CODEC_MAX_FIELDS
+#else
+#define GW_CODEC_MAX_FIELDS 16U
+#endif
+
+#if defined(CONFIG_GW_ENGINE_BATCH_MAX_POINTS)
+#define GW_CODEC_BATCH_MAX_POINTS CONFIG_GW_ENGINE_BATCH_MAX_POINTS
+#else
+#define GW_CODEC_BATCH_MAX_POINTS 64U
+#endif
+
+/* Field 0 carries the record quality (0 = good) and applies to every other field. */
+#define GW_CODEC_FIELD_QUALITY 0U
+
+typedef enum {
+    GW_CODEC_FORMAT_JSON = 0,
+    GW_CODEC_FORMAT_CBOR = 1,
+    GW_CODEC_FORMAT_GORILLA = 2,
+} gw_codec_format_t;
+
+typedef enum {
+    GW_CODEC_VALUE_UINT = 0,
+    GW_CODEC_VALUE_INT = 1,
+    GW_CODEC_VALUE_FLOAT = 2,
+    GW_CODEC_VALUE_BOOL = 3,
+} gw_codec_value_type_t;
+
+typedef struct {
+    uint16_t id;
+    gw_codec_value_type_t type;
+    union {
+        uint32_t u;
+        int32_t i;
+        float f;
+        bool b;
+    } value;
+} gw_codec_field_t;
+
+/* One telemetry sample: a CBOR map of numeric field id -> value. */
+typedef struct {
+    uint8_t count;
+    gw_codec_field_t fields[GW_CODEC_MAX_FIELDS];
+} gw_codec_record_t;
+
+/* field keeps its type; only the Gorilla encoding reduces it to float32. */
+typedef struct {
+    uint32_t ts_ms;
+    gw_codec_field_t field;
+} gw_codec_point_t;
+
+/* Timestamped field values in arrival order, flushed as one message. */
+typedef struct {
+    uint16_t count;
+    gw_codec_point_t points[GW_CODEC_BATCH_MAX_POINTS];
+} gw_codec_batch_t;
+
+void gw_codec_record_init(gw_codec_record_t *rec);
+int gw_codec_record_add_uint(gw_codec_record_t *rec, uint16_t id, uint32_t value);
+int gw_codec_record_add_int(gw_codec_record_t *rec, uint16_t id, int32_t value);
+int gw_codec_record_add_float(gw_codec_record_t *rec, uint16_t id, float value);
+int gw_codec_record_add_bool(gw_codec_record_t *rec, uint16_t id, bool value);
+float gw_codec_field_as_float(const gw_codec_field_t *field);
+
+int gw_codec_encode_cbor(const gw_codec_record_t *rec, uint8_t *out_buf, size_t out_cap, size_t *out_len);
+int gw_codec_decode_cbor(const uint8_t *buf, size_t len, gw_codec_record_t *out_rec);
+
+void gw_codec_batch_init(gw_codec_batch_t *batch);
+/* Adds every field of rec at ts_ms; -ENOSPC (batch unchanged) when it does not fit. */
+int gw_codec_batch_add(gw_codec_batch_t *batch, uint32_t ts_ms, const gw_codec_record_t *rec);
+/* CBOR: array of [ts_ms, id, value]. GORILLA: see gw_gorilla.h. */
+int gw_codec_encode_batch(
+    const gw_codec_batch_t *batch,
+    gw_codec_format_t format,
+    uint8_t *out_buf,
+    size_t out_cap,
+    size_t *out_len);
+
+/*
+ * JSON text always starts with an ASCII byte, a CBOR map or array never does;
+ * a Gorilla block starts with GW_GORILLA_MAGIC.
+ */
+gw_codec_format_t gw_codec_detect(const uint8_t *payload, size_t payload_len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
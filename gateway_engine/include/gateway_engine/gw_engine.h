@@ -5,15 +5,85 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <gateway_engine/gw_adapt.h>
+#include <gateway_engine/gw_agg.h>
 #include <gateway_engine/gw_cloud.h>
+#include <gateway_engine/gw_codec.h>
+#include <gateway_engine/gw_link_proto.h>
 #include <gateway_engine/gw_ota.h>
 #include <gateway_engine/gw_profile.h>
+#include <gateway_engine/gw_rbe.h>
+#include <gateway_engine/gw_rules.h>
+#include <gateway_engine/gw_shadow.h>
 #include <gateway_engine/gw_transport.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+#if defined(CONFIG_GW_ENGINE_MAX_PENDING_REQUESTS)
+#define GW_ENGINE_MAX_PENDING_REQUESTS CONFIG_GW_ENGINE_MAX_PENDING_REQUESTS
+#else
+#define GW_ENGINE_MAX_PENDING_REQUESTS 32U
+#endif
+
+#if defined(CONFIG_GW_ENGINE_RX_ERROR_WINDOW)
+#define GW_ENGINE_RX_ERROR_WINDOW CONFIG_GW_ENGINE_RX_ERROR_WINDOW
+#else
+#define GW_ENGINE_RX_ERROR_WINDOW 64U
+#endif
+
+#if defined(CONFIG_GW_ENGINE_RX_ERROR_THRESHOLD)
+#define GW_ENGINE_RX_ERROR_THRESHOLD CONFIG_GW_ENGINE_RX_ERROR_THRESHOLD
+#else
+#define GW_ENGINE_RX_ERROR_THRESHOLD 16U
+#endif
+
+#if defined(CONFIG_GW_ENGINE_CLOUD_BACKOFF_MIN_MS)
+#define GW_ENGINE_CLOUD_BACKOFF_MIN_MS CONFIG_GW_ENGINE_CLOUD_BACKOFF_MIN_MS
+#else
+#define GW_ENGINE_CLOUD_BACKOFF_MIN_MS 1000U
+#endif
+
+#if defined(CONFIG_GW_ENGINE_CLOUD_BACKOFF_MAX_MS)
+#define GW_ENGINE_CLOUD_BACKOFF_MAX_MS CONFIG_GW_ENGINE_CLOUD_BACKOFF_MAX_MS
+#else
+#define GW_ENGINE_CLOUD_BACKOFF_MAX_MS 60000U
+#endif
+
+#if defined(CONFIG_GW_ENGINE_CLOUD_AUTH_BACKOFF_MIN_MS)
+#define GW_ENGINE_CLOUD_AUTH_BACKOFF_MIN_MS CONFIG_GW_ENGINE_CLOUD_AUTH_BACKOFF_MIN_MS
+#else
+#define GW_ENGINE_CLOUD_AUTH_BACKOFF_MIN_MS 30000U
+#endif
+
+#if defined(CONFIG_GW_ENGINE_CLOUD_AUTH_BACKOFF_MAX_MS)
+#define GW_ENGINE_CLOUD_AUTH_BACKOFF_MAX_MS CONFIG_GW_ENGINE_CLOUD_AUTH_BACKOFF_MAX_MS
+#else
+#define GW_ENGINE_CLOUD_AUTH_BACKOFF_MAX_MS 1800000U
+#endif
+
+#if defined(CONFIG_GW_ENGINE_CLOUD_BUSY_BACKOFF_MIN_MS)
+#define GW_ENGINE_CLOUD_BUSY_BACKOFF_MIN_MS CONFIG_GW_ENGINE_CLOUD_BUSY_BACKOFF_MIN_MS
+#else
+#define GW_ENGINE_CLOUD_BUSY_BACKOFF_MIN_MS 5000U
+#endif
+
+#if defined(CONFIG_GW_ENGINE_CLOUD_BUSY_BACKOFF_MAX_MS)
+#define GW_ENGINE_CLOUD_BUSY_BACKOFF_MAX_MS CONFIG_GW_ENGINE_CLOUD_BUSY_BACKOFF_MAX_MS
+#else
+#define GW_ENGINE_CLOUD_BUSY_BACKOFF_MAX_MS 300000U
+#endif
+
+#if defined(CONFIG_GW_ENGINE_BATCH_MAX_SIZE)
+#define GW_ENGINE_BATCH_MAX_SIZE CONFIG_GW_ENGINE_BATCH_MAX_SIZE
+#else
+#define GW_ENGINE_BATCH_MAX_SIZE 256U
+#endif
+
+#define GW_ENGINE_ROUTE_ANY_EDGE 0xFFFFU
+#define GW_ENGINE_ROUTE_ANY_CMD 0xFFU
+
 typedef enum {
     GW_ENGINE_STATE_INIT = 0,
     GW_ENGINE_STATE_READY = 1,
@@ -21,21 +91,163 @@ typedef enum {
     GW_ENGINE_STATE_FAULT = 3,
 } gw_engine_state_t;
 
+typedef enum {
+    GW_ENGINE_CLOUD_STATE_OFFLINE = 0,
+    GW_ENGINE_CLOUD_STATE_BACKOFF = 1,
+    GW_ENGINE_CLOUD_STATE_CONNECTING = 2,
+    GW_ENGINE_CLOUD_STATE_CONNECTED = 3,
+} gw_engine_cloud_state_t;
+
+/* Why the last cloud attempt failed; each class has its own backoff policy. */
+typedef enum {
+    GW_ENGINE_CLOUD_RETRY_NETWORK = 0,
+    /* -EACCES/-EPERM: rejected credentials or refused identity. */
+    GW_ENGINE_CLOUD_RETRY_AUTH = 1,
+    /* -EBUSY: HTTP 429/5xx or a broker reporting itself unavailable. */
+    GW_ENGINE_CLOUD_RETRY_BUSY = 2,
+    /* -EAGAIN: bootstrap answered but the device is not claimed yet. */
+    GW_ENGINE_CLOUD_RETRY_UNCLAIMED = 3,
+} gw_engine_cloud_retry_t;
+
+typedef enum {
+    GW_ENGINE_REQUEST_ACK = 0,
+    GW_ENGINE_REQUEST_NACK = 1,
+    GW_ENGINE_REQUEST_TIMEOUT = 2,
+    GW_ENGINE_REQUEST_CANCELLED = 3,
+} gw_engine_request_result_t;
+
+struct gw_engine;
+
+/* response is NULL for TIMEOUT and CANCELLED; its payload is only valid during the callback. */
+typedef void (*gw_engine_request_cb)(
+    struct gw_engine *engine,
+    gw_engine_request_result_t result,
+    const gw_link_frame_view_t *response,
+    void *user_data);
+
+typedef struct {
+    gw_engine_request_cb cb;
+    void *user_data;
+    uint32_t deadline_ms;
+    uint16_t seq;
+    uint8_t cmd;
+    bool in_use;
+} gw_engine_pending_request_t;
+
+typedef struct {
+    uint32_t rx_frames;
+    uint32_t rx_dropped_crc;
+    uint32_t rx_dropped_proto;
+    uint32_t rx_dropped_len;
+    uint32_t rx_rejected;
+    /* OTA frames the OTA backend refused; each is answered with a NACK (send failures in ota_nack_failed). */
+    uint32_t ota_rejected;
+    uint32_t ota_nack_failed;
+    uint32_t rx_transport_errors;
+    uint16_t rx_error_rate_permille;
+    uint32_t cloud_connects;
+    uint32_t cloud_connect_failures;
+    uint32_t cloud_disconnects;
+    uint32_t telemetry_forwarded;
+    uint32_t telemetry_dropped;
+    uint32_t telemetry_suppressed;
+    uint32_t telemetry_summaries;
+    uint32_t telemetry_batches;
+    uint32_t telemetry_deferred;
+    uint32_t rule_actions;
+    uint32_t rule_actions_dropped;
+    uint32_t shadow_documents;
+    uint32_t shadow_pushes;
+    uint32_t shadow_retries;
+    /* Pushes dropped after max_retries, and pushes that did not fit one frame. */
+    uint32_t shadow_push_abandoned;
+    uint32_t shadow_push_failed;
+    uint32_t shadow_resyncs;
+    uint32_t adapt_flush_ms;
+    uint32_t adapt_batch_points;
+    uint32_t adapt_degraded;
+    uint32_t cmd_routed;
+    uint32_t cmd_shadowed;
+    uint32_t cmd_dropped;
+    uint32_t cmd_latency_last_ms;
+    uint32_t cmd_latency_avg_ms;
+    uint32_t cmd_latency_max_ms;
+} gw_engine_metrics_t;
+
+/* Maps frames from an edge (by link cmd) to a cloud publish slot; first match wins. */
+typedef struct {
+    uint16_t edge_id;
+    uint8_t cmd;
+    uint16_t slot;
+} gw_engine_route_t;
+
 typedef struct {
     gw_profile_t profile;
     const char *device_id;
+    uint16_t edge_id;
+    const gw_engine_route_t *routes;
+    size_t route_count;
     uint32_t loop_period_ms;
     gw_cloud_config_t cloud;
     gw_ota_config_t ota;
+    gw_rbe_config_t rbe;
+    gw_agg_config_t agg;
+    /*
+     * batch_max_age_ms = 0 forwards every record on its own; JSON is never batched.
+     * A cloud publish_rate_* limit requires batching so deferred records are kept.
+     */
+    gw_codec_format_t batch_format;
+    uint32_t batch_max_age_ms;
+    gw_rules_config_t rules;
+    /* Delivers rule actions for edges other than edge_id; NULL drops them. */
+    gw_rules_emit_cb rule_forward;
+    void *rule_forward_user_data;
+    gw_shadow_config_t shadow;
+    /* Drives batch_max_age_ms and the batch size from uplink measurements when enabled. */
+    gw_adapt_config_t adapt;
 } gw_engine_config_t;
 
-typedef struct {
+typedef struct gw_engine {
     gw_engine_config_t config;
     gw_transport_t transport;
     gw_cloud_client_t cloud;
     gw_ota_ctx_t ota;
+    gw_rbe_t rbe;
+    gw_agg_t agg;
+    gw_rules_t rules;
+    gw_shadow_t shadow;
+    bool shadow_full_wanted;
+    bool shadow_push_wanted;
+    bool shadow_resync_wanted;
+    bool shadow_push_inflight;
+    bool shadow_push_resync;
+    uint8_t shadow_push_attempts;
+    uint32_t shadow_push_version;
+    uint32_t shadow_retry_at_ms;
+    uint32_t shadow_next_delta_ms;
+    bool edge_seen;
+    uint32_t edge_last_rx_ms;
+    gw_adapt_t adapt;
+    uint32_t adapt_rejected_seen;
+    gw_codec_batch_t batch;
+    uint16_t batch_slot;
+    uint32_t batch_flush_at_ms;
+    /* The open batch met an empty token bucket; counted once in telemetry_deferred. */
+    bool batch_deferred;
     gw_engine_state_t state;
+    gw_engine_cloud_state_t cloud_state;
+    bool uplink_available;
+    uint32_t cloud_retry_at_ms;
+    /* Backoff window of cloud_retry_class; the next delay is drawn uniformly below it. */
+    uint32_t cloud_backoff_ms;
+    gw_engine_cloud_retry_t cloud_retry_class;
+    int cloud_last_error;
     uint16_t tx_seq;
+    gw_engine_pending_request_t pending[GW_ENGINE_MAX_PENDING_REQUESTS];
+    uint16_t pending_count;
+    gw_engine_metrics_t metrics;
+    uint16_t rx_window_frames;
+    uint16_t rx_window_errors;
     bool initialized;
     bool running;
 } gw_engine_t;
@@ -44,7 +256,23 @@ int gw_engine_init(gw_engine_t *engine, const gw_engine_config_t *cfg, const gw_
 int gw_engine_start(gw_engine_t *engine);
 int gw_engine_step(gw_engine_t *engine);
 int gw_engine_send(gw_engine_t *engine, uint8_t cmd, const uint8_t *payload, uint16_t payload_len);
+int gw_engine_request(
+    gw_engine_t *engine,
+    uint8_t cmd,
+    const uint8_t *payload,
+    uint16_t payload_len,
+    uint32_t timeout_ms,
+    gw_engine_request_cb cb,
+    void *user_data);
+int gw_engine_set_uplink(gw_engine_t *engine, bool available);
 int gw_engine_stop(gw_engine_t *engine);
+/* Replaces the local rule table; the running table is kept when the new one is invalid. */
+int gw_engine_load_rules(gw_engine_t *engine, const gw_rule_t *rules, size_t rule_count);
+/* Local desired state update, pushed to the edge like a cloud shadow command. */
+int gw_engine_set_desired(gw_engine_t *engine, const gw_codec_record_t *desired);
+/* Full shadow document: reported values and pending desired values, with their versions. */
+int gw_engine_get_shadow(const gw_engine_t *engine, gw_codec_record_t *out_reported, gw_codec_record_t *out_desired);
+int gw_engine_get_metrics(const gw_engine_t *engine, gw_engine_metrics_t *out_metrics);
 const char *gw_engine_profile_name(const gw_engine_t *engine);
 
 #ifdef __cplusplus
@@ -0,0 +1,38 @@
+#ifndef GW_GORILLA_H
+#define GW_GORILLA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <gateway_engine/gw_codec.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* First byte of a block; neither ASCII nor a CBOR map/array head, so gw_codec_detect can tell it apart. */
+#define GW_GORILLA_MAGIC 0xC7U
+#define GW_GORILLA_VERSION 1U
+
+/*
+ * Block layout (big endian):
+ *   magic u8, version u8, series u8,
+ *   per series: field id u16, points u16, stream bytes u16, bit stream.
+ *
+ * Each series stream starts with the first timestamp and float bits (32 + 32
+ * bits). Following points carry the delta-of-delta of the timestamp:
+ *   '0' (0) | '10' + 7 bits | '110' + 9 bits | '1110' + 12 bits | '1111' + 32 bits
+ * and the XOR with the previous value:
+ *   '0' (same) | '10' + bits inside the previous window |
+ *   '11' + 5-bit leading zeros + 6-bit length + bits.
+ */
+int gw_gorilla_encode_batch(const gw_codec_batch_t *batch, uint8_t *out_buf, size_t out_cap, size_t *out_len);
+
+/* Reference decoder, plain C with no Zephyr dependency; points come out grouped by series. */
+int gw_gorilla_decode_batch(const uint8_t *buf, size_t len, gw_codec_batch_t *out_batch);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
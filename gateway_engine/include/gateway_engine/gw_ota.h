@@ -13,22 +13,37 @@ typedef enum {
     GW_OTA_STATE_RECEIVING = 1,
     GW_OTA_STATE_VERIFYING = 2,
     GW_OTA_STATE_READY_TO_APPLY = 3,
+    /* Storage or verification failed; last_error says why, gw_ota_begin restarts. */
+    GW_OTA_STATE_FAILED = 4,
 } gw_ota_state_t;
 
 typedef struct {
     uint32_t chunk_size;
+    /* Longest a chunk may wait for the flash writer before the transfer fails. */
     uint32_t timeout_ms;
 } gw_ota_config_t;
 
+typedef struct {
+    uint32_t bytes_written;
+    uint32_t pages_written;
+    uint32_t pages_erased;
+    /* Chunks that found both page buffers full and waited for the writer. */
+    uint32_t stalls;
+    uint32_t stall_ms;
+} gw_ota_stats_t;
+
 typedef struct {
     gw_ota_config_t config;
     gw_ota_state_t state;
     uint32_t bytes_received;
+    int last_error;
+    gw_ota_stats_t stats;
 } gw_ota_ctx_t;
 
 int gw_ota_init(gw_ota_ctx_t *ctx, const gw_ota_config_t *cfg);
 int gw_ota_begin(gw_ota_ctx_t *ctx);
 int gw_ota_push_chunk(gw_ota_ctx_t *ctx, const uint8_t *chunk, size_t chunk_len);
+/* Completion is asynchronous with a flash backend: gw_ota_pump moves VERIFYING to READY_TO_APPLY. */
 int gw_ota_finish(gw_ota_ctx_t *ctx);
 int gw_ota_pump(gw_ota_ctx_t *ctx);
 
@@ -0,0 +1,87 @@
+#ifndef GW_RBE_H
+#define GW_RBE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <gateway_engine/gw_codec.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(CONFIG_GW_ENGINE_RBE_MAX_SIGNALS)
+#define GW_RBE_MAX_SIGNALS CONFIG_GW_ENGINE_RBE_MAX_SIGNALS
+#else
+#define GW_RBE_MAX_SIGNALS 64U
+#endif
+
+#define GW_RBE_ANY_EDGE 0xFFFFU
+#define GW_RBE_ANY_FIELD 0xFFFFU
+
+/*
+ * Report-by-exception band for (edge, field); the first matching band wins.
+ * A field is reported when it leaves either deadband (absolute or percent of
+ * the last reported value), when integrity_ms passed since its last report,
+ * or when the edge quality changed. A quality change is reported even when no
+ * value moved. Zero deadbands report any change; integrity_ms = 0 never forces
+ * a report.
+ */
+typedef struct {
+    uint16_t edge_id;
+    uint16_t field_id;
+    float abs_deadband;
+    float pct_deadband;
+    uint32_t integrity_ms;
+} gw_rbe_band_t;
+
+typedef struct {
+    const gw_rbe_band_t *bands;
+    size_t band_count;
+} gw_rbe_config_t;
+
+typedef struct {
+    uint32_t fields_in;
+    uint32_t fields_out;
+    uint32_t forced_integrity;
+    uint32_t forced_quality;
+    uint32_t quality_rejected;
+    uint32_t table_full;
+} gw_rbe_stats_t;
+
+/* Last reported value per (edge, field); band is an index into config.bands. */
+typedef struct {
+    bool in_use;
+    bool reported;
+    uint16_t edge_id;
+    uint16_t field_id;
+    uint16_t band;
+    uint32_t quality;
+    uint32_t last_sent_ms;
+    gw_codec_field_t last;
+} gw_rbe_signal_t;
+
+typedef struct {
+    gw_rbe_config_t config;
+    gw_rbe_signal_t signals[GW_RBE_MAX_SIGNALS];
+    uint16_t signal_count;
+    gw_rbe_stats_t stats;
+} gw_rbe_t;
+
+int gw_rbe_init(gw_rbe_t *rbe, const gw_rbe_config_t *cfg);
+bool gw_rbe_enabled(const gw_rbe_t *rbe);
+/*
+ * Copies the fields of in that must be reported into out; out->count == 0 means
+ * nothing to send. -EINVAL when the quality field is not an unsigned integer
+ * code (integral floats are converted).
+ */
+int gw_rbe_filter(gw_rbe_t *rbe, uint16_t edge_id, uint32_t now_ms, const gw_codec_record_t *in, gw_codec_record_t *out);
+/* Forgets the last reported values so the next record of every signal is sent in full. */
+void gw_rbe_reset(gw_rbe_t *rbe);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
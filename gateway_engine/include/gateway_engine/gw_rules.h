@@ -0,0 +1,116 @@
+#ifndef GW_RULES_H
+#define GW_RULES_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <gateway_engine/gw_codec.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(CONFIG_GW_ENGINE_RULES_MAX)
+#define GW_RULES_MAX CONFIG_GW_ENGINE_RULES_MAX
+#else
+#define GW_RULES_MAX 16U
+#endif
+
+#if defined(CONFIG_GW_ENGINE_RULES_ACTION_MAX)
+#define GW_RULES_ACTION_MAX CONFIG_GW_ENGINE_RULES_ACTION_MAX
+#else
+#define GW_RULES_ACTION_MAX 8U
+#endif
+
+/* One slot per distinct (edge, field) key; at most one key per rule. */
+#define GW_RULES_INDEX_SIZE (GW_RULES_MAX * 2U)
+
+#define GW_RULES_ANY_EDGE 0xFFFFU
+
+typedef enum {
+    /* Fires on every sample that meets the condition, at most once per min_interval_ms. */
+    GW_RULE_LEVEL = 0,
+    /* Fires action when the condition becomes true and release when it becomes false. */
+    GW_RULE_EDGE = 1,
+    /* Like EDGE, but only releases once the value crosses back past reset. */
+    GW_RULE_HYSTERESIS = 2,
+} gw_rule_kind_t;
+
+typedef enum {
+    GW_RULE_ABOVE = 0,
+    GW_RULE_BELOW = 1,
+} gw_rule_op_t;
+
+/*
+ * When field_id from src_edge is above (or below) threshold, action is sent to
+ * dst_edge as a CONTROL payload. release (release_len = 0 for none) is sent
+ * when an EDGE or HYSTERESIS rule goes back to idle.
+ */
+typedef struct {
+    uint16_t src_edge;
+    uint16_t field_id;
+    uint16_t dst_edge;
+    uint8_t kind;
+    uint8_t op;
+    float threshold;
+    float reset;
+    uint32_t min_interval_ms;
+    uint8_t action_len;
+    uint8_t release_len;
+    uint8_t action[GW_RULES_ACTION_MAX];
+    uint8_t release[GW_RULES_ACTION_MAX];
+} gw_rule_t;
+
+typedef struct {
+    const gw_rule_t *rules;
+    size_t rule_count;
+} gw_rules_config_t;
+
+typedef struct {
+    uint32_t evaluated;
+    uint32_t fired;
+    uint32_t released;
+    uint32_t throttled;
+} gw_rules_stats_t;
+
+typedef struct {
+    bool active;
+    bool fired_once;
+    uint32_t last_fire_ms;
+} gw_rule_state_t;
+
+/* Rules are kept sorted by (src_edge, field_id); first/count is the run for one key. */
+typedef struct {
+    bool in_use;
+    uint16_t edge_id;
+    uint16_t field_id;
+    uint8_t first;
+    uint8_t count;
+} gw_rules_index_t;
+
+/* payload is only valid during the callback. */
+typedef void (*gw_rules_emit_cb)(void *user_data, uint16_t dst_edge, const uint8_t *payload, size_t payload_len);
+
+typedef struct {
+    gw_rule_t rules[GW_RULES_MAX];
+    gw_rule_state_t state[GW_RULES_MAX];
+    gw_rules_index_t index[GW_RULES_INDEX_SIZE];
+    uint8_t rule_count;
+    gw_rules_emit_cb emit;
+    void *user_data;
+    gw_rules_stats_t stats;
+} gw_rules_t;
+
+int gw_rules_init(gw_rules_t *rules, const gw_rules_config_t *cfg, gw_rules_emit_cb emit, void *user_data);
+/* Validates and copies a new table; on error the running table is kept. Rule state starts idle. */
+int gw_rules_load(gw_rules_t *rules, const gw_rule_t *table, size_t count);
+bool gw_rules_enabled(const gw_rules_t *rules);
+/* Evaluates only the rules indexed under (edge_id, field) and (GW_RULES_ANY_EDGE, field). */
+void gw_rules_eval(gw_rules_t *rules, uint16_t edge_id, uint32_t now_ms, const gw_codec_record_t *rec);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
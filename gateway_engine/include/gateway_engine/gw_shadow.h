@@ -0,0 +1,114 @@
+#ifndef GW_SHADOW_H
+#define GW_SHADOW_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <gateway_engine/gw_codec.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if GW_CODEC_MAX_FIELDS < 3
+#error "GW_CODEC_MAX_FIELDS must leave room for the shadow version fields"
+#endif
+
+/* Each sub-document is one record; the desired one also carries two version fields. */
+#define GW_SHADOW_MAX_FIELDS (GW_CODEC_MAX_FIELDS - 2U)
+
+/* Reserved ids carried in shadow documents; telemetry fields with these ids are ignored. */
+#define GW_SHADOW_FIELD_VERSION 0xFFFEU
+#define GW_SHADOW_FIELD_DESIRED_VERSION 0xFFFDU
+#define GW_SHADOW_FIELD_ACKED_VERSION 0xFFFCU
+
+/* Retries of one desired push when max_retries = 0; the wait doubles up to 8 x ack_timeout_ms. */
+#define GW_SHADOW_DEFAULT_MAX_RETRIES 5U
+#define GW_SHADOW_RETRY_MAX_SHIFT 3U
+
+/*
+ * slot receives the shadow documents. Deltas go out at most once per
+ * delta_min_ms. A frame from the edge after resync_idle_ms of silence counts
+ * as a reconnect and the desired state is pushed in one CONTROL frame,
+ * ACK-tracked with ack_timeout_ms; a frame that times out or is NACKed is
+ * sent again with exponential backoff, at most max_retries times. The values
+ * stay pending after that and go out with the next update or resync.
+ */
+typedef struct {
+    bool enabled;
+    uint16_t slot;
+    uint32_t delta_min_ms;
+    uint32_t resync_idle_ms;
+    uint32_t ack_timeout_ms;
+    uint8_t max_retries;
+} gw_shadow_config_t;
+
+typedef struct {
+    uint16_t id;
+    bool has_reported;
+    bool has_desired;
+    bool pending;
+    bool dirty;
+    uint32_t desired_version;
+    gw_codec_field_t reported;
+    gw_codec_field_t desired;
+} gw_shadow_field_t;
+
+typedef struct {
+    uint32_t reported_updates;
+    uint32_t desired_updates;
+    uint32_t acks;
+    uint32_t table_full;
+} gw_shadow_stats_t;
+
+/*
+ * version counts reported changes; desired_version counts desired changes and
+ * acked_version is the last desired_version confirmed by the edge.
+ */
+typedef struct {
+    gw_shadow_config_t config;
+    gw_shadow_field_t fields[GW_SHADOW_MAX_FIELDS];
+    uint8_t field_count;
+    uint32_t version;
+    uint32_t desired_version;
+    uint32_t acked_version;
+    bool desired_dirty;
+    gw_shadow_stats_t stats;
+} gw_shadow_t;
+
+int gw_shadow_init(gw_shadow_t *shadow, const gw_shadow_config_t *cfg);
+bool gw_shadow_enabled(const gw_shadow_t *shadow);
+/* Merges reported values from telemetry; changed fields join the next delta. */
+void gw_shadow_report(gw_shadow_t *shadow, const gw_codec_record_t *rec);
+/* Records desired values; they stay pending until the edge ACKs them. */
+int gw_shadow_set_desired(gw_shadow_t *shadow, const gw_codec_record_t *rec);
+/* Desired values for the edge: pending ones only, or every desired value when all is set. */
+void gw_shadow_desired(const gw_shadow_t *shadow, bool all, gw_codec_record_t *out);
+/* The edge applied desired state up to desired_version; it becomes reported. */
+void gw_shadow_ack(gw_shadow_t *shadow, uint32_t desired_version);
+bool gw_shadow_has_delta(const gw_shadow_t *shadow);
+/*
+ * reported: changed reported fields (or all when full is set) plus
+ * GW_SHADOW_FIELD_VERSION. desired: values not yet ACKed by the edge plus
+ * GW_SHADOW_FIELD_DESIRED_VERSION and GW_SHADOW_FIELD_ACKED_VERSION.
+ */
+void gw_shadow_document(
+    const gw_shadow_t *shadow,
+    bool full,
+    gw_codec_record_t *reported,
+    gw_codec_record_t *desired);
+/* CBOR array of two maps: [reported, desired]. */
+int gw_shadow_encode(
+    const gw_codec_record_t *reported,
+    const gw_codec_record_t *desired,
+    uint8_t *out_buf,
+    size_t out_cap,
+    size_t *out_len);
+void gw_shadow_clear_delta(gw_shadow_t *shadow);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
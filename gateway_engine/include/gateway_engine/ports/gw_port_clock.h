@@ -0,0 +1,16 @@
+#ifndef GW_PORT_CLOCK_H
+#define GW_PORT_CLOCK_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint32_t gw_port_clock_now_ms(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
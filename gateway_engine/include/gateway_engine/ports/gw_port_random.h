@@ -0,0 +1,16 @@
+#ifndef GW_PORT_RANDOM_H
+#define GW_PORT_RANDOM_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint32_t gw_port_random_u32(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
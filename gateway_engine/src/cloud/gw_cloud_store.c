@@ -0,0 +1,208 @@
+#include "gw_cloud_store.h"
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/settings/settings.h>
+
+#define GW_CLOUD_STORE_KEY "gw/cloud/creds"
+#define GW_CLOUD_STORE_MAGIC 0x47574343U
+#define GW_CLOUD_STORE_VERSION 1U
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint8_t status;
+    uint8_t reserved;
+    uint8_t fingerprint[GW_CLOUD_STORE_FINGERPRINT_SIZE];
+    int64_t saved_at_s;
+    uint32_t poll_interval_s;
+    char device_id[sizeof(((gw_cloud_client_t *)0)->resolved_device_id)];
+    char hardware_id[sizeof(((gw_cloud_client_t *)0)->resolved_hardware_id)];
+    char broker[sizeof(((gw_cloud_client_t *)0)->resolved_broker)];
+    char mqtt_username[sizeof(((gw_cloud_client_t *)0)->resolved_mqtt_username)];
+    char device_secret[sizeof(((gw_cloud_client_t *)0)->resolved_device_secret)];
+    char topic_prefix[sizeof(((gw_cloud_client_t *)0)->resolved_topic_prefix)];
+} gw_cloud_store_record_t;
+
+typedef struct {
+    gw_cloud_store_record_t *record;
+    bool found;
+} gw_cloud_store_load_ctx_t;
+
+static gw_cloud_store_record_t g_record;
+
+static int gw_cloud_store_init(void)
+{
+    static bool initialized;
+    int rc;
+
+    if (initialized) {
+        return 0;
+    }
+
+    rc = settings_subsys_init();
+    if (rc != 0) {
+        return rc;
+    }
+
+    initialized = true;
+    return 0;
+}
+
+static int gw_cloud_store_load_cb(const char *key, size_t len, settings_read_cb read_cb, void *cb_arg, void *param)
+{
+    gw_cloud_store_load_ctx_t *ctx = (gw_cloud_store_load_ctx_t *)param;
+    ssize_t n;
+
+    /* The subtree is the full key, so only the leaf itself (key == NULL) is of interest. */
+    if (key != NULL || len != sizeof(*ctx->record)) {
+        return 0;
+    }
+
+    n = read_cb(cb_arg, ctx->record, sizeof(*ctx->record));
+    ctx->found = (n == (ssize_t)sizeof(*ctx->record));
+    return 0;
+}
+
+static bool gw_cloud_store_strings_ok(const gw_cloud_store_record_t *rec)
+{
+    return memchr(rec->device_id, '\0', sizeof(rec->device_id)) != NULL &&
+           memchr(rec->hardware_id, '\0', sizeof(rec->hardware_id)) != NULL &&
+           memchr(rec->broker, '\0', sizeof(rec->broker)) != NULL &&
+           memchr(rec->mqtt_username, '\0', sizeof(rec->mqtt_username)) != NULL &&
+           memchr(rec->device_secret, '\0', sizeof(rec->device_secret)) != NULL &&
+           memchr(rec->topic_prefix, '\0', sizeof(rec->topic_prefix)) != NULL;
+}
+
+/*
+ * Validity policy: same identity/endpoint fingerprint, device was claimed or
+ * active, complete MQTT credentials, and younger than the configured max age.
+ * Records stamped before wall-clock time was known are accepted; the broker
+ * rejecting them is what ultimately forces a fresh bootstrap.
+ */
+static int gw_cloud_store_validate(const gw_cloud_store_record_t *rec, const uint8_t *fingerprint)
+{
+    time_t now;
+
+    if (rec->magic != GW_CLOUD_STORE_MAGIC || rec->version != GW_CLOUD_STORE_VERSION) {
+        return -EBADMSG;
+    }
+
+    if (memcmp(rec->fingerprint, fingerprint, GW_CLOUD_STORE_FINGERPRINT_SIZE) != 0) {
+        return -ESTALE;
+    }
+
+    if (rec->status != (uint8_t)GW_CLOUD_STATUS_CLAIMED && rec->status != (uint8_t)GW_CLOUD_STATUS_ACTIVE) {
+        return -EACCES;
+    }
+
+    if (!gw_cloud_store_strings_ok(rec) || rec->broker[0] == '\0' || rec->mqtt_username[0] == '\0' ||
+        rec->device_secret[0] == '\0' || rec->topic_prefix[0] == '\0') {
+        return -EBADMSG;
+    }
+
+    now = time(NULL);
+    if (now > 0 && rec->saved_at_s > 0 &&
+        ((int64_t)now < rec->saved_at_s ||
+         ((int64_t)now - rec->saved_at_s) > (int64_t)CONFIG_GW_ENGINE_CLOUD_CRED_CACHE_MAX_AGE_S)) {
+        return -ESTALE;
+    }
+
+    return 0;
+}
+
+int gw_cloud_store_load(gw_cloud_client_t *client, const uint8_t fingerprint[GW_CLOUD_STORE_FINGERPRINT_SIZE])
+{
+    gw_cloud_store_load_ctx_t ctx;
+    int rc;
+
+    if (client == NULL || fingerprint == NULL) {
+        return -EINVAL;
+    }
+
+    rc = gw_cloud_store_init();
+    if (rc != 0) {
+        return rc;
+    }
+
+    (void)memset(&g_record, 0, sizeof(g_record));
+    ctx.record = &g_record;
+    ctx.found = false;
+
+    rc = settings_load_subtree_direct(GW_CLOUD_STORE_KEY, gw_cloud_store_load_cb, &ctx);
+    if (rc != 0) {
+        return rc;
+    }
+
+    if (!ctx.found) {
+        return -ENOENT;
+    }
+
+    rc = gw_cloud_store_validate(&g_record, fingerprint);
+    if (rc != 0) {
+        return rc;
+    }
+
+    client->status = (gw_cloud_status_t)g_record.status;
+    client->poll_interval_s = g_record.poll_interval_s;
+    (void)memcpy(client->resolved_device_id, g_record.device_id, sizeof(g_record.device_id));
+    (void)memcpy(client->resolved_hardware_id, g_record.hardware_id, sizeof(g_record.hardware_id));
+    (void)memcpy(client->resolved_broker, g_record.broker, sizeof(g_record.broker));
+    (void)memcpy(client->resolved_mqtt_username, g_record.mqtt_username, sizeof(g_record.mqtt_username));
+    (void)memcpy(client->resolved_device_secret, g_record.device_secret, sizeof(g_record.device_secret));
+    (void)memcpy(client->resolved_topic_prefix, g_record.topic_prefix, sizeof(g_record.topic_prefix));
+    client->credentials_ready = true;
+
+    return 0;
+}
+
+int gw_cloud_store_save(const gw_cloud_client_t *client, const uint8_t fingerprint[GW_CLOUD_STORE_FINGERPRINT_SIZE])
+{
+    time_t now;
+    int rc;
+
+    if (client == NULL || fingerprint == NULL) {
+        return -EINVAL;
+    }
+
+    rc = gw_cloud_store_init();
+    if (rc != 0) {
+        return rc;
+    }
+
+    (void)memset(&g_record, 0, sizeof(g_record));
+    g_record.magic = GW_CLOUD_STORE_MAGIC;
+    g_record.version = GW_CLOUD_STORE_VERSION;
+    g_record.status = (uint8_t)client->status;
+    (void)memcpy(g_record.fingerprint, fingerprint, GW_CLOUD_STORE_FINGERPRINT_SIZE);
+
+    now = time(NULL);
+    g_record.saved_at_s = (now > 0) ? (int64_t)now : 0;
+    g_record.poll_interval_s = client->poll_interval_s;
+
+    (void)memcpy(g_record.device_id, client->resolved_device_id, sizeof(g_record.device_id));
+    (void)memcpy(g_record.hardware_id, client->resolved_hardware_id, sizeof(g_record.hardware_id));
+    (void)memcpy(g_record.broker, client->resolved_broker, sizeof(g_record.broker));
+    (void)memcpy(g_record.mqtt_username, client->resolved_mqtt_username, sizeof(g_record.mqtt_username));
+    (void)memcpy(g_record.device_secret, client->resolved_device_secret, sizeof(g_record.device_secret));
+    (void)memcpy(g_record.topic_prefix, client->resolved_topic_prefix, sizeof(g_record.topic_prefix));
+
+    return settings_save_one(GW_CLOUD_STORE_KEY, &g_record, sizeof(g_record));
+}
+
+int gw_cloud_store_clear(void)
+{
+    int rc;
+
+    rc = gw_cloud_store_init();
+    if (rc != 0) {
+        return rc;
+    }
+
+    return settings_delete(GW_CLOUD_STORE_KEY);
+}
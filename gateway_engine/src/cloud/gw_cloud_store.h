@@ -0,0 +1,14 @@
+#ifndef GW_CLOUD_STORE_H
+#define GW_CLOUD_STORE_H
+
+#include <stdint.h>
+
+#include <gateway_engine/gw_cloud.h>
+
+#define GW_CLOUD_STORE_FINGERPRINT_SIZE 8U
+
+int gw_cloud_store_load(gw_cloud_client_t *client, const uint8_t fingerprint[GW_CLOUD_STORE_FINGERPRINT_SIZE]);
+int gw_cloud_store_save(const gw_cloud_client_t *client, const uint8_t fingerprint[GW_CLOUD_STORE_FINGERPRINT_SIZE]);
+int gw_cloud_store_clear(void);
+
+#endif
@@ -1,4 +1,5 @@
 #include <errno.h>
+#include <string.h>
 
 #include <gateway_engine/gw_cloud.h>
 
@@ -15,6 +16,23 @@ int gw_cloud_init(gw_cloud_client_t *client, const gw_cloud_config_t *cfg)
     return 0;
 }
 
+bool gw_cloud_is_connected(const gw_cloud_client_t *client)
+{
+    return client != NULL && client->connected;
+}
+
+void gw_cloud_get_stats(const gw_cloud_client_t *client, gw_cloud_stats_t *out, gw_cloud_slot_stats_t *out_slots)
+{
+    if (client == NULL || out == NULL) {
+        return;
+    }
+
+    *out = client->stats;
+    if (out_slots != NULL) {
+        (void)memcpy(out_slots, client->slot_stats, sizeof(client->slot_stats));
+    }
+}
+
 int gw_cloud_connect(gw_cloud_client_t *client)
 {
     if (client == NULL || !client->initialized) {
@@ -38,6 +56,21 @@ int gw_cloud_publish_telemetry(gw_cloud_client_t *client, const uint8_t *payload
     return 0;
 }
 
+int gw_cloud_publish_slot(gw_cloud_client_t *client, uint16_t slot, const uint8_t *payload, size_t payload_len)
+{
+    if (slot >= GW_CLOUD_SLOTS) {
+        return -EINVAL;
+    }
+
+    return gw_cloud_publish_telemetry(client, payload, payload_len);
+}
+
+uint32_t gw_cloud_publish_wait_ms(const gw_cloud_client_t *client)
+{
+    (void)client;
+    return 0U;
+}
+
 int gw_cloud_pump(gw_cloud_client_t *client)
 {
     if (client == NULL || !client->connected) {
@@ -47,6 +80,15 @@ int gw_cloud_pump(gw_cloud_client_t *client)
     return 0;
 }
 
+int gw_cloud_poll_command(gw_cloud_client_t *client, gw_cloud_command_t *out)
+{
+    if (client == NULL || out == NULL) {
+        return -EINVAL;
+    }
+
+    return -EAGAIN;
+}
+
 int gw_cloud_disconnect(gw_cloud_client_t *client)
 {
     if (client == NULL || !client->initialized) {
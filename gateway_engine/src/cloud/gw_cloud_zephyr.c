@@ -1,3 +1,4 @@
+#include <ctype.h>
 #include <errno.h>
 #include <stdarg.h>
 #include <stddef.h>
@@ -8,23 +9,32 @@
 #include <time.h>
 
 #include <zephyr/kernel.h>
-#include <zephyr/net/http/client.h>
+#include <zephyr/net/dns_resolve.h>
 #include <zephyr/net/mqtt.h>
-#include <zephyr/posix/netdb.h>
+#include <zephyr/net/net_ip.h>
+#include <zephyr/posix/fcntl.h>
 #include <zephyr/posix/sys/socket.h>
 #include <zephyr/posix/unistd.h>
 #include <zephyr/net/socket.h>
 #include <zephyr/net/tls_credentials.h>
 #include <zephyr/posix/poll.h>
+#if defined(CONFIG_GW_ENGINE_CLOUD_THREAD)
+#include <zephyr/posix/sys/eventfd.h>
+#endif
 
 #include <gateway_engine/gw_cloud.h>
+#include <gateway_engine/gw_codec.h>
 
 #include "gw_sha256.h"
+#if defined(CONFIG_GW_ENGINE_CLOUD_CRED_CACHE)
+#include "gw_cloud_store.h"
+#endif
 
 #define GW_CLOUD_HTTP_TIMEOUT_MS 5000
 #define GW_CLOUD_MQTT_CONNECT_TIMEOUT_MS 5000
 #define GW_CLOUD_MAX_HTTP_BODY 1024
-#define GW_CLOUD_MAX_HTTP_RX 1024
+#define GW_CLOUD_MAX_HTTP_REQ 768
+#define GW_CLOUD_MAX_HTTP_RX 2048
 #define GW_CLOUD_MAX_URL_HOST 96
 #define GW_CLOUD_MAX_URL_PATH 128
 #define GW_CLOUD_MAX_URL_BUF 192
@@ -34,7 +44,52 @@
 #define GW_CLOUD_MQTT_RX_BUF 2048
 #define GW_CLOUD_MQTT_TX_BUF 2048
 #define GW_CLOUD_MQTT_WS_TMP_BUF 1024
-#define GW_CLOUD_TOPIC_SLOT 0
+#define GW_CLOUD_TOPIC_FORMATS 3
+#define GW_CLOUD_MAX_TOPIC 216
+#define GW_CLOUD_CMD_TOPIC "/cmd/"
+#define GW_CLOUD_CMD_DRAIN_CHUNK 32
+
+#if defined(CONFIG_GW_ENGINE_CLOUD_DNS_CACHE_ENTRIES)
+#define GW_DNS_CACHE_ENTRIES CONFIG_GW_ENGINE_CLOUD_DNS_CACHE_ENTRIES
+#else
+#define GW_DNS_CACHE_ENTRIES 2
+#endif
+
+#if defined(CONFIG_GW_ENGINE_CLOUD_DNS_CACHE_TTL_S)
+#define GW_DNS_CACHE_TTL_S CONFIG_GW_ENGINE_CLOUD_DNS_CACHE_TTL_S
+#else
+#define GW_DNS_CACHE_TTL_S 300
+#endif
+
+#if defined(CONFIG_GW_ENGINE_CLOUD_DNS_CACHE_STALE_S)
+#define GW_DNS_CACHE_STALE_S CONFIG_GW_ENGINE_CLOUD_DNS_CACHE_STALE_S
+#else
+#define GW_DNS_CACHE_STALE_S 86400
+#endif
+
+#if defined(CONFIG_GW_ENGINE_CLOUD_DNS_MAX_ADDRS)
+#define GW_DNS_MAX_ADDRS CONFIG_GW_ENGINE_CLOUD_DNS_MAX_ADDRS
+#else
+#define GW_DNS_MAX_ADDRS 4
+#endif
+
+#if defined(CONFIG_GW_ENGINE_CLOUD_MQTT_INFLIGHT)
+#define GW_MQTT_INFLIGHT CONFIG_GW_ENGINE_CLOUD_MQTT_INFLIGHT
+#else
+#define GW_MQTT_INFLIGHT 8
+#endif
+
+#if defined(CONFIG_GW_ENGINE_CLOUD_MQTT_INFLIGHT_MAX_PAYLOAD)
+#define GW_MQTT_INFLIGHT_MAX_PAYLOAD CONFIG_GW_ENGINE_CLOUD_MQTT_INFLIGHT_MAX_PAYLOAD
+#else
+#define GW_MQTT_INFLIGHT_MAX_PAYLOAD 256
+#endif
+
+#if defined(CONFIG_GW_ENGINE_CLOUD_CONNECT_STAGGER_MS)
+#define GW_CONNECT_STAGGER_MS CONFIG_GW_ENGINE_CLOUD_CONNECT_STAGGER_MS
+#else
+#define GW_CONNECT_STAGGER_MS 250
+#endif
 
 typedef enum {
     GW_URL_SCHEME_HTTP = 0,
@@ -56,6 +111,123 @@ typedef struct {
     uint16_t status_code;
 } gw_http_result_t;
 
+typedef enum {
+    GW_DNS_STATE_IDLE = 0,
+    GW_DNS_STATE_PENDING = 1,
+    GW_DNS_STATE_DONE = 2,
+    GW_DNS_STATE_FAILED = 3,
+} gw_dns_state_t;
+
+/* One AAAA and one A query run side by side; answers are kept per family. */
+enum {
+    GW_DNS_FAMILY_V6 = 0,
+    GW_DNS_FAMILY_V4 = 1,
+    GW_DNS_FAMILIES = 2,
+};
+
+/*
+ * The resolver callbacks fill found[]; the last query to finish interleaves
+ * the families into addrs/count and publishes state last. addr holds the
+ * address to use (the first ranked one, or the race winner).
+ */
+typedef struct {
+    atomic_t state;
+    atomic_t outstanding;
+    uint16_t ids[GW_DNS_FAMILIES];
+    bool started[GW_DNS_FAMILIES];
+    struct sockaddr_storage found[GW_DNS_FAMILIES][GW_DNS_MAX_ADDRS];
+    socklen_t found_lens[GW_DNS_FAMILIES][GW_DNS_MAX_ADDRS];
+    uint8_t found_count[GW_DNS_FAMILIES];
+    uint16_t port;
+    char host[GW_CLOUD_MAX_URL_HOST];
+    struct sockaddr_storage addrs[GW_DNS_MAX_ADDRS];
+    socklen_t addrlens[GW_DNS_MAX_ADDRS];
+    uint8_t count;
+    bool from_resolver;
+    struct sockaddr_storage addr;
+    socklen_t addrlen;
+} gw_dns_query_t;
+
+typedef struct {
+    char host[GW_CLOUD_MAX_URL_HOST];
+    struct sockaddr_storage addrs[GW_DNS_MAX_ADDRS];
+    socklen_t addrlens[GW_DNS_MAX_ADDRS];
+    uint8_t count;
+    int64_t expires_at;
+    int64_t stale_until;
+} gw_dns_cache_entry_t;
+
+/* Parallel connect attempts to the resolved addresses, started GW_CONNECT_STAGGER_MS apart. */
+typedef struct {
+    int socks[GW_DNS_MAX_ADDRS];
+    uint8_t started;
+    int64_t next_start;
+    int last_err;
+} gw_conn_race_t;
+
+/* Remembers the last peer a TLS handshake completed with; the socket layer caches its session. */
+typedef struct {
+    struct sockaddr_storage peer;
+    bool peer_valid;
+    gw_cloud_tls_handshake_t type;
+    int64_t started;
+} gw_tls_tracker_t;
+
+typedef enum {
+    GW_HTTP_STEP_IDLE = 0,
+    GW_HTTP_STEP_RESOLVE = 1,
+    GW_HTTP_STEP_CONNECT = 2,
+    GW_HTTP_STEP_SEND = 3,
+    GW_HTTP_STEP_RECV = 4,
+} gw_http_step_t;
+
+typedef struct {
+    gw_http_step_t step;
+    gw_url_t url;
+    int tls_sec_tag;
+    int sock;
+    bool reused;
+    int64_t deadline;
+    gw_dns_query_t dns;
+    gw_conn_race_t race;
+    gw_tls_tracker_t tls;
+    gw_cloud_tls_stats_t *tls_stats;
+    char tx_buf[GW_CLOUD_MAX_HTTP_REQ];
+    size_t tx_len;
+    size_t tx_off;
+    char rx_buf[GW_CLOUD_MAX_HTTP_RX + 1];
+    size_t rx_len;
+} gw_http_exchange_t;
+
+typedef enum {
+    GW_CONN_STAGE_IDLE = 0,
+    GW_CONN_STAGE_BOOTSTRAP = 1,
+    GW_CONN_STAGE_SECRET = 2,
+    GW_CONN_STAGE_BROKER_RESOLVE = 3,
+    GW_CONN_STAGE_MQTT_CONNECT = 4,
+    GW_CONN_STAGE_WAIT_CONNACK = 5,
+    GW_CONN_STAGE_CONNECTED = 6,
+} gw_conn_stage_t;
+
+typedef struct {
+    gw_conn_stage_t stage;
+    int64_t deadline;
+    gw_http_exchange_t http;
+    gw_http_result_t result;
+    gw_url_t broker_url;
+    gw_dns_query_t broker_dns;
+    gw_tls_tracker_t broker_tls;
+    bool from_cache;
+} gw_cloud_connector_t;
+
+/* Built once per connection; alias is the MQTT 5 topic alias (0 = none yet). */
+typedef struct {
+    char name[GW_CLOUD_MAX_TOPIC];
+    uint16_t len;
+    uint16_t alias;
+    bool alias_sent;
+} gw_cloud_topic_t;
+
 typedef struct {
     struct mqtt_client mqtt;
     struct mqtt_utf8 mqtt_user_name;
@@ -66,7 +238,12 @@ typedef struct {
     bool mqtt_connected;
     bool connack_received;
     int connack_result;
-    uint16_t last_message_id;
+    int connack_code;
+    uint16_t topic_alias_max;
+    uint16_t topic_alias_next;
+    gw_cloud_topic_t topics[GW_CLOUD_SLOTS][GW_CLOUD_TOPIC_FORMATS];
+    char cmd_filter[GW_CLOUD_MAX_TOPIC];
+    uint16_t cmd_filter_len;
     sec_tag_t sec_tags[1];
     uint8_t mqtt_rx_buf[GW_CLOUD_MQTT_RX_BUF];
     uint8_t mqtt_tx_buf[GW_CLOUD_MQTT_TX_BUF];
@@ -75,7 +252,59 @@ typedef struct {
 #endif
 } gw_cloud_runtime_t;
 
+typedef struct {
+    bool in_use;
+    uint16_t message_id;
+    uint16_t slot;
+    uint16_t len;
+    uint32_t order;
+    int64_t sent_at;
+    uint8_t payload[GW_MQTT_INFLIGHT_MAX_PAYLOAD];
+} gw_mqtt_inflight_entry_t;
+
+/* QoS 1 publishes awaiting PUBACK; kept across reconnects for DUP retransmission. */
+typedef struct {
+    gw_mqtt_inflight_entry_t entries[GW_MQTT_INFLIGHT];
+    uint16_t count;
+    uint16_t last_message_id;
+    uint32_t next_order;
+} gw_mqtt_inflight_t;
+
+/*
+ * Downlink commands. The MQTT event handler is the only producer and fills the
+ * slot past the tail before publishing it through count; the lock only guards
+ * head/count.
+ */
+typedef struct {
+    struct k_spinlock lock;
+    gw_cloud_command_t items[GW_CLOUD_CMD_QUEUE_DEPTH];
+    uint16_t head;
+    uint16_t count;
+} gw_cloud_cmd_queue_t;
+
+/* Publish token bucket in thousandths of a message / byte, so short refills are not lost. */
+typedef struct {
+    int64_t msg_tokens;
+    int64_t byte_tokens;
+    int64_t refilled_at;
+    int64_t deferred_since;
+    bool deferred;
+    /* Wait returned by the last gw_cloud_rate_take(), for gw_cloud_publish_wait_ms(). */
+    uint32_t wait_ms;
+} gw_cloud_rate_t;
+
 static gw_cloud_runtime_t g_rt;
+static gw_mqtt_inflight_t g_inflight;
+static gw_cloud_rate_t g_rate;
+static gw_cloud_cmd_queue_t g_cmds;
+/* HMAC midstates for manufacturing_key, computed once in gw_cloud_init. */
+static gw_hmac_sha256_key_t g_sign_key;
+static gw_dns_cache_entry_t g_dns_cache[GW_DNS_CACHE_ENTRIES];
+static gw_cloud_connector_t g_conn = {
+    .http = {
+        .sock = -1,
+    },
+};
 
 static size_t gw_strnlen_safe(const char *s, size_t max)
 {
@@ -216,6 +445,7 @@ static int gw_make_signature(
 {
     char msg[GW_CLOUD_MAX_MSG_BUF];
     uint8_t mac[32];
+    int rc;
 
     if (cfg == NULL || identity_key == NULL || timestamp == NULL || out_sig_hex == NULL) {
         return -EINVAL;
@@ -229,12 +459,11 @@ static int gw_make_signature(
         return -ENOSPC;
     }
 
-    gw_hmac_sha256(
-        (const uint8_t *)cfg->manufacturing_key,
-        strlen(cfg->manufacturing_key),
-        (const uint8_t *)msg,
-        strlen(msg),
-        mac);
+    /* A backend failure must fail the request, not sign it with a zero MAC. */
+    rc = gw_hmac_sha256_keyed(&g_sign_key, (const uint8_t *)msg, strlen(msg), mac);
+    if (rc != 0) {
+        return rc;
+    }
 
     gw_hex_encode(mac, sizeof(mac), out_sig_hex, out_sig_hex_sz);
     if (out_sig_hex[0] == '\0') {
@@ -370,824 +599,2830 @@ static bool gw_url_is_tls(const gw_url_t *url)
     return url->scheme == GW_URL_SCHEME_HTTPS || url->scheme == GW_URL_SCHEME_WSS;
 }
 
-static int gw_socket_connect(const gw_url_t *url, int tls_sec_tag, int *out_sock)
+static bool gw_ascii_ieq(const char *a, const char *b, size_t len)
 {
-    struct addrinfo hints;
-    struct addrinfo *res = NULL;
-    struct addrinfo *it;
-    char port_buf[8];
-    int sock = -1;
-    int rc;
+    size_t i;
 
-    if (url == NULL || out_sock == NULL) {
-        return -EINVAL;
+    for (i = 0; i < len; ++i) {
+        if (tolower((unsigned char)a[i]) != tolower((unsigned char)b[i])) {
+            return false;
+        }
     }
 
-    (void)memset(&hints, 0, sizeof(hints));
-    hints.ai_family = AF_UNSPEC;
-    hints.ai_socktype = SOCK_STREAM;
-    hints.ai_protocol = gw_url_is_tls(url) ? IPPROTO_TLS_1_2 : IPPROTO_TCP;
+    return true;
+}
 
-    rc = gw_snprintf_checked(port_buf, sizeof(port_buf), "%u", url->port);
-    if (rc != 0) {
-        return rc;
+static void gw_sockaddr_set_port(struct sockaddr *addr, uint16_t port)
+{
+    if (addr->sa_family == AF_INET) {
+        net_sin(addr)->sin_port = htons(port);
+    } else if (addr->sa_family == AF_INET6) {
+        net_sin6(addr)->sin6_port = htons(port);
     }
+}
+
+static bool gw_dns_parse_literal(gw_dns_query_t *q, const char *host)
+{
+    struct sockaddr_in *sin = (struct sockaddr_in *)&q->addrs[0];
+    struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)&q->addrs[0];
 
-    rc = getaddrinfo(url->host, port_buf, &hints, &res);
-    if (rc != 0 || res == NULL) {
-        return -EHOSTUNREACH;
+    if (net_addr_pton(AF_INET, host, &sin->sin_addr) == 0) {
+        sin->sin_family = AF_INET;
+        q->addrlens[0] = sizeof(*sin);
+        q->count = 1U;
+        return true;
     }
 
-    for (it = res; it != NULL; it = it->ai_next) {
-        sock = socket(it->ai_family, it->ai_socktype, hints.ai_protocol);
-        if (sock < 0) {
-            continue;
-        }
+    (void)memset(&q->addrs[0], 0, sizeof(q->addrs[0]));
 
-        if (gw_url_is_tls(url)) {
-            sec_tag_t sec_tags[1];
+    if (net_addr_pton(AF_INET6, host, &sin6->sin6_addr) == 0) {
+        sin6->sin6_family = AF_INET6;
+        q->addrlens[0] = sizeof(*sin6);
+        q->count = 1U;
+        return true;
+    }
 
-            if (tls_sec_tag < 0) {
-                close(sock);
-                sock = -1;
-                continue;
-            }
+    (void)memset(&q->addrs[0], 0, sizeof(q->addrs[0]));
+    return false;
+}
 
-            sec_tags[0] = (sec_tag_t)tls_sec_tag;
+/*
+ * Called once per finished query (answered, failed or never started). The
+ * last one builds the ranked list alternating families, IPv6 first (RFC 8305
+ * section 4), so the connect race spans both.
+ */
+static void gw_dns_query_done(gw_dns_query_t *q)
+{
+    uint8_t next[GW_DNS_FAMILIES] = {0U, 0U};
+    size_t fam = GW_DNS_FAMILY_V6;
+    size_t tries;
 
-            rc = setsockopt(sock, SOL_TLS, TLS_SEC_TAG_LIST, sec_tags, sizeof(sec_tags));
-            if (rc < 0) {
-                close(sock);
-                sock = -1;
-                continue;
-            }
+    if (atomic_dec(&q->outstanding) != 1) {
+        return;
+    }
 
-            rc = setsockopt(sock, SOL_TLS, TLS_HOSTNAME, url->host, strlen(url->host) + 1U);
-            if (rc < 0) {
-                close(sock);
-                sock = -1;
-                continue;
-            }
+    q->count = 0U;
+    for (tries = 0U; q->count < GW_DNS_MAX_ADDRS && tries < GW_DNS_FAMILIES;) {
+        if (next[fam] < q->found_count[fam]) {
+            q->addrs[q->count] = q->found[fam][next[fam]];
+            q->addrlens[q->count] = q->found_lens[fam][next[fam]];
+            q->count++;
+            next[fam]++;
+            tries = 0U;
+        } else {
+            tries++;
         }
+        fam = (fam + 1U) % GW_DNS_FAMILIES;
+    }
 
-        rc = connect(sock, it->ai_addr, it->ai_addrlen);
-        if (rc == 0) {
+    (void)atomic_set(&q->state, (q->count > 0U) ? GW_DNS_STATE_DONE : GW_DNS_STATE_FAILED);
+}
+
+static void gw_dns_cb(enum dns_resolve_status status, struct dns_addrinfo *info, void *user_data)
+{
+    gw_dns_query_t *q = (gw_dns_query_t *)user_data;
+    size_t fam;
+
+    if (q == NULL || atomic_get(&q->state) != GW_DNS_STATE_PENDING) {
+        return;
+    }
+
+    switch (status) {
+    case DNS_EAI_INPROGRESS:
+        if (info == NULL || info->ai_addrlen > sizeof(q->found[0][0])) {
             break;
         }
+        fam = (info->ai_addr.sa_family == AF_INET6) ? GW_DNS_FAMILY_V6 : GW_DNS_FAMILY_V4;
+        if (q->found_count[fam] < GW_DNS_MAX_ADDRS) {
+            (void)memcpy(&q->found[fam][q->found_count[fam]], &info->ai_addr, info->ai_addrlen);
+            q->found_lens[fam][q->found_count[fam]] = info->ai_addrlen;
+            q->found_count[fam]++;
+        }
+        break;
 
-        close(sock);
-        sock = -1;
+    default:
+        /* ALLDONE, an error or a timeout ends this query; the other may still run. */
+        gw_dns_query_done(q);
+        break;
     }
+}
 
-    freeaddrinfo(res);
+static gw_dns_cache_entry_t *gw_dns_cache_find(const char *host)
+{
+    size_t i;
 
-    if (sock < 0) {
-        return -ECONNREFUSED;
+    for (i = 0U; i < GW_DNS_CACHE_ENTRIES; ++i) {
+        if (g_dns_cache[i].count > 0U && strcmp(g_dns_cache[i].host, host) == 0) {
+            return &g_dns_cache[i];
+        }
     }
 
-    *out_sock = sock;
-    return 0;
+    return NULL;
+}
+
+static void gw_dns_cache_store(const gw_dns_query_t *q)
+{
+    gw_dns_cache_entry_t *e = gw_dns_cache_find(q->host);
+    int64_t now = k_uptime_get();
+    size_t i;
+
+    if (e == NULL) {
+        /* Replace an empty slot or the one closest to going stale. */
+        e = &g_dns_cache[0];
+        for (i = 0U; i < GW_DNS_CACHE_ENTRIES; ++i) {
+            if (g_dns_cache[i].count == 0U) {
+                e = &g_dns_cache[i];
+                break;
+            }
+            if (g_dns_cache[i].stale_until < e->stale_until) {
+                e = &g_dns_cache[i];
+            }
+        }
+    }
+
+    (void)memset(e, 0, sizeof(*e));
+    (void)memcpy(e->host, q->host, sizeof(e->host));
+    (void)memcpy(e->addrs, q->addrs, sizeof(e->addrs));
+    (void)memcpy(e->addrlens, q->addrlens, sizeof(e->addrlens));
+    e->count = q->count;
+    e->expires_at = now + ((int64_t)GW_DNS_CACHE_TTL_S * 1000);
+    e->stale_until = e->expires_at + ((int64_t)GW_DNS_CACHE_STALE_S * 1000);
 }
 
-static int gw_http_response_cb(struct http_response *rsp, enum http_final_call final_data, void *user_data)
+static void gw_dns_cache_copy(gw_dns_query_t *q, const gw_dns_cache_entry_t *e)
 {
-    gw_http_result_t *result = (gw_http_result_t *)user_data;
+    (void)memcpy(q->addrs, e->addrs, sizeof(q->addrs));
+    (void)memcpy(q->addrlens, e->addrlens, sizeof(q->addrlens));
+    q->count = e->count;
+}
 
-    ARG_UNUSED(final_data);
+/* Reorders the cached addresses for host so addr is tried first (prefer) or last (demote). */
+static void gw_dns_cache_rank(const char *host, const struct sockaddr_storage *addr, bool prefer)
+{
+    gw_dns_cache_entry_t *e = gw_dns_cache_find(host);
+    struct sockaddr_storage key;
+    struct sockaddr_storage tmp_addr;
+    socklen_t tmp_len;
+    size_t idx;
+    size_t i;
 
-    if (rsp == NULL || result == NULL) {
-        return -EINVAL;
+    if (e == NULL) {
+        return;
     }
 
-    result->status_code = rsp->http_status_code;
+    /* Cached addresses are stored without a port. */
+    key = *addr;
+    gw_sockaddr_set_port((struct sockaddr *)&key, 0U);
+
+    for (idx = 0U; idx < e->count; ++idx) {
+        if (memcmp(&e->addrs[idx], &key, sizeof(key)) == 0) {
+            break;
+        }
+    }
+    if (idx >= e->count) {
+        return;
+    }
 
-    if (rsp->body_frag_start != NULL && rsp->body_frag_len > 0U) {
-        size_t copy_len = rsp->body_frag_len;
+    tmp_addr = e->addrs[idx];
+    tmp_len = e->addrlens[idx];
 
-        if (result->body_len + copy_len >= sizeof(result->body)) {
-            copy_len = sizeof(result->body) - result->body_len - 1U;
+    if (prefer) {
+        for (i = idx; i > 0U; --i) {
+            e->addrs[i] = e->addrs[i - 1U];
+            e->addrlens[i] = e->addrlens[i - 1U];
         }
+        e->addrs[0] = tmp_addr;
+        e->addrlens[0] = tmp_len;
+    } else {
+        for (i = idx; i + 1U < e->count; ++i) {
+            e->addrs[i] = e->addrs[i + 1U];
+            e->addrlens[i] = e->addrlens[i + 1U];
+        }
+        e->addrs[e->count - 1U] = tmp_addr;
+        e->addrlens[e->count - 1U] = tmp_len;
+    }
+}
 
-        if (copy_len > 0U) {
-            (void)memcpy(&result->body[result->body_len], rsp->body_frag_start, copy_len);
-            result->body_len += copy_len;
-            result->body[result->body_len] = '\0';
+static void gw_dns_cancel(gw_dns_query_t *q)
+{
+    size_t fam;
+
+    if (atomic_get(&q->state) == GW_DNS_STATE_PENDING) {
+        (void)atomic_set(&q->state, GW_DNS_STATE_IDLE);
+        for (fam = 0U; fam < GW_DNS_FAMILIES; ++fam) {
+            if (q->started[fam]) {
+                (void)dns_cancel_addr_info(q->ids[fam]);
+            }
         }
     }
 
-    return 0;
+    (void)atomic_set(&q->state, GW_DNS_STATE_IDLE);
 }
 
-static int gw_http_post_json(
-    const gw_url_t *url,
-    int tls_sec_tag,
-    const char *payload,
-    uint32_t timeout_ms,
-    gw_http_result_t *out_result)
+/* Starts the query for one family; a family the stack lacks, or a failed start, counts as finished. */
+static void gw_dns_query_start(gw_dns_query_t *q, size_t fam, uint32_t timeout_ms)
 {
-    int sock = -1;
-    int rc;
-    struct http_request req;
-    static const char *const HDRS[] = {
-        "Accept: application/json\r\n",
-        "Connection: close\r\n",
-        NULL,
-    };
-    char recv_buf[GW_CLOUD_MAX_HTTP_RX];
-    char port_buf[8];
+    bool supported = (fam == GW_DNS_FAMILY_V6) ? IS_ENABLED(CONFIG_NET_IPV6) : IS_ENABLED(CONFIG_NET_IPV4);
+    enum dns_query_type type = (fam == GW_DNS_FAMILY_V6) ? DNS_QUERY_TYPE_AAAA : DNS_QUERY_TYPE_A;
 
-    if (url == NULL || payload == NULL || out_result == NULL) {
-        return -EINVAL;
+    q->started[fam] = supported &&
+                      dns_get_addr_info(q->host, type, &q->ids[fam], gw_dns_cb, q, (int32_t)timeout_ms) == 0;
+    if (!q->started[fam]) {
+        gw_dns_query_done(q);
     }
+}
+
+/* Fresh cache entries answer immediately; otherwise a query runs and stale entries back it up. */
+static int gw_dns_start(gw_dns_query_t *q, const char *host, uint16_t port, uint32_t timeout_ms)
+{
+    const gw_dns_cache_entry_t *e;
+    int rc;
 
-    (void)memset(out_result, 0, sizeof(*out_result));
+    gw_dns_cancel(q);
 
-    rc = gw_socket_connect(url, tls_sec_tag, &sock);
+    (void)memset(q->addrs, 0, sizeof(q->addrs));
+    (void)memset(q->addrlens, 0, sizeof(q->addrlens));
+    (void)memset(q->found_count, 0, sizeof(q->found_count));
+    (void)memset(q->started, 0, sizeof(q->started));
+    (void)memset(&q->addr, 0, sizeof(q->addr));
+    q->addrlen = 0U;
+    q->count = 0U;
+    q->from_resolver = false;
+    q->port = port;
+
+    rc = gw_copy_string(q->host, sizeof(q->host), host);
     if (rc != 0) {
         return rc;
     }
 
-    (void)memset(&req, 0, sizeof(req));
-    rc = gw_snprintf_checked(port_buf, sizeof(port_buf), "%u", url->port);
-    if (rc != 0) {
-        close(sock);
-        return rc;
+    if (gw_dns_parse_literal(q, host)) {
+        (void)atomic_set(&q->state, GW_DNS_STATE_DONE);
+        return 0;
     }
 
-    req.method = HTTP_POST;
-    req.url = url->path;
-    req.host = url->host;
-    req.port = port_buf;
-    req.protocol = "HTTP/1.1";
-    req.header_fields = HDRS;
-    req.content_type_value = "application/json";
-    req.payload = payload;
-    req.payload_len = strlen(payload);
-    req.response = gw_http_response_cb;
-    req.recv_buf = (uint8_t *)recv_buf;
-    req.recv_buf_len = sizeof(recv_buf);
+    e = gw_dns_cache_find(host);
+    if (e != NULL && k_uptime_get() < e->expires_at) {
+        gw_dns_cache_copy(q, e);
+        (void)atomic_set(&q->state, GW_DNS_STATE_DONE);
+        return 0;
+    }
 
-    rc = http_client_req(sock, &req, (int32_t)timeout_ms, out_result);
-    close(sock);
+    q->from_resolver = true;
+    (void)atomic_set(&q->outstanding, GW_DNS_FAMILIES);
+    (void)atomic_set(&q->state, GW_DNS_STATE_PENDING);
 
-    if (rc < 0) {
-        return rc;
-    }
+    gw_dns_query_start(q, GW_DNS_FAMILY_V6, timeout_ms);
+    gw_dns_query_start(q, GW_DNS_FAMILY_V4, timeout_ms);
 
     return 0;
 }
 
-static const char *gw_json_find_key(const char *json, const char *key)
+static int gw_dns_poll(gw_dns_query_t *q)
 {
-    char pattern[48];
+    const gw_dns_cache_entry_t *e;
+    size_t i;
 
-    if (json == NULL || key == NULL) {
-        return NULL;
+    switch ((gw_dns_state_t)atomic_get(&q->state)) {
+    case GW_DNS_STATE_DONE:
+        break;
+    case GW_DNS_STATE_PENDING:
+        return -EINPROGRESS;
+    case GW_DNS_STATE_FAILED:
+        e = gw_dns_cache_find(q->host);
+        if (e == NULL || k_uptime_get() >= e->stale_until) {
+            return -EHOSTUNREACH;
+        }
+        /* Resolver is down: keep using the last known addresses. */
+        gw_dns_cache_copy(q, e);
+        q->from_resolver = false;
+        (void)atomic_set(&q->state, GW_DNS_STATE_DONE);
+        break;
+    default:
+        return -EINVAL;
     }
 
-    if (gw_snprintf_checked(pattern, sizeof(pattern), "\"%s\"", key) != 0) {
-        return NULL;
+    if (q->addrlen == 0U) {
+        if (q->from_resolver) {
+            gw_dns_cache_store(q);
+        }
+
+        for (i = 0U; i < q->count; ++i) {
+            gw_sockaddr_set_port((struct sockaddr *)&q->addrs[i], q->port);
+        }
+        (void)memcpy(&q->addr, &q->addrs[0], sizeof(q->addr));
+        q->addrlen = q->addrlens[0];
     }
 
-    return strstr(json, pattern);
+    return 0;
 }
 
-static int gw_json_get_string(const char *json, const char *key, char *out, size_t out_sz)
+static void gw_tls_handshake_begin(gw_tls_tracker_t *t, const struct sockaddr_storage *peer)
 {
-    const char *p;
-    const char *q;
-    size_t len;
-
-    if (json == NULL || key == NULL || out == NULL || out_sz == 0U) {
-        return -EINVAL;
-    }
-
-    p = gw_json_find_key(json, key);
-    if (p == NULL) {
-        return -ENOENT;
-    }
+    t->started = k_uptime_get();
+    t->type = GW_CLOUD_TLS_HANDSHAKE_FULL;
 
-    p = strchr(p, ':');
-    if (p == NULL) {
-        return -EBADMSG;
+#if defined(CONFIG_GW_ENGINE_CLOUD_TLS_SESSION_CACHE)
+    if (t->peer_valid && memcmp(&t->peer, peer, sizeof(t->peer)) == 0) {
+        t->type = GW_CLOUD_TLS_HANDSHAKE_SESSION_OFFERED;
     }
-    ++p;
+#endif
 
-    while (*p == ' ' || *p == '\t') {
-        ++p;
-    }
+    (void)memcpy(&t->peer, peer, sizeof(t->peer));
+    t->peer_valid = false;
+}
 
-    if (*p != '"') {
-        return -EBADMSG;
+static void gw_tls_handshake_done(gw_tls_tracker_t *t, gw_cloud_tls_stats_t *stats)
+{
+    if (t->type == GW_CLOUD_TLS_HANDSHAKE_NONE) {
+        return;
     }
-    ++p;
 
-    q = strchr(p, '"');
-    if (q == NULL) {
-        return -EBADMSG;
-    }
+    t->peer_valid = true;
 
-    len = (size_t)(q - p);
-    if (len >= out_sz) {
-        return -ENOSPC;
+    if (stats != NULL) {
+        if (t->type == GW_CLOUD_TLS_HANDSHAKE_SESSION_OFFERED) {
+            stats->session_offered++;
+        } else {
+            stats->full++;
+        }
+        stats->last_type = t->type;
+        stats->last_duration_ms = (uint32_t)(k_uptime_get() - t->started);
     }
 
-    (void)memcpy(out, p, len);
-    out[len] = '\0';
-    return 0;
+    t->type = GW_CLOUD_TLS_HANDSHAKE_NONE;
 }
 
-static int gw_json_get_uint(const char *json, const char *key, uint32_t *out)
+static int gw_socket_connect_start(
+    const gw_url_t *url,
+    int tls_sec_tag,
+    const struct sockaddr *addr,
+    socklen_t addrlen,
+    int *out_sock)
 {
-    const char *p;
-    long value;
+    int sock;
+    int flags;
+    int rc;
 
-    if (json == NULL || key == NULL || out == NULL) {
+    if (url == NULL || addr == NULL || out_sock == NULL) {
         return -EINVAL;
     }
 
-    p = gw_json_find_key(json, key);
-    if (p == NULL) {
-        return -ENOENT;
+    if (gw_url_is_tls(url) && tls_sec_tag < 0) {
+        return -EINVAL;
     }
 
-    p = strchr(p, ':');
-    if (p == NULL) {
-        return -EBADMSG;
+    sock = socket(addr->sa_family, SOCK_STREAM, gw_url_is_tls(url) ? IPPROTO_TLS_1_2 : IPPROTO_TCP);
+    if (sock < 0) {
+        return -errno;
     }
-    ++p;
 
-    while (*p == ' ' || *p == '\t') {
-        ++p;
-    }
+    if (gw_url_is_tls(url)) {
+        sec_tag_t sec_tags[1];
 
-    value = strtol(p, NULL, 10);
-    if (value < 0L) {
-        return -ERANGE;
-    }
+        sec_tags[0] = (sec_tag_t)tls_sec_tag;
 
-    *out = (uint32_t)value;
-    return 0;
-}
+        rc = setsockopt(sock, SOL_TLS, TLS_SEC_TAG_LIST, sec_tags, sizeof(sec_tags));
+        if (rc == 0) {
+            rc = setsockopt(sock, SOL_TLS, TLS_HOSTNAME, url->host, strlen(url->host) + 1U);
+        }
+#if defined(CONFIG_GW_ENGINE_CLOUD_TLS_SESSION_CACHE)
+        if (rc == 0) {
+            int cache = TLS_SESSION_CACHE_ENABLED;
 
-static gw_cloud_status_t gw_status_from_string(const char *status)
-{
-    if (status == NULL) {
-        return GW_CLOUD_STATUS_UNKNOWN;
+            rc = setsockopt(sock, SOL_TLS, TLS_SESSION_CACHE, &cache, sizeof(cache));
+        }
+#endif
+        if (rc < 0) {
+            rc = -errno;
+            close(sock);
+            return rc;
+        }
     }
 
-    if (strcmp(status, "not_provisioned") == 0) {
-        return GW_CLOUD_STATUS_NOT_PROVISIONED;
+    flags = fcntl(sock, F_GETFL, 0);
+    if (flags < 0 || fcntl(sock, F_SETFL, flags | O_NONBLOCK) < 0) {
+        rc = -errno;
+        close(sock);
+        return rc;
     }
-    if (strcmp(status, "unclaimed") == 0) {
-        return GW_CLOUD_STATUS_UNCLAIMED;
+
+    rc = connect(sock, addr, addrlen);
+    if (rc < 0 && errno != EINPROGRESS && errno != EAGAIN) {
+        rc = -errno;
+        close(sock);
+        return rc;
     }
-    if (strcmp(status, "claimed") == 0) {
-        return GW_CLOUD_STATUS_CLAIMED;
+
+    *out_sock = sock;
+    return 0;
+}
+
+static int gw_socket_connect_poll(int sock)
+{
+    struct pollfd pfd;
+    int sock_err = 0;
+    socklen_t sock_err_len = sizeof(sock_err);
+    int rc;
+
+    pfd.fd = sock;
+    pfd.events = POLLOUT;
+    pfd.revents = 0;
+
+    rc = poll(&pfd, 1, 0);
+    if (rc < 0) {
+        return -errno;
     }
-    if (strcmp(status, "active") == 0) {
-        return GW_CLOUD_STATUS_ACTIVE;
+    if (rc == 0) {
+        return -EINPROGRESS;
     }
-    if (strcmp(status, "suspended") == 0) {
-        return GW_CLOUD_STATUS_SUSPENDED;
+
+    if (getsockopt(sock, SOL_SOCKET, SO_ERROR, &sock_err, &sock_err_len) == 0 && sock_err != 0) {
+        return -sock_err;
     }
-    if (strcmp(status, "revoked") == 0) {
-        return GW_CLOUD_STATUS_REVOKED;
+
+    if ((pfd.revents & (POLLERR | POLLHUP | POLLNVAL)) != 0) {
+        return -ECONNREFUSED;
     }
 
-    return GW_CLOUD_STATUS_UNKNOWN;
+    return 0;
 }
 
-static int gw_build_api_url(
-    const char *explicit_url,
-    const char *api_base_url,
-    const char *path_suffix,
-    char *out,
-    size_t out_sz)
+static void gw_conn_race_reset(gw_conn_race_t *r)
 {
-    size_t base_len;
+    size_t i;
 
-    if (out == NULL || out_sz == 0U) {
-        return -EINVAL;
+    for (i = 0U; i < r->started; ++i) {
+        if (r->socks[i] >= 0) {
+            close(r->socks[i]);
+            r->socks[i] = -1;
+        }
     }
 
-    if (explicit_url != NULL && explicit_url[0] != '\0') {
-        return gw_copy_string(out, out_sz, explicit_url);
+    r->started = 0U;
+    r->last_err = -ECONNREFUSED;
+}
+
+static void gw_conn_race_start_next(gw_conn_race_t *r, const gw_url_t *url, int tls_sec_tag, const gw_dns_query_t *q)
+{
+    size_t idx = r->started;
+    int rc;
+
+    r->socks[idx] = -1;
+    rc = gw_socket_connect_start(
+        url,
+        tls_sec_tag,
+        (const struct sockaddr *)&q->addrs[idx],
+        q->addrlens[idx],
+        &r->socks[idx]);
+    if (rc != 0) {
+        r->last_err = rc;
     }
 
-    if (api_base_url == NULL || api_base_url[0] == '\0' || path_suffix == NULL) {
-        return -EINVAL;
+    r->started++;
+    r->next_start = k_uptime_get() + GW_CONNECT_STAGGER_MS;
+}
+
+/*
+ * Happy-eyeballs style connect: addresses are tried in rank order, a new attempt
+ * starts every GW_CONNECT_STAGGER_MS (or as soon as all running ones failed), and
+ * the first socket to connect wins. The winner's address is stored in q->addr.
+ */
+static int gw_conn_race_poll(gw_conn_race_t *r, const gw_url_t *url, int tls_sec_tag, gw_dns_query_t *q, int *out_sock)
+{
+    bool pending = false;
+    size_t i;
+    int rc;
+
+    for (i = 0U; i < r->started; ++i) {
+        if (r->socks[i] < 0) {
+            continue;
+        }
+
+        rc = gw_socket_connect_poll(r->socks[i]);
+        if (rc == -EINPROGRESS) {
+            pending = true;
+            continue;
+        }
+
+        if (rc != 0) {
+            close(r->socks[i]);
+            r->socks[i] = -1;
+            r->last_err = rc;
+            continue;
+        }
+
+        *out_sock = r->socks[i];
+        r->socks[i] = -1;
+        (void)memcpy(&q->addr, &q->addrs[i], sizeof(q->addr));
+        q->addrlen = q->addrlens[i];
+        gw_dns_cache_rank(q->host, &q->addr, true);
+        gw_conn_race_reset(r);
+        return 0;
     }
 
-    base_len = strlen(api_base_url);
-    if (base_len > 0U && api_base_url[base_len - 1U] == '/') {
-        return gw_snprintf_checked(out, out_sz, "%s%s", api_base_url, path_suffix + 1);
+    while (r->started < q->count && (!pending || k_uptime_get() >= r->next_start)) {
+        gw_conn_race_start_next(r, url, tls_sec_tag, q);
+        if (r->socks[r->started - 1U] >= 0) {
+            pending = true;
+            break;
+        }
     }
 
-    return gw_snprintf_checked(out, out_sz, "%s%s", api_base_url, path_suffix);
+    return pending ? -EINPROGRESS : r->last_err;
 }
 
-static int gw_derive_secret_from_bootstrap(const char *bootstrap_url, char *out, size_t out_sz)
+static const char *gw_http_find_header(const char *headers, const char *headers_end, const char *name)
 {
-    static const char SUFFIX_BOOTSTRAP[] = "/bootstrap";
-    const char *found;
-    size_t prefix_len;
+    size_t name_len = strlen(name);
+    const char *line = headers;
 
-    if (bootstrap_url == NULL || out == NULL || out_sz == 0U) {
-        return -EINVAL;
-    }
+    while (line < headers_end) {
+        const char *eol = strstr(line, "\r\n");
 
-    found = strstr(bootstrap_url, SUFFIX_BOOTSTRAP);
-    if (found == NULL) {
-        return -EINVAL;
+        if (eol == NULL || eol > headers_end) {
+            eol = headers_end;
+        }
+
+        if ((size_t)(eol - line) > name_len && line[name_len] == ':' && gw_ascii_ieq(line, name, name_len)) {
+            const char *value = line + name_len + 1;
+
+            while (*value == ' ' || *value == '\t') {
+                ++value;
+            }
+            return value;
+        }
+
+        line = eol + 2;
     }
 
-    prefix_len = (size_t)(found - bootstrap_url);
-    if (prefix_len + strlen("/secret") + 1U > out_sz) {
-        return -ENOSPC;
+    return NULL;
+}
+
+/* Decodes a chunked body into out; -EINPROGRESS until the terminating chunk and trailers arrive. */
+static int gw_http_dechunk(const char *data, size_t data_len, char *out, size_t out_sz, size_t *out_len)
+{
+    size_t pos = 0U;
+    size_t len = 0U;
+
+    for (;;) {
+        const char *eol = strstr(&data[pos], "\r\n");
+        char *end = NULL;
+        unsigned long chunk_len;
+
+        if (eol == NULL) {
+            return -EINPROGRESS;
+        }
+
+        chunk_len = strtoul(&data[pos], &end, 16);
+        if (end == &data[pos] || (*end != ';' && *end != '\r' && *end != ' ')) {
+            return -EBADMSG;
+        }
+
+        pos = (size_t)(eol - data) + 2U;
+
+        if (chunk_len == 0UL) {
+            /* Empty trailer section or trailers followed by a blank line. */
+            if (data_len - pos >= 2U && data[pos] == '\r' && data[pos + 1U] == '\n') {
+                break;
+            }
+            if (strstr(&data[pos], "\r\n\r\n") == NULL) {
+                return -EINPROGRESS;
+            }
+            break;
+        }
+
+        if (chunk_len > data_len || data_len - pos < (size_t)chunk_len + 2U) {
+            return -EINPROGRESS;
+        }
+
+        if (len < out_sz - 1U) {
+            size_t copy_len = (size_t)chunk_len;
+
+            if (copy_len > out_sz - 1U - len) {
+                copy_len = out_sz - 1U - len;
+            }
+            (void)memcpy(&out[len], &data[pos], copy_len);
+            len += copy_len;
+        }
+
+        pos += (size_t)chunk_len;
+        if (data[pos] != '\r' || data[pos + 1U] != '\n') {
+            return -EBADMSG;
+        }
+        pos += 2U;
     }
 
-    (void)memcpy(out, bootstrap_url, prefix_len);
-    (void)memcpy(&out[prefix_len], "/secret", strlen("/secret") + 1U);
+    out[len] = '\0';
+    *out_len = len;
     return 0;
 }
 
-static int gw_build_auth_payload(const gw_cloud_config_t *cfg, char *out, size_t out_sz)
+/*
+ * Returns 0 once a full response is buffered, -EINPROGRESS if more bytes are needed.
+ * out_keep_alive tells whether the connection can carry another request.
+ */
+static int gw_http_parse_response(
+    const char *raw,
+    size_t raw_len,
+    bool eof,
+    gw_http_result_t *out,
+    bool *out_keep_alive)
 {
-    char ts[GW_CLOUD_MAX_TIMESTAMP];
-    char sig[GW_CLOUD_MAX_SIG_HEX];
-    const char *identity;
+    const char *headers_end;
+    const char *body;
+    const char *value;
+    size_t body_len;
+    size_t copy_len;
+    long status;
+    bool keep_alive;
     int rc;
 
-    if (cfg == NULL || out == NULL || out_sz == 0U) {
-        return -EINVAL;
+    headers_end = strstr(raw, "\r\n\r\n");
+    if (headers_end == NULL) {
+        return eof ? -EBADMSG : -EINPROGRESS;
     }
 
-    identity = gw_identity_key(cfg);
-    if (identity == NULL || identity[0] == '\0') {
-        return -EINVAL;
+    if (raw_len < 12U || strncmp(raw, "HTTP/1.", 7U) != 0) {
+        return -EBADMSG;
     }
 
-    rc = gw_make_rfc3339_now(ts, sizeof(ts));
-    if (rc != 0) {
-        return rc;
+    status = strtol(&raw[9], NULL, 10);
+    if (status < 100L || status > 599L) {
+        return -EBADMSG;
     }
 
-    rc = gw_make_signature(cfg, identity, ts, sig, sizeof(sig));
-    if (rc != 0) {
+    keep_alive = (raw[7] == '1');
+    value = gw_http_find_header(raw, headers_end, "Connection");
+    if (value != NULL) {
+        if (gw_ascii_ieq(value, "close", 5U)) {
+            keep_alive = false;
+        } else if (gw_ascii_ieq(value, "keep-alive", 10U)) {
+            keep_alive = true;
+        }
+    }
+
+    body = headers_end + 4;
+    body_len = raw_len - (size_t)(body - raw);
+
+    (void)memset(out, 0, sizeof(*out));
+    out->status_code = (uint16_t)status;
+
+    value = gw_http_find_header(raw, headers_end, "Transfer-Encoding");
+    if (value != NULL && gw_ascii_ieq(value, "chunked", 7U)) {
+        rc = gw_http_dechunk(body, body_len, out->body, sizeof(out->body), &out->body_len);
+        if (rc == -EINPROGRESS && eof) {
+            return -EBADMSG;
+        }
+        if (rc == 0) {
+            *out_keep_alive = keep_alive;
+        }
         return rc;
     }
 
-    if (cfg->hardware_id != NULL && cfg->hardware_id[0] != '\0') {
-        return gw_snprintf_checked(
-            out,
-            out_sz,
-            "{\"hardware_id\":\"%s\",\"timestamp\":\"%s\",\"signature\":\"%s\"}",
-            cfg->hardware_id,
-            ts,
-            sig);
-    } else if (cfg->device_id != NULL && cfg->device_id[0] != '\0') {
-        return gw_snprintf_checked(
-            out,
-            out_sz,
-            "{\"device_id\":\"%s\",\"timestamp\":\"%s\",\"signature\":\"%s\"}",
-            cfg->device_id,
-            ts,
-            sig);
+    value = gw_http_find_header(raw, headers_end, "Content-Length");
+    if (value != NULL) {
+        long content_len = strtol(value, NULL, 10);
+
+        if (content_len < 0L) {
+            return -EBADMSG;
+        }
+        if (body_len < (size_t)content_len) {
+            return eof ? -EBADMSG : -EINPROGRESS;
+        }
+        body_len = (size_t)content_len;
+    } else if (!eof) {
+        return -EINPROGRESS;
     } else {
-        return -EINVAL;
+        /* Body delimited by connection close. */
+        keep_alive = false;
+    }
+
+    copy_len = body_len;
+    if (copy_len >= sizeof(out->body)) {
+        copy_len = sizeof(out->body) - 1U;
     }
+
+    (void)memcpy(out->body, body, copy_len);
+    out->body[copy_len] = '\0';
+    out->body_len = copy_len;
+    *out_keep_alive = keep_alive;
+
+    return 0;
 }
 
-static int gw_cloud_do_bootstrap(gw_cloud_client_t *client)
+static void gw_http_exchange_abort(gw_http_exchange_t *ex)
+{
+    gw_dns_cancel(&ex->dns);
+    gw_conn_race_reset(&ex->race);
+
+    if (ex->sock >= 0) {
+        close(ex->sock);
+    }
+
+    ex->sock = -1;
+    ex->reused = false;
+    ex->step = GW_HTTP_STEP_IDLE;
+}
+
+/* An idle keep-alive socket is only reusable if the peer has not closed or reset it. */
+static bool gw_http_idle_socket_alive(gw_http_exchange_t *ex, const gw_url_t *url)
+{
+    struct pollfd pfd;
+
+    if (ex->sock < 0 || ex->step != GW_HTTP_STEP_IDLE) {
+        return false;
+    }
+
+    if (ex->url.scheme != url->scheme || ex->url.port != url->port || strcmp(ex->url.host, url->host) != 0) {
+        return false;
+    }
+
+    pfd.fd = ex->sock;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+
+    /* Readable while idle means EOF, an error or unsolicited bytes: none is reusable. */
+    return poll(&pfd, 1, 0) == 0;
+}
+
+/* Reopens the connection to the already resolved address and replays the request. */
+static int gw_http_exchange_reconnect(gw_http_exchange_t *ex)
 {
-    char url_buf[GW_CLOUD_MAX_URL_BUF];
-    char payload[GW_CLOUD_MAX_MSG_BUF];
-    char status_buf[32];
-    gw_url_t url;
-    gw_http_result_t result;
-    uint32_t poll_interval;
     int rc;
 
-    rc = gw_build_api_url(
-        client->config.bootstrap_url,
-        client->config.api_base_url,
-        "/api/v1/devices/bootstrap",
-        url_buf,
-        sizeof(url_buf));
-    if (rc != 0) {
-        return rc;
+    if (ex->sock >= 0) {
+        close(ex->sock);
+        ex->sock = -1;
     }
 
-    rc = gw_parse_url(url_buf, GW_URL_SCHEME_HTTPS, false, &url);
-    if (rc != 0) {
-        return rc;
+    ex->reused = false;
+    ex->tx_off = 0U;
+    ex->rx_len = 0U;
+    ex->rx_buf[0] = '\0';
+
+    if (gw_url_is_tls(&ex->url)) {
+        gw_tls_handshake_begin(&ex->tls, &ex->dns.addr);
     }
 
-    rc = gw_build_auth_payload(&client->config, payload, sizeof(payload));
+    rc = gw_socket_connect_start(
+        &ex->url,
+        ex->tls_sec_tag,
+        (const struct sockaddr *)&ex->dns.addr,
+        ex->dns.addrlen,
+        &ex->sock);
     if (rc != 0) {
+        gw_http_exchange_abort(ex);
         return rc;
     }
 
-    rc = gw_http_post_json(
-        &url,
-        client->config.tls_sec_tag,
-        payload,
-        client->config.bootstrap_timeout_ms,
-        &result);
+    ex->step = GW_HTTP_STEP_CONNECT;
+    return -EINPROGRESS;
+}
+
+static int gw_http_exchange_start(
+    gw_http_exchange_t *ex,
+    const gw_url_t *url,
+    int tls_sec_tag,
+    const char *payload,
+    uint32_t timeout_ms,
+    gw_cloud_tls_stats_t *tls_stats)
+{
+    size_t payload_len;
+    bool reuse;
+    int rc;
+
+    if (ex == NULL || url == NULL || payload == NULL) {
+        return -EINVAL;
+    }
+
+    reuse = gw_http_idle_socket_alive(ex, url) && ex->tls_sec_tag == tls_sec_tag;
+    if (!reuse) {
+        gw_http_exchange_abort(ex);
+    }
+
+    ex->url = *url;
+    ex->tls_sec_tag = tls_sec_tag;
+    ex->tls_stats = tls_stats;
+    ex->reused = reuse;
+    ex->tx_off = 0U;
+    ex->rx_len = 0U;
+    ex->rx_buf[0] = '\0';
+    ex->deadline = k_uptime_get() + (int64_t)timeout_ms;
+
+    payload_len = strlen(payload);
+
+    rc = gw_snprintf_checked(
+        ex->tx_buf,
+        sizeof(ex->tx_buf),
+        "POST %s HTTP/1.1\r\n"
+        "Host: %s\r\n"
+        "Accept: application/json\r\n"
+        "Content-Type: application/json\r\n"
+        "Content-Length: %u\r\n"
+        "Connection: keep-alive\r\n"
+        "\r\n"
+        "%s",
+        ex->url.path,
+        ex->url.host,
+        (unsigned int)payload_len,
+        payload);
     if (rc != 0) {
+        gw_http_exchange_abort(ex);
         return rc;
     }
 
-    if (result.status_code != 200U) {
-        return -EACCES;
+    ex->tx_len = strlen(ex->tx_buf);
+
+    if (reuse) {
+        ex->step = GW_HTTP_STEP_SEND;
+        return 0;
     }
 
-    rc = gw_json_get_string(result.body, "status", status_buf, sizeof(status_buf));
+    rc = gw_dns_start(&ex->dns, ex->url.host, ex->url.port, timeout_ms);
     if (rc != 0) {
         return rc;
     }
 
-    client->status = gw_status_from_string(status_buf);
+    ex->step = GW_HTTP_STEP_RESOLVE;
+    return 0;
+}
 
-    if (gw_json_get_string(result.body, "device_id", client->resolved_device_id, sizeof(client->resolved_device_id)) !=
-        0) {
-        if (client->config.device_id != NULL) {
-            (void)gw_copy_string(client->resolved_device_id, sizeof(client->resolved_device_id), client->config.device_id);
+/*
+ * Advances the exchange without blocking; 0 means out_result holds the response.
+ * On success the socket stays open (step IDLE) when the server allows keep-alive.
+ */
+static int gw_http_exchange_poll(gw_http_exchange_t *ex, gw_http_result_t *out_result)
+{
+    bool keep_alive = false;
+    bool eof = false;
+    int rc;
+
+    if (ex->step == GW_HTTP_STEP_IDLE) {
+        return -EINVAL;
+    }
+
+    if (k_uptime_get() >= ex->deadline) {
+        gw_http_exchange_abort(ex);
+        return -ETIMEDOUT;
+    }
+
+    if (ex->step == GW_HTTP_STEP_RESOLVE) {
+        rc = gw_dns_poll(&ex->dns);
+        if (rc == -EINPROGRESS) {
+            return rc;
+        }
+        if (rc != 0) {
+            gw_http_exchange_abort(ex);
+            return rc;
         }
+        gw_conn_race_reset(&ex->race);
+        ex->step = GW_HTTP_STEP_CONNECT;
     }
 
-    if (gw_json_get_string(
-            result.body,
-            "hardware_id",
-            client->resolved_hardware_id,
-            sizeof(client->resolved_hardware_id)) != 0) {
-        if (client->config.hardware_id != NULL) {
-            (void)gw_copy_string(
-                client->resolved_hardware_id,
-                sizeof(client->resolved_hardware_id),
-                client->config.hardware_id);
+    if (ex->step == GW_HTTP_STEP_CONNECT) {
+        if (ex->sock >= 0) {
+            rc = gw_socket_connect_poll(ex->sock);
+        } else {
+            rc = gw_conn_race_poll(&ex->race, &ex->url, ex->tls_sec_tag, &ex->dns, &ex->sock);
+            /* TLS on a non-blocking socket starts with the first send, so only the winner pays it. */
+            if (rc == 0 && gw_url_is_tls(&ex->url)) {
+                gw_tls_handshake_begin(&ex->tls, &ex->dns.addr);
+            }
+        }
+        if (rc == -EINPROGRESS) {
+            return rc;
+        }
+        if (rc != 0) {
+            gw_http_exchange_abort(ex);
+            return rc;
+        }
+        ex->step = GW_HTTP_STEP_SEND;
+    }
+
+    if (ex->step == GW_HTTP_STEP_SEND) {
+        while (ex->tx_off < ex->tx_len) {
+            ssize_t n = send(ex->sock, &ex->tx_buf[ex->tx_off], ex->tx_len - ex->tx_off, 0);
+
+            if (n < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    return -EINPROGRESS;
+                }
+                /* The server may have dropped an idle keep-alive connection. */
+                if (ex->reused) {
+                    return gw_http_exchange_reconnect(ex);
+                }
+                rc = -errno;
+                gw_http_exchange_abort(ex);
+                return rc;
+            }
+            ex->tx_off += (size_t)n;
+        }
+        /* The TLS handshake of a non-blocking socket completes before the first byte goes out. */
+        gw_tls_handshake_done(&ex->tls, ex->tls_stats);
+        ex->step = GW_HTTP_STEP_RECV;
+    }
+
+    while (ex->rx_len < GW_CLOUD_MAX_HTTP_RX) {
+        ssize_t n = recv(ex->sock, &ex->rx_buf[ex->rx_len], GW_CLOUD_MAX_HTTP_RX - ex->rx_len, 0);
+
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            if (ex->reused && ex->rx_len == 0U) {
+                return gw_http_exchange_reconnect(ex);
+            }
+            rc = -errno;
+            gw_http_exchange_abort(ex);
+            return rc;
+        }
+        if (n == 0) {
+            if (ex->reused && ex->rx_len == 0U) {
+                return gw_http_exchange_reconnect(ex);
+            }
+            eof = true;
+            break;
+        }
+        ex->rx_len += (size_t)n;
+    }
+
+    ex->rx_buf[ex->rx_len] = '\0';
+
+    rc = gw_http_parse_response(
+        ex->rx_buf,
+        ex->rx_len,
+        eof || ex->rx_len >= GW_CLOUD_MAX_HTTP_RX,
+        out_result,
+        &keep_alive);
+    if (rc == -EINPROGRESS) {
+        return rc;
+    }
+
+    if (rc == 0 && keep_alive && !eof) {
+        ex->reused = false;
+        ex->step = GW_HTTP_STEP_IDLE;
+        return 0;
+    }
+
+    gw_http_exchange_abort(ex);
+    return rc;
+}
+
+static const char *gw_json_find_key(const char *json, const char *key)
+{
+    char pattern[48];
+
+    if (json == NULL || key == NULL) {
+        return NULL;
+    }
+
+    if (gw_snprintf_checked(pattern, sizeof(pattern), "\"%s\"", key) != 0) {
+        return NULL;
+    }
+
+    return strstr(json, pattern);
+}
+
+static int gw_json_get_string(const char *json, const char *key, char *out, size_t out_sz)
+{
+    const char *p;
+    const char *q;
+    size_t len;
+
+    if (json == NULL || key == NULL || out == NULL || out_sz == 0U) {
+        return -EINVAL;
+    }
+
+    p = gw_json_find_key(json, key);
+    if (p == NULL) {
+        return -ENOENT;
+    }
+
+    p = strchr(p, ':');
+    if (p == NULL) {
+        return -EBADMSG;
+    }
+    ++p;
+
+    while (*p == ' ' || *p == '\t') {
+        ++p;
+    }
+
+    if (*p != '"') {
+        return -EBADMSG;
+    }
+    ++p;
+
+    q = strchr(p, '"');
+    if (q == NULL) {
+        return -EBADMSG;
+    }
+
+    len = (size_t)(q - p);
+    if (len >= out_sz) {
+        return -ENOSPC;
+    }
+
+    (void)memcpy(out, p, len);
+    out[len] = '\0';
+    return 0;
+}
+
+static int gw_json_get_uint(const char *json, const char *key, uint32_t *out)
+{
+    const char *p;
+    long value;
+
+    if (json == NULL || key == NULL || out == NULL) {
+        return -EINVAL;
+    }
+
+    p = gw_json_find_key(json, key);
+    if (p == NULL) {
+        return -ENOENT;
+    }
+
+    p = strchr(p, ':');
+    if (p == NULL) {
+        return -EBADMSG;
+    }
+    ++p;
+
+    while (*p == ' ' || *p == '\t') {
+        ++p;
+    }
+
+    value = strtol(p, NULL, 10);
+    if (value < 0L) {
+        return -ERANGE;
+    }
+
+    *out = (uint32_t)value;
+    return 0;
+}
+
+static gw_cloud_status_t gw_status_from_string(const char *status)
+{
+    if (status == NULL) {
+        return GW_CLOUD_STATUS_UNKNOWN;
+    }
+
+    if (strcmp(status, "not_provisioned") == 0) {
+        return GW_CLOUD_STATUS_NOT_PROVISIONED;
+    }
+    if (strcmp(status, "unclaimed") == 0) {
+        return GW_CLOUD_STATUS_UNCLAIMED;
+    }
+    if (strcmp(status, "claimed") == 0) {
+        return GW_CLOUD_STATUS_CLAIMED;
+    }
+    if (strcmp(status, "active") == 0) {
+        return GW_CLOUD_STATUS_ACTIVE;
+    }
+    if (strcmp(status, "suspended") == 0) {
+        return GW_CLOUD_STATUS_SUSPENDED;
+    }
+    if (strcmp(status, "revoked") == 0) {
+        return GW_CLOUD_STATUS_REVOKED;
+    }
+
+    return GW_CLOUD_STATUS_UNKNOWN;
+}
+
+static int gw_build_api_url(
+    const char *explicit_url,
+    const char *api_base_url,
+    const char *path_suffix,
+    char *out,
+    size_t out_sz)
+{
+    size_t base_len;
+
+    if (out == NULL || out_sz == 0U) {
+        return -EINVAL;
+    }
+
+    if (explicit_url != NULL && explicit_url[0] != '\0') {
+        return gw_copy_string(out, out_sz, explicit_url);
+    }
+
+    if (api_base_url == NULL || api_base_url[0] == '\0' || path_suffix == NULL) {
+        return -EINVAL;
+    }
+
+    base_len = strlen(api_base_url);
+    if (base_len > 0U && api_base_url[base_len - 1U] == '/') {
+        return gw_snprintf_checked(out, out_sz, "%s%s", api_base_url, path_suffix + 1);
+    }
+
+    return gw_snprintf_checked(out, out_sz, "%s%s", api_base_url, path_suffix);
+}
+
+static int gw_derive_secret_from_bootstrap(const char *bootstrap_url, char *out, size_t out_sz)
+{
+    static const char SUFFIX_BOOTSTRAP[] = "/bootstrap";
+    const char *found;
+    size_t prefix_len;
+
+    if (bootstrap_url == NULL || out == NULL || out_sz == 0U) {
+        return -EINVAL;
+    }
+
+    found = strstr(bootstrap_url, SUFFIX_BOOTSTRAP);
+    if (found == NULL) {
+        return -EINVAL;
+    }
+
+    prefix_len = (size_t)(found - bootstrap_url);
+    if (prefix_len + strlen("/secret") + 1U > out_sz) {
+        return -ENOSPC;
+    }
+
+    (void)memcpy(out, bootstrap_url, prefix_len);
+    (void)memcpy(&out[prefix_len], "/secret", strlen("/secret") + 1U);
+    return 0;
+}
+
+static int gw_build_auth_payload(const gw_cloud_config_t *cfg, char *out, size_t out_sz)
+{
+    char ts[GW_CLOUD_MAX_TIMESTAMP];
+    char sig[GW_CLOUD_MAX_SIG_HEX];
+    const char *identity;
+    int rc;
+
+    if (cfg == NULL || out == NULL || out_sz == 0U) {
+        return -EINVAL;
+    }
+
+    identity = gw_identity_key(cfg);
+    if (identity == NULL || identity[0] == '\0') {
+        return -EINVAL;
+    }
+
+    rc = gw_make_rfc3339_now(ts, sizeof(ts));
+    if (rc != 0) {
+        return rc;
+    }
+
+    rc = gw_make_signature(cfg, identity, ts, sig, sizeof(sig));
+    if (rc != 0) {
+        return rc;
+    }
+
+    if (cfg->hardware_id != NULL && cfg->hardware_id[0] != '\0') {
+        return gw_snprintf_checked(
+            out,
+            out_sz,
+            "{\"hardware_id\":\"%s\",\"timestamp\":\"%s\",\"signature\":\"%s\"}",
+            cfg->hardware_id,
+            ts,
+            sig);
+    } else if (cfg->device_id != NULL && cfg->device_id[0] != '\0') {
+        return gw_snprintf_checked(
+            out,
+            out_sz,
+            "{\"device_id\":\"%s\",\"timestamp\":\"%s\",\"signature\":\"%s\"}",
+            cfg->device_id,
+            ts,
+            sig);
+    } else {
+        return -EINVAL;
+    }
+}
+
+static int gw_cloud_bootstrap_start(gw_cloud_client_t *client)
+{
+    char url_buf[GW_CLOUD_MAX_URL_BUF];
+    char payload[GW_CLOUD_MAX_MSG_BUF];
+    gw_url_t url;
+    int rc;
+
+    rc = gw_build_api_url(
+        client->config.bootstrap_url,
+        client->config.api_base_url,
+        "/api/v1/devices/bootstrap",
+        url_buf,
+        sizeof(url_buf));
+    if (rc != 0) {
+        return rc;
+    }
+
+    rc = gw_parse_url(url_buf, GW_URL_SCHEME_HTTPS, false, &url);
+    if (rc != 0) {
+        return rc;
+    }
+
+    rc = gw_build_auth_payload(&client->config, payload, sizeof(payload));
+    if (rc != 0) {
+        return rc;
+    }
+
+    return gw_http_exchange_start(
+        &g_conn.http,
+        &url,
+        client->config.tls_sec_tag,
+        payload,
+        client->config.bootstrap_timeout_ms,
+        &client->stats.tls_http);
+}
+
+/* -EBUSY asks the engine for the server-busy backoff, -EACCES for the auth one. */
+static int gw_http_status_error(uint16_t status_code)
+{
+    if (status_code == 429U || status_code >= 500U) {
+        return -EBUSY;
+    }
+
+    return -EACCES;
+}
+
+/* The broker refused the credentials themselves, in 3.1.1 or MQTT 5 codes. */
+static bool gw_mqtt_credentials_rejected(int return_code)
+{
+    switch (return_code) {
+    case MQTT_BAD_USER_NAME_OR_PASSWORD:
+    case MQTT_NOT_AUTHORIZED:
+#if defined(CONFIG_GW_ENGINE_CLOUD_MQTT5)
+    case 0x86: /* bad user name or password */
+    case 0x87: /* not authorized */
+#endif
+        return true;
+    default:
+        return false;
+    }
+}
+
+static int gw_mqtt_connack_error(int return_code)
+{
+    if (gw_mqtt_credentials_rejected(return_code)) {
+        return -EACCES;
+    }
+
+    switch (return_code) {
+    case MQTT_SERVER_UNAVAILABLE:
+#if defined(CONFIG_GW_ENGINE_CLOUD_MQTT5)
+    case 0x88: /* server unavailable */
+    case 0x89: /* server busy */
+    case 0x97: /* quota exceeded */
+    case 0x9F: /* connection rate exceeded */
+#endif
+        return -EBUSY;
+    case MQTT_UNACCEPTABLE_PROTOCOL_VERSION:
+    case MQTT_IDENTIFIER_REJECTED:
+#if defined(CONFIG_GW_ENGINE_CLOUD_MQTT5)
+    case 0x85: /* client identifier not valid */
+#endif
+        return -EACCES;
+    default:
+        return -ECONNREFUSED;
+    }
+}
+
+static int gw_cloud_bootstrap_parse(gw_cloud_client_t *client, const gw_http_result_t *result)
+{
+    char status_buf[32];
+    uint32_t poll_interval;
+    int rc;
+
+    if (result->status_code != 200U) {
+        return gw_http_status_error(result->status_code);
+    }
+
+    rc = gw_json_get_string(result->body, "status", status_buf, sizeof(status_buf));
+    if (rc != 0) {
+        return rc;
+    }
+
+    client->status = gw_status_from_string(status_buf);
+
+    if (gw_json_get_string(result->body, "device_id", client->resolved_device_id, sizeof(client->resolved_device_id)) !=
+        0) {
+        if (client->config.device_id != NULL) {
+            (void)gw_copy_string(client->resolved_device_id, sizeof(client->resolved_device_id), client->config.device_id);
+        }
+    }
+
+    if (gw_json_get_string(
+            result->body,
+            "hardware_id",
+            client->resolved_hardware_id,
+            sizeof(client->resolved_hardware_id)) != 0) {
+        if (client->config.hardware_id != NULL) {
+            (void)gw_copy_string(
+                client->resolved_hardware_id,
+                sizeof(client->resolved_hardware_id),
+                client->config.hardware_id);
+        }
+    }
+
+    poll_interval = 0U;
+    if (gw_json_get_uint(result->body, "poll_interval", &poll_interval) == 0) {
+        client->poll_interval_s = poll_interval;
+    }
+
+    return 0;
+}
+
+static int gw_cloud_secret_start(gw_cloud_client_t *client)
+{
+    char url_buf[GW_CLOUD_MAX_URL_BUF];
+    char payload[GW_CLOUD_MAX_MSG_BUF];
+    gw_url_t url;
+    int rc;
+
+    rc = gw_build_api_url(
+        client->config.secret_url,
+        client->config.api_base_url,
+        "/api/v1/devices/secret",
+        url_buf,
+        sizeof(url_buf));
+    if (rc != 0 && client->config.secret_url == NULL && client->config.api_base_url == NULL &&
+        client->config.bootstrap_url != NULL) {
+        rc = gw_derive_secret_from_bootstrap(client->config.bootstrap_url, url_buf, sizeof(url_buf));
+    }
+    if (rc != 0) {
+        return rc;
+    }
+
+    rc = gw_parse_url(url_buf, GW_URL_SCHEME_HTTPS, false, &url);
+    if (rc != 0) {
+        return rc;
+    }
+
+    rc = gw_build_auth_payload(&client->config, payload, sizeof(payload));
+    if (rc != 0) {
+        return rc;
+    }
+
+    return gw_http_exchange_start(
+        &g_conn.http,
+        &url,
+        client->config.tls_sec_tag,
+        payload,
+        client->config.bootstrap_timeout_ms,
+        &client->stats.tls_http);
+}
+
+static int gw_cloud_secret_parse(gw_cloud_client_t *client, const gw_http_result_t *result)
+{
+    int rc;
+
+    if (result->status_code != 200U) {
+        return gw_http_status_error(result->status_code);
+    }
+
+    rc = gw_json_get_string(
+        result->body,
+        "device_secret",
+        client->resolved_device_secret,
+        sizeof(client->resolved_device_secret));
+    if (rc != 0) {
+        return rc;
+    }
+
+    rc = gw_json_get_string(
+        result->body,
+        "mqtt_username",
+        client->resolved_mqtt_username,
+        sizeof(client->resolved_mqtt_username));
+    if (rc != 0) {
+        return rc;
+    }
+
+    rc = gw_json_get_string(result->body, "broker", client->resolved_broker, sizeof(client->resolved_broker));
+    if (rc != 0) {
+        return rc;
+    }
+
+    rc = gw_json_get_string(
+        result->body,
+        "topic_prefix",
+        client->resolved_topic_prefix,
+        sizeof(client->resolved_topic_prefix));
+    if (rc != 0) {
+        return rc;
+    }
+
+    client->credentials_ready = true;
+    return 0;
+}
+
+static gw_mqtt_inflight_entry_t *gw_mqtt_inflight_find(uint16_t message_id)
+{
+    size_t i;
+
+    for (i = 0U; i < GW_MQTT_INFLIGHT; ++i) {
+        if (g_inflight.entries[i].in_use && g_inflight.entries[i].message_id == message_id) {
+            return &g_inflight.entries[i];
+        }
+    }
+
+    return NULL;
+}
+
+/* Message ids stay unique across reconnects because the broker keeps the session. */
+static uint16_t gw_mqtt_next_message_id(void)
+{
+    do {
+        g_inflight.last_message_id++;
+    } while (g_inflight.last_message_id == 0U || gw_mqtt_inflight_find(g_inflight.last_message_id) != NULL);
+
+    return g_inflight.last_message_id;
+}
+
+static void gw_mqtt_inflight_ack(gw_cloud_client_t *client, uint16_t message_id)
+{
+    gw_mqtt_inflight_entry_t *e = gw_mqtt_inflight_find(message_id);
+    gw_cloud_stats_t *st = &client->stats;
+    uint32_t latency;
+
+    if (e == NULL) {
+        return;
+    }
+
+    latency = (uint32_t)(k_uptime_get() - e->sent_at);
+    e->in_use = false;
+    g_inflight.count--;
+
+    st->publish_ok++;
+    client->slot_stats[e->slot].published++;
+    client->slot_stats[e->slot].bytes += e->len;
+    st->puback_count++;
+    st->puback_latency_last_ms = latency;
+    if (latency > st->puback_latency_max_ms) {
+        st->puback_latency_max_ms = latency;
+    }
+    /* EWMA with 1/8 gain. */
+    if (st->puback_count == 1U) {
+        st->puback_latency_avg_ms = latency;
+    } else {
+        st->puback_latency_avg_ms = (uint32_t)((int32_t)st->puback_latency_avg_ms +
+                                               ((int32_t)latency - (int32_t)st->puback_latency_avg_ms) / 8);
+    }
+    st->inflight = g_inflight.count;
+}
+
+/* Parses the edge id from "<prefix>/cmd/<id>" in place; the topic still points into mqtt_rx_buf. */
+static int gw_cloud_cmd_edge_id(const struct mqtt_utf8 *topic, uint16_t *out_edge_id)
+{
+    size_t base = (size_t)g_rt.cmd_filter_len - 1U;
+    uint32_t id = 0U;
+    size_t i;
+
+    if (g_rt.cmd_filter_len == 0U || topic->size <= base || topic->size > base + 5U ||
+        memcmp(topic->utf8, g_rt.cmd_filter, base) != 0) {
+        return -EINVAL;
+    }
+
+    for (i = base; i < topic->size; ++i) {
+        if (!isdigit((int)topic->utf8[i])) {
+            return -EINVAL;
+        }
+        id = (id * 10U) + (uint32_t)(topic->utf8[i] - '0');
+    }
+
+    if (id > UINT16_MAX) {
+        return -ERANGE;
+    }
+
+    *out_edge_id = (uint16_t)id;
+    return 0;
+}
+
+static int gw_mqtt_drain_payload(struct mqtt_client *mqtt, size_t len)
+{
+    uint8_t scratch[GW_CLOUD_CMD_DRAIN_CHUNK];
+    int rc;
+
+    while (len > 0U) {
+        size_t n = MIN(len, sizeof(scratch));
+
+        rc = mqtt_readall_publish_payload(mqtt, scratch, n);
+        if (rc != 0) {
+            return rc;
+        }
+        len -= n;
+    }
+
+    return 0;
+}
+
+/* The payload is read from the socket straight into the queue slot, with no staging copy. */
+static void gw_mqtt_on_publish(gw_cloud_client_t *client, struct mqtt_client *mqtt, const struct mqtt_publish_param *p)
+{
+    uint32_t received_ms = k_uptime_get_32();
+    size_t len = p->message.payload.len;
+    gw_cloud_command_t *cmd = NULL;
+    uint16_t edge_id = 0U;
+    k_spinlock_key_t key;
+    int rc;
+
+    if (gw_cloud_cmd_edge_id(&p->message.topic.topic, &edge_id) == 0 && len <= GW_CLOUD_CMD_MAX_PAYLOAD) {
+        key = k_spin_lock(&g_cmds.lock);
+        if (g_cmds.count < GW_CLOUD_CMD_QUEUE_DEPTH) {
+            cmd = &g_cmds.items[(g_cmds.head + g_cmds.count) % GW_CLOUD_CMD_QUEUE_DEPTH];
+        }
+        k_spin_unlock(&g_cmds.lock, key);
+    }
+
+    if (cmd == NULL) {
+        rc = gw_mqtt_drain_payload(mqtt, len);
+        client->stats.cmd_dropped++;
+    } else {
+        rc = mqtt_readall_publish_payload(mqtt, cmd->payload, len);
+        if (rc == 0) {
+            cmd->edge_id = edge_id;
+            cmd->len = (uint16_t)len;
+            cmd->received_ms = received_ms;
+
+            key = k_spin_lock(&g_cmds.lock);
+            g_cmds.count++;
+            k_spin_unlock(&g_cmds.lock, key);
+            client->stats.cmd_received++;
+        }
+    }
+
+    /* A broken read leaves the stream unusable; mqtt_input reports it and no PUBACK is owed. */
+    if (rc == 0 && p->message.topic.qos == MQTT_QOS_1_AT_LEAST_ONCE) {
+        struct mqtt_puback_param ack = {
+            .message_id = p->message_id,
+        };
+
+        (void)mqtt_publish_qos1_ack(mqtt, &ack);
+    }
+}
+
+static void gw_mqtt_evt_handler(struct mqtt_client *mqtt, const struct mqtt_evt *evt)
+{
+    gw_cloud_client_t *client;
+
+    if (mqtt == NULL || evt == NULL) {
+        return;
+    }
+
+    client = (gw_cloud_client_t *)mqtt->user_data;
+    if (client == NULL) {
+        return;
+    }
+
+    switch (evt->type) {
+    case MQTT_EVT_CONNACK:
+        g_rt.connack_received = true;
+        g_rt.connack_result = evt->result;
+        g_rt.connack_code = evt->param.connack.return_code;
+#if defined(CONFIG_GW_ENGINE_CLOUD_MQTT5)
+        g_rt.topic_alias_max = evt->param.connack.prop.topic_alias_maximum;
+#endif
+        if (evt->result == 0 && evt->param.connack.return_code == MQTT_CONNECTION_ACCEPTED) {
+            g_rt.mqtt_connected = true;
+            client->connected = true;
+        } else {
+            g_rt.mqtt_connected = false;
+            client->connected = false;
+        }
+        break;
+
+    case MQTT_EVT_DISCONNECT:
+        g_rt.mqtt_connected = false;
+        client->connected = false;
+        break;
+
+    case MQTT_EVT_PUBACK:
+        if (evt->result == 0) {
+            gw_mqtt_inflight_ack(client, evt->param.puback.message_id);
+        }
+        break;
+
+    case MQTT_EVT_PUBLISH:
+        if (evt->result == 0) {
+            gw_mqtt_on_publish(client, mqtt, &evt->param.publish);
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+static int gw_cloud_broker_resolve_start(gw_cloud_client_t *client)
+{
+    int rc;
+
+    if (client->resolved_broker[0] == '\0') {
+        if (client->config.broker_url == NULL || client->config.broker_url[0] == '\0') {
+            return -EINVAL;
+        }
+        rc = gw_copy_string(client->resolved_broker, sizeof(client->resolved_broker), client->config.broker_url);
+        if (rc != 0) {
+            return rc;
+        }
+    }
+
+    rc = gw_parse_url(client->resolved_broker, GW_URL_SCHEME_WSS, true, &g_conn.broker_url);
+    if (rc != 0) {
+        return rc;
+    }
+
+    g_conn.deadline = k_uptime_get() + (int64_t)client->config.mqtt_connect_timeout_ms;
+
+    return gw_dns_start(
+        &g_conn.broker_dns,
+        g_conn.broker_url.host,
+        g_conn.broker_url.port,
+        client->config.mqtt_connect_timeout_ms);
+}
+
+static void gw_prepare_fds(struct mqtt_client *mqtt)
+{
+    g_rt.nfds = 0;
+
+    if (mqtt == NULL) {
+        return;
+    }
+
+    switch (mqtt->transport.type) {
+    case MQTT_TRANSPORT_NON_SECURE:
+        g_rt.fds[0].fd = mqtt->transport.tcp.sock;
+        break;
+#if defined(CONFIG_MQTT_LIB_TLS)
+    case MQTT_TRANSPORT_SECURE:
+        g_rt.fds[0].fd = mqtt->transport.tls.sock;
+        break;
+#endif
+#if defined(CONFIG_MQTT_LIB_WEBSOCKET)
+    case MQTT_TRANSPORT_NON_SECURE_WEBSOCKET:
+#if defined(CONFIG_MQTT_LIB_TLS)
+    case MQTT_TRANSPORT_SECURE_WEBSOCKET:
+#endif
+        g_rt.fds[0].fd = mqtt->transport.websocket.sock;
+        break;
+#endif
+    default:
+        return;
+    }
+
+    g_rt.fds[0].events = POLLIN;
+    g_rt.nfds = 1;
+}
+
+/* Indexed by gw_codec_format_t so the cloud can tell the encoding apart by topic. */
+static const char *const g_topic_suffix[GW_CLOUD_TOPIC_FORMATS] = {"", "/cbor", "/gorilla"};
+
+static int gw_cloud_topics_build(const gw_cloud_client_t *client)
+{
+    size_t slot;
+    size_t fmt;
+    int rc;
+
+    if (client->resolved_topic_prefix[0] == '\0') {
+        return -ENODATA;
+    }
+
+    for (slot = 0U; slot < GW_CLOUD_SLOTS; ++slot) {
+        for (fmt = 0U; fmt < GW_CLOUD_TOPIC_FORMATS; ++fmt) {
+            gw_cloud_topic_t *t = &g_rt.topics[slot][fmt];
+
+            rc = gw_snprintf_checked(
+                t->name,
+                sizeof(t->name),
+                "%s/slot/%u%s",
+                client->resolved_topic_prefix,
+                (unsigned int)slot,
+                g_topic_suffix[fmt]);
+            if (rc != 0) {
+                return rc;
+            }
+            t->len = (uint16_t)strlen(t->name);
+            t->alias = 0U;
+            t->alias_sent = false;
+        }
+    }
+
+    rc = gw_snprintf_checked(
+        g_rt.cmd_filter, sizeof(g_rt.cmd_filter), "%s" GW_CLOUD_CMD_TOPIC "+", client->resolved_topic_prefix);
+    if (rc != 0) {
+        return rc;
+    }
+    g_rt.cmd_filter_len = (uint16_t)strlen(g_rt.cmd_filter);
+
+    return 0;
+}
+
+static gw_cloud_topic_t *gw_cloud_topic_for(uint16_t slot, const uint8_t *payload, size_t payload_len)
+{
+    return &g_rt.topics[slot][gw_codec_detect(payload, payload_len)];
+}
+
+static int gw_cloud_mqtt_send(
+    gw_cloud_client_t *client,
+    gw_cloud_topic_t *topic,
+    const uint8_t *payload,
+    size_t payload_len,
+    uint8_t qos,
+    uint16_t message_id,
+    bool dup)
+{
+    struct mqtt_publish_param param;
+    uint32_t started;
+    uint32_t elapsed;
+    int rc;
+
+    (void)memset(&param, 0, sizeof(param));
+    param.message.topic.topic.utf8 = (const uint8_t *)topic->name;
+    param.message.topic.topic.size = topic->len;
+    param.message.topic.qos = qos;
+    param.message.payload.data = (uint8_t *)payload;
+    param.message.payload.len = payload_len;
+    param.message_id = message_id;
+    param.dup_flag = dup ? 1U : 0U;
+    param.retain_flag = 0U;
+
+#if defined(CONFIG_GW_ENGINE_CLOUD_MQTT5)
+    /* Aliases are per connection and bounded by the broker's Topic Alias Maximum. */
+    if (topic->alias == 0U && g_rt.topic_alias_next < g_rt.topic_alias_max) {
+        topic->alias = ++g_rt.topic_alias_next;
+    }
+    if (topic->alias != 0U) {
+        param.prop.topic_alias = topic->alias;
+        if (topic->alias_sent) {
+            param.message.topic.topic.size = 0U;
+            client->stats.topic_alias_hits++;
+        }
+    }
+#endif
+
+    started = k_uptime_get_32();
+    rc = mqtt_publish(&g_rt.mqtt, &param);
+    elapsed = k_uptime_get_32() - started;
+    if (rc == 0 && topic->alias != 0U) {
+        topic->alias_sent = true;
+    }
+
+    /* EWMA with 1/8 gain, like the PUBACK latency. */
+    client->stats.send_latency_last_ms = elapsed;
+    client->stats.send_latency_avg_ms = (uint32_t)((int32_t)client->stats.send_latency_avg_ms +
+                                                   ((int32_t)elapsed - (int32_t)client->stats.send_latency_avg_ms) / 8);
+
+    return rc;
+}
+
+static int gw_cloud_mqtt_configure(gw_cloud_client_t *client)
+{
+    const gw_url_t *broker_url = &g_conn.broker_url;
+    const char *client_id;
+    int rc;
+
+    if (client == NULL) {
+        return -EINVAL;
+    }
+
+    if (g_conn.broker_dns.addrlen > sizeof(g_rt.broker)) {
+        return -ENOBUFS;
+    }
+
+    (void)memset(&g_rt, 0, sizeof(g_rt));
+    (void)memcpy(&g_rt.broker, &g_conn.broker_dns.addr, g_conn.broker_dns.addrlen);
+
+    rc = gw_cloud_topics_build(client);
+    if (rc != 0) {
+        return rc;
+    }
+
+    mqtt_client_init(&g_rt.mqtt);
+
+    g_rt.mqtt.broker = &g_rt.broker;
+    g_rt.mqtt.evt_cb = gw_mqtt_evt_handler;
+    g_rt.mqtt.user_data = client;
+    g_rt.mqtt.rx_buf = g_rt.mqtt_rx_buf;
+    g_rt.mqtt.rx_buf_size = sizeof(g_rt.mqtt_rx_buf);
+    g_rt.mqtt.tx_buf = g_rt.mqtt_tx_buf;
+    g_rt.mqtt.tx_buf_size = sizeof(g_rt.mqtt_tx_buf);
+#if defined(CONFIG_GW_ENGINE_CLOUD_MQTT5)
+    g_rt.mqtt.protocol_version = MQTT_VERSION_5_0;
+#else
+    g_rt.mqtt.protocol_version = MQTT_VERSION_3_1_1;
+#endif
+    /* QoS 1 needs the broker to keep the session so unacked ids survive a reconnect. */
+    g_rt.mqtt.clean_session = (client->config.publish_qos == MQTT_QOS_1_AT_LEAST_ONCE) ? 0U : 1U;
+
+    client_id = client->config.mqtt_client_id;
+    if (client_id == NULL || client_id[0] == '\0') {
+        client_id = (client->resolved_device_id[0] != '\0') ? client->resolved_device_id : client->config.device_id;
+    }
+    if (client_id == NULL || client_id[0] == '\0') {
+        return -EINVAL;
+    }
+
+    g_rt.mqtt.client_id.utf8 = (const uint8_t *)client_id;
+    g_rt.mqtt.client_id.size = strlen(client_id);
+
+    g_rt.mqtt_user_name.utf8 = (const uint8_t *)client->resolved_mqtt_username;
+    g_rt.mqtt_user_name.size = strlen(client->resolved_mqtt_username);
+    g_rt.mqtt_password.utf8 = (const uint8_t *)client->resolved_device_secret;
+    g_rt.mqtt_password.size = strlen(client->resolved_device_secret);
+
+    g_rt.mqtt.user_name = &g_rt.mqtt_user_name;
+    g_rt.mqtt.password = &g_rt.mqtt_password;
+
+    g_rt.mqtt.keepalive = (client->config.mqtt_keepalive_sec == 0U) ? 60U : client->config.mqtt_keepalive_sec;
+
+    switch (broker_url->scheme) {
+    case GW_URL_SCHEME_WSS:
+#if defined(CONFIG_MQTT_LIB_TLS) && defined(CONFIG_MQTT_LIB_WEBSOCKET)
+        if (client->config.tls_sec_tag < 0) {
+            return -EINVAL;
+        }
+        g_rt.mqtt.transport.type = MQTT_TRANSPORT_SECURE_WEBSOCKET;
+        g_rt.sec_tags[0] = (sec_tag_t)client->config.tls_sec_tag;
+        g_rt.mqtt.transport.tls.config.peer_verify = TLS_PEER_VERIFY_REQUIRED;
+        g_rt.mqtt.transport.tls.config.sec_tag_list = g_rt.sec_tags;
+        g_rt.mqtt.transport.tls.config.sec_tag_count = 1U;
+        g_rt.mqtt.transport.tls.config.hostname = broker_url->host;
+#if defined(CONFIG_GW_ENGINE_CLOUD_TLS_SESSION_CACHE)
+        g_rt.mqtt.transport.tls.config.session_cache = TLS_SESSION_CACHE_ENABLED;
+#endif
+
+        g_rt.mqtt.transport.websocket.config.host = broker_url->host;
+        g_rt.mqtt.transport.websocket.config.url = broker_url->path;
+        g_rt.mqtt.transport.websocket.config.tmp_buf = g_rt.ws_tmp_buf;
+        g_rt.mqtt.transport.websocket.config.tmp_buf_len = sizeof(g_rt.ws_tmp_buf);
+        g_rt.mqtt.transport.websocket.timeout = (int32_t)client->config.mqtt_connect_timeout_ms;
+#else
+        return -ENOTSUP;
+#endif
+        break;
+
+    case GW_URL_SCHEME_WS:
+#if defined(CONFIG_MQTT_LIB_WEBSOCKET)
+        g_rt.mqtt.transport.type = MQTT_TRANSPORT_NON_SECURE_WEBSOCKET;
+        g_rt.mqtt.transport.websocket.config.host = broker_url->host;
+        g_rt.mqtt.transport.websocket.config.url = broker_url->path;
+        g_rt.mqtt.transport.websocket.config.tmp_buf = g_rt.ws_tmp_buf;
+        g_rt.mqtt.transport.websocket.config.tmp_buf_len = sizeof(g_rt.ws_tmp_buf);
+        g_rt.mqtt.transport.websocket.timeout = (int32_t)client->config.mqtt_connect_timeout_ms;
+#else
+        return -ENOTSUP;
+#endif
+        break;
+
+    case GW_URL_SCHEME_HTTPS:
+#if defined(CONFIG_MQTT_LIB_TLS)
+        if (client->config.tls_sec_tag < 0) {
+            return -EINVAL;
+        }
+        g_rt.mqtt.transport.type = MQTT_TRANSPORT_SECURE;
+        g_rt.sec_tags[0] = (sec_tag_t)client->config.tls_sec_tag;
+        g_rt.mqtt.transport.tls.config.peer_verify = TLS_PEER_VERIFY_REQUIRED;
+        g_rt.mqtt.transport.tls.config.sec_tag_list = g_rt.sec_tags;
+        g_rt.mqtt.transport.tls.config.sec_tag_count = 1U;
+        g_rt.mqtt.transport.tls.config.hostname = broker_url->host;
+#if defined(CONFIG_GW_ENGINE_CLOUD_TLS_SESSION_CACHE)
+        g_rt.mqtt.transport.tls.config.session_cache = TLS_SESSION_CACHE_ENABLED;
+#endif
+#else
+        return -ENOTSUP;
+#endif
+        break;
+
+    case GW_URL_SCHEME_HTTP:
+        g_rt.mqtt.transport.type = MQTT_TRANSPORT_NON_SECURE;
+        break;
+
+    default:
+        return -EPROTONOSUPPORT;
+    }
+
+    return 0;
+}
+
+static void gw_cloud_apply_config_credentials(gw_cloud_client_t *client)
+{
+    const gw_cloud_config_t *cfg = &client->config;
+
+    client->status = GW_CLOUD_STATUS_UNKNOWN;
+    client->poll_interval_s = 0U;
+    client->credentials_ready = false;
+    (void)memset(client->resolved_device_id, 0, sizeof(client->resolved_device_id));
+    (void)memset(client->resolved_hardware_id, 0, sizeof(client->resolved_hardware_id));
+    (void)memset(client->resolved_broker, 0, sizeof(client->resolved_broker));
+    (void)memset(client->resolved_mqtt_username, 0, sizeof(client->resolved_mqtt_username));
+    (void)memset(client->resolved_device_secret, 0, sizeof(client->resolved_device_secret));
+    (void)memset(client->resolved_topic_prefix, 0, sizeof(client->resolved_topic_prefix));
+
+    if (cfg->device_id != NULL) {
+        (void)gw_copy_string(client->resolved_device_id, sizeof(client->resolved_device_id), cfg->device_id);
+    }
+    if (cfg->hardware_id != NULL) {
+        (void)gw_copy_string(client->resolved_hardware_id, sizeof(client->resolved_hardware_id), cfg->hardware_id);
+    }
+
+    if (cfg->broker_url != NULL) {
+        (void)gw_copy_string(client->resolved_broker, sizeof(client->resolved_broker), cfg->broker_url);
+    }
+    if (cfg->mqtt_username != NULL) {
+        (void)gw_copy_string(
+            client->resolved_mqtt_username,
+            sizeof(client->resolved_mqtt_username),
+            cfg->mqtt_username);
+    }
+    if (cfg->device_secret != NULL) {
+        (void)gw_copy_string(
+            client->resolved_device_secret,
+            sizeof(client->resolved_device_secret),
+            cfg->device_secret);
+    }
+    if (cfg->topic_prefix != NULL) {
+        (void)gw_copy_string(
+            client->resolved_topic_prefix,
+            sizeof(client->resolved_topic_prefix),
+            cfg->topic_prefix);
+    }
+
+    if (client->resolved_mqtt_username[0] != '\0' && client->resolved_device_secret[0] != '\0' &&
+        client->resolved_topic_prefix[0] != '\0') {
+        client->credentials_ready = true;
+    }
+}
+
+static void gw_cloud_connect_reset(void)
+{
+    if (g_conn.stage == GW_CONN_STAGE_WAIT_CONNACK) {
+        (void)mqtt_abort(&g_rt.mqtt);
+    }
+
+    gw_http_exchange_abort(&g_conn.http);
+    gw_dns_cancel(&g_conn.broker_dns);
+    g_conn.stage = GW_CONN_STAGE_IDLE;
+}
+
+static int gw_cloud_after_credentials(gw_cloud_client_t *client)
+{
+    int rc;
+
+    /* Bootstrap/secret are done; free the keep-alive TLS socket before the MQTT handshake. */
+    gw_http_exchange_abort(&g_conn.http);
+
+    rc = gw_cloud_broker_resolve_start(client);
+    if (rc != 0) {
+        return rc;
+    }
+
+    g_conn.stage = GW_CONN_STAGE_BROKER_RESOLVE;
+    return -EINPROGRESS;
+}
+
+#if defined(CONFIG_GW_ENGINE_CLOUD_CRED_CACHE)
+/* Ties a persisted record to the identity and endpoints it was issued for. */
+static int gw_cloud_cache_fingerprint(const gw_cloud_client_t *client, uint8_t out[GW_CLOUD_STORE_FINGERPRINT_SIZE])
+{
+    const gw_cloud_config_t *cfg = &client->config;
+    char buf[GW_CLOUD_MAX_MSG_BUF];
+    uint8_t digest[32];
+    int rc;
+    int n;
+
+    n = snprintf(
+        buf,
+        sizeof(buf),
+        "%s\n%s\n%s\n%s",
+        gw_identity_key(cfg),
+        (cfg->bootstrap_url != NULL) ? cfg->bootstrap_url : "",
+        (cfg->api_base_url != NULL) ? cfg->api_base_url : "",
+        cfg->manufacturing_key);
+    if (n < 0) {
+        n = 0;
+    } else if ((size_t)n >= sizeof(buf)) {
+        n = (int)sizeof(buf) - 1;
+    }
+
+    rc = gw_sha256((const uint8_t *)buf, (size_t)n, digest);
+    if (rc != 0) {
+        return rc;
+    }
+
+    (void)memcpy(out, digest, GW_CLOUD_STORE_FINGERPRINT_SIZE);
+    return 0;
+}
+
+static bool gw_cloud_cache_load(gw_cloud_client_t *client)
+{
+    uint8_t fp[GW_CLOUD_STORE_FINGERPRINT_SIZE];
+
+    if (gw_cloud_cache_fingerprint(client, fp) != 0 || gw_cloud_store_load(client, fp) != 0) {
+        return false;
+    }
+
+    client->stats.cred_cache_hits++;
+    return true;
+}
+
+static void gw_cloud_cache_save(const gw_cloud_client_t *client)
+{
+    uint8_t fp[GW_CLOUD_STORE_FINGERPRINT_SIZE];
+
+    if (gw_cloud_cache_fingerprint(client, fp) == 0) {
+        (void)gw_cloud_store_save(client, fp);
+    }
+}
+#endif
+
+/*
+ * Starts a connect sequence. Persisted credentials go straight to the broker;
+ * bootstrap only runs when there is no valid cache entry.
+ */
+static int gw_cloud_session_start(gw_cloud_client_t *client)
+{
+    int rc;
+
+    g_conn.from_cache = false;
+
+#if defined(CONFIG_GW_ENGINE_CLOUD_CRED_CACHE)
+    if (gw_cloud_cache_load(client)) {
+        g_conn.from_cache = true;
+        rc = gw_cloud_after_credentials(client);
+        return (rc == -EINPROGRESS) ? 0 : rc;
+    }
+#endif
+
+    rc = gw_cloud_bootstrap_start(client);
+    if (rc != 0) {
+        return rc;
+    }
+
+    g_conn.stage = GW_CONN_STAGE_BOOTSTRAP;
+    return 0;
+}
+
+#if defined(CONFIG_GW_ENGINE_CLOUD_CRED_CACHE)
+/* The broker refused cached credentials: drop them and fall back to bootstrap. */
+static int gw_cloud_cache_rejected(gw_cloud_client_t *client)
+{
+    int rc;
+
+    (void)mqtt_abort(&g_rt.mqtt);
+    (void)gw_cloud_store_clear();
+    client->stats.cred_cache_invalidations++;
+    gw_cloud_apply_config_credentials(client);
+    g_conn.from_cache = false;
+
+    rc = gw_cloud_bootstrap_start(client);
+    if (rc != 0) {
+        return rc;
+    }
+
+    g_conn.stage = GW_CONN_STAGE_BOOTSTRAP;
+    return -EINPROGRESS;
+}
+#endif
+
+/*
+ * Advances the connect sequence by whatever can be done without blocking.
+ * Returns -EINPROGRESS while a stage is waiting on the network.
+ */
+static int gw_cloud_connect_advance(gw_cloud_client_t *client)
+{
+    int rc;
+
+    switch (g_conn.stage) {
+    case GW_CONN_STAGE_BOOTSTRAP:
+        rc = gw_http_exchange_poll(&g_conn.http, &g_conn.result);
+        if (rc != 0) {
+            return rc;
+        }
+
+        rc = gw_cloud_bootstrap_parse(client, &g_conn.result);
+        if (rc != 0) {
+            return rc;
+        }
+
+        if (client->status != GW_CLOUD_STATUS_CLAIMED && client->status != GW_CLOUD_STATUS_ACTIVE) {
+            return -EAGAIN;
+        }
+
+        if (client->credentials_ready) {
+            return gw_cloud_after_credentials(client);
+        }
+
+        rc = gw_cloud_secret_start(client);
+        if (rc != 0) {
+            return rc;
+        }
+
+        g_conn.stage = GW_CONN_STAGE_SECRET;
+        return -EINPROGRESS;
+
+    case GW_CONN_STAGE_SECRET:
+        rc = gw_http_exchange_poll(&g_conn.http, &g_conn.result);
+        if (rc != 0) {
+            return rc;
+        }
+
+        rc = gw_cloud_secret_parse(client, &g_conn.result);
+        if (rc != 0) {
+            return rc;
+        }
+
+        return gw_cloud_after_credentials(client);
+
+    case GW_CONN_STAGE_BROKER_RESOLVE:
+        if (k_uptime_get() >= g_conn.deadline) {
+            return -ETIMEDOUT;
+        }
+
+        rc = gw_dns_poll(&g_conn.broker_dns);
+        if (rc != 0) {
+            return rc;
+        }
+
+        g_conn.stage = GW_CONN_STAGE_MQTT_CONNECT;
+        __fallthrough;
+
+    case GW_CONN_STAGE_MQTT_CONNECT:
+        rc = gw_cloud_mqtt_configure(client);
+        if (rc != 0) {
+            return rc;
+        }
+
+        if (gw_url_is_tls(&g_conn.broker_url)) {
+            gw_tls_handshake_begin(&g_conn.broker_tls, &g_conn.broker_dns.addr);
+        }
+
+        /* The MQTT library connects synchronously; it is bounded by mqtt_connect_timeout_ms. */
+        rc = mqtt_connect(&g_rt.mqtt);
+        if (rc != 0) {
+            /* The MQTT socket cannot be raced; rotate the address for the next attempt instead. */
+            gw_dns_cache_rank(g_conn.broker_dns.host, &g_conn.broker_dns.addr, false);
+            return rc;
+        }
+
+        /* mqtt_connect returns after TCP, TLS and the WebSocket upgrade; CONNACK follows. */
+        gw_tls_handshake_done(&g_conn.broker_tls, &client->stats.tls_mqtt);
+
+        gw_prepare_fds(&g_rt.mqtt);
+        g_conn.deadline = k_uptime_get() + (int64_t)client->config.mqtt_connect_timeout_ms;
+        g_conn.stage = GW_CONN_STAGE_WAIT_CONNACK;
+        return -EINPROGRESS;
+
+    case GW_CONN_STAGE_WAIT_CONNACK:
+        if (g_rt.nfds > 0 && poll(g_rt.fds, g_rt.nfds, 0) > 0) {
+            rc = mqtt_input(&g_rt.mqtt);
+            if (rc != 0) {
+                return rc;
+            }
+        }
+
+        if (g_rt.connack_received) {
+#if defined(CONFIG_GW_ENGINE_CLOUD_CRED_CACHE)
+            if (g_rt.mqtt_connected) {
+                if (!g_conn.from_cache) {
+                    gw_cloud_cache_save(client);
+                }
+            } else if (g_conn.from_cache && gw_mqtt_credentials_rejected(g_rt.connack_code)) {
+                return gw_cloud_cache_rejected(client);
+            }
+#endif
+            return g_rt.mqtt_connected ? 0 : gw_mqtt_connack_error(g_rt.connack_code);
+        }
+
+        if (k_uptime_get() >= g_conn.deadline) {
+            gw_dns_cache_rank(g_conn.broker_dns.host, &g_conn.broker_dns.addr, false);
+            return -ETIMEDOUT;
+        }
+
+        return -EINPROGRESS;
+
+    case GW_CONN_STAGE_CONNECTED:
+        return 0;
+
+    case GW_CONN_STAGE_IDLE:
+    default:
+        return -ENOTCONN;
+    }
+}
+
+static bool gw_cloud_rate_enabled(const gw_cloud_client_t *client)
+{
+    return client->config.publish_rate_msgs > 0U || client->config.publish_rate_bytes > 0U;
+}
+
+static void gw_cloud_rate_reset(const gw_cloud_client_t *client)
+{
+    (void)memset(&g_rate, 0, sizeof(g_rate));
+    g_rate.msg_tokens = (int64_t)client->config.publish_burst_msgs * 1000;
+    g_rate.byte_tokens = (int64_t)client->config.publish_burst_bytes * 1000;
+    g_rate.refilled_at = k_uptime_get();
+}
+
+/*
+ * Takes the tokens for one publish of len bytes. Returns 0 when it may be sent,
+ * otherwise the milliseconds until the bucket can pay for it. A payload larger
+ * than the byte burst waits for a full bucket and leaves it in debt.
+ */
+static uint32_t gw_cloud_rate_take(gw_cloud_client_t *client, size_t len)
+{
+    const gw_cloud_config_t *cfg = &client->config;
+    int64_t now = k_uptime_get();
+    int64_t elapsed = now - g_rate.refilled_at;
+    int64_t need_bytes = (int64_t)MIN(len, cfg->publish_burst_bytes) * 1000;
+    int64_t wait = 0;
+    uint32_t waited;
+
+    if (!gw_cloud_rate_enabled(client)) {
+        return 0U;
+    }
+
+    g_rate.refilled_at = now;
+    g_rate.msg_tokens = MIN(g_rate.msg_tokens + elapsed * cfg->publish_rate_msgs,
+                            (int64_t)cfg->publish_burst_msgs * 1000);
+    g_rate.byte_tokens = MIN(g_rate.byte_tokens + elapsed * cfg->publish_rate_bytes,
+                             (int64_t)cfg->publish_burst_bytes * 1000);
+
+    if (cfg->publish_rate_msgs > 0U && g_rate.msg_tokens < 1000) {
+        wait = (1000 - g_rate.msg_tokens + cfg->publish_rate_msgs - 1) / cfg->publish_rate_msgs;
+    }
+
+    if (cfg->publish_rate_bytes > 0U && g_rate.byte_tokens < need_bytes) {
+        wait = MAX(wait, (need_bytes - g_rate.byte_tokens + cfg->publish_rate_bytes - 1) / cfg->publish_rate_bytes);
+    }
+
+    g_rate.wait_ms = (uint32_t)wait;
+    if (wait > 0) {
+        if (!g_rate.deferred) {
+            g_rate.deferred = true;
+            g_rate.deferred_since = now;
+            client->stats.rate_deferred++;
+        }
+        return (uint32_t)wait;
+    }
+
+    if (g_rate.deferred) {
+        waited = (uint32_t)(now - g_rate.deferred_since);
+        g_rate.deferred = false;
+        client->stats.rate_deferred_ms += waited;
+        if (waited > client->stats.rate_deferred_max_ms) {
+            client->stats.rate_deferred_max_ms = waited;
         }
     }
 
-    poll_interval = 0U;
-    if (gw_json_get_uint(result.body, "poll_interval", &poll_interval) == 0) {
-        client->poll_interval_s = poll_interval;
+    if (cfg->publish_rate_msgs > 0U) {
+        g_rate.msg_tokens -= 1000;
+    }
+    if (cfg->publish_rate_bytes > 0U) {
+        g_rate.byte_tokens -= (int64_t)len * 1000;
     }
 
-    return 0;
+    return 0U;
 }
 
-static int gw_cloud_do_secret(gw_cloud_client_t *client)
+static bool gw_cloud_publish_window_open(const gw_cloud_client_t *client)
 {
-    char url_buf[GW_CLOUD_MAX_URL_BUF];
-    char payload[GW_CLOUD_MAX_MSG_BUF];
-    gw_url_t url;
-    gw_http_result_t result;
+    return client->config.publish_qos != MQTT_QOS_1_AT_LEAST_ONCE || g_inflight.count < GW_MQTT_INFLIGHT;
+}
+
+static int gw_cloud_mqtt_publish(gw_cloud_client_t *client, uint16_t slot, const uint8_t *payload, size_t payload_len)
+{
+    gw_cloud_topic_t *topic = gw_cloud_topic_for(slot, payload, payload_len);
+    gw_cloud_slot_stats_t *slot_stats = &client->slot_stats[slot];
+    gw_mqtt_inflight_entry_t *e = NULL;
+    size_t i;
     int rc;
 
-    rc = gw_build_api_url(
-        client->config.secret_url,
-        client->config.api_base_url,
-        "/api/v1/devices/secret",
-        url_buf,
-        sizeof(url_buf));
-    if (rc != 0 && client->config.secret_url == NULL && client->config.api_base_url == NULL &&
-        client->config.bootstrap_url != NULL) {
-        rc = gw_derive_secret_from_bootstrap(client->config.bootstrap_url, url_buf, sizeof(url_buf));
-    }
-    if (rc != 0) {
-        return rc;
+    if (topic->len == 0U) {
+        return -ENODATA;
     }
 
-    rc = gw_parse_url(url_buf, GW_URL_SCHEME_HTTPS, false, &url);
-    if (rc != 0) {
-        return rc;
-    }
+    if (client->config.publish_qos != MQTT_QOS_1_AT_LEAST_ONCE) {
+        rc = gw_cloud_mqtt_send(
+            client,
+            topic,
+            payload,
+            payload_len,
+            MQTT_QOS_0_AT_MOST_ONCE,
+            gw_mqtt_next_message_id(),
+            false);
+        if (rc != 0) {
+            client->stats.publish_failed++;
+            slot_stats->failed++;
+            return rc;
+        }
 
-    rc = gw_build_auth_payload(&client->config, payload, sizeof(payload));
-    if (rc != 0) {
-        return rc;
+        client->stats.publish_ok++;
+        slot_stats->published++;
+        slot_stats->bytes += (uint32_t)payload_len;
+        return 0;
     }
 
-    rc = gw_http_post_json(
-        &url,
-        client->config.tls_sec_tag,
-        payload,
-        client->config.bootstrap_timeout_ms,
-        &result);
-    if (rc != 0) {
-        return rc;
+    if (payload_len > GW_MQTT_INFLIGHT_MAX_PAYLOAD) {
+        return -EMSGSIZE;
     }
 
-    if (result.status_code != 200U) {
-        return -EACCES;
+    if (g_inflight.count >= GW_MQTT_INFLIGHT) {
+        client->stats.backpressure++;
+        return -EAGAIN;
     }
 
-    rc = gw_json_get_string(
-        result.body,
-        "device_secret",
-        client->resolved_device_secret,
-        sizeof(client->resolved_device_secret));
-    if (rc != 0) {
-        return rc;
+    for (i = 0U; i < GW_MQTT_INFLIGHT; ++i) {
+        if (!g_inflight.entries[i].in_use) {
+            e = &g_inflight.entries[i];
+            break;
+        }
     }
 
-    rc = gw_json_get_string(
-        result.body,
-        "mqtt_username",
-        client->resolved_mqtt_username,
-        sizeof(client->resolved_mqtt_username));
-    if (rc != 0) {
-        return rc;
-    }
+    e->in_use = true;
+    e->message_id = gw_mqtt_next_message_id();
+    e->slot = slot;
+    e->len = (uint16_t)payload_len;
+    e->order = g_inflight.next_order++;
+    e->sent_at = k_uptime_get();
+    (void)memcpy(e->payload, payload, payload_len);
+    g_inflight.count++;
 
-    rc = gw_json_get_string(result.body, "broker", client->resolved_broker, sizeof(client->resolved_broker));
-    if (rc != 0) {
-        return rc;
+    client->stats.inflight = g_inflight.count;
+    if (g_inflight.count > client->stats.inflight_high_watermark) {
+        client->stats.inflight_high_watermark = g_inflight.count;
     }
 
-    rc = gw_json_get_string(
-        result.body,
-        "topic_prefix",
-        client->resolved_topic_prefix,
-        sizeof(client->resolved_topic_prefix));
+    /* Once stored the message is owed to the broker: a failed send is retried with DUP on reconnect. */
+    rc = gw_cloud_mqtt_send(client, topic, e->payload, e->len, MQTT_QOS_1_AT_LEAST_ONCE, e->message_id, false);
     if (rc != 0) {
-        return rc;
+        client->stats.publish_failed++;
+        slot_stats->failed++;
     }
 
-    client->credentials_ready = true;
     return 0;
 }
 
-static void gw_mqtt_evt_handler(struct mqtt_client *mqtt, const struct mqtt_evt *evt)
+/* Subscribed on every connection: QoS 1 so the broker redelivers commands lost to a reconnect. */
+static int gw_cloud_mqtt_subscribe(void)
 {
-    gw_cloud_client_t *client;
-
-    if (mqtt == NULL || evt == NULL) {
-        return;
-    }
-
-    client = (gw_cloud_client_t *)mqtt->user_data;
-    if (client == NULL) {
-        return;
-    }
-
-    switch (evt->type) {
-    case MQTT_EVT_CONNACK:
-        g_rt.connack_received = true;
-        g_rt.connack_result = evt->result;
-        if (evt->result == 0 && evt->param.connack.return_code == MQTT_CONNECTION_ACCEPTED) {
-            g_rt.mqtt_connected = true;
-            client->connected = true;
-        } else {
-            g_rt.mqtt_connected = false;
-            client->connected = false;
-        }
-        break;
-
-    case MQTT_EVT_DISCONNECT:
-        g_rt.mqtt_connected = false;
-        client->connected = false;
-        break;
+    struct mqtt_topic topic = {
+        .topic = {
+            .utf8 = (const uint8_t *)g_rt.cmd_filter,
+            .size = g_rt.cmd_filter_len,
+        },
+        .qos = MQTT_QOS_1_AT_LEAST_ONCE,
+    };
+    struct mqtt_subscription_list list = {
+        .list = &topic,
+        .list_count = 1U,
+        .message_id = gw_mqtt_next_message_id(),
+    };
 
-    default:
-        break;
-    }
+    return mqtt_subscribe(&g_rt.mqtt, &list);
 }
 
-static int gw_prepare_broker_sockaddr(const gw_url_t *url)
+/* Replays unacked QoS 1 publishes in their original order with the DUP flag set. */
+static int gw_cloud_mqtt_resend_inflight(gw_cloud_client_t *client)
 {
-    struct addrinfo hints;
-    struct addrinfo *res = NULL;
-    char port_buf[8];
+    uint32_t floor = 0U;
+    bool first = true;
+    size_t sent;
+    size_t i;
     int rc;
 
-    if (url == NULL) {
-        return -EINVAL;
+    if (g_inflight.count == 0U) {
+        return 0;
     }
 
-    (void)memset(&hints, 0, sizeof(hints));
-    hints.ai_family = AF_UNSPEC;
-    hints.ai_socktype = SOCK_STREAM;
+    for (sent = 0U; sent < g_inflight.count; ++sent) {
+        gw_mqtt_inflight_entry_t *next = NULL;
 
-    rc = gw_snprintf_checked(port_buf, sizeof(port_buf), "%u", url->port);
-    if (rc != 0) {
-        return rc;
-    }
+        for (i = 0U; i < GW_MQTT_INFLIGHT; ++i) {
+            gw_mqtt_inflight_entry_t *e = &g_inflight.entries[i];
 
-    rc = getaddrinfo(url->host, port_buf, &hints, &res);
-    if (rc != 0 || res == NULL) {
-        return -EHOSTUNREACH;
-    }
+            if (!e->in_use || (!first && e->order <= floor)) {
+                continue;
+            }
+            if (next == NULL || e->order < next->order) {
+                next = e;
+            }
+        }
 
-    if (res->ai_addrlen > sizeof(g_rt.broker)) {
-        freeaddrinfo(res);
-        return -ENOBUFS;
-    }
+        if (next == NULL) {
+            break;
+        }
+
+        rc = gw_cloud_mqtt_send(
+            client,
+            gw_cloud_topic_for(next->slot, next->payload, next->len),
+            next->payload,
+            next->len,
+            MQTT_QOS_1_AT_LEAST_ONCE,
+            next->message_id,
+            true);
+        if (rc != 0) {
+            return rc;
+        }
 
-    (void)memcpy(&g_rt.broker, res->ai_addr, res->ai_addrlen);
-    freeaddrinfo(res);
+        client->stats.qos1_retransmits++;
+        floor = next->order;
+        first = false;
+    }
 
     return 0;
 }
 
-static void gw_prepare_fds(struct mqtt_client *mqtt)
+static int gw_cloud_connect_run(gw_cloud_client_t *client)
 {
-    g_rt.nfds = 0;
+    int rc;
 
-    if (mqtt == NULL) {
-        return;
+    rc = gw_cloud_connect_advance(client);
+    if (rc == 0) {
+        rc = gw_cloud_mqtt_subscribe();
+    }
+    if (rc == 0) {
+        rc = gw_cloud_mqtt_resend_inflight(client);
+    }
+    if (rc == 0) {
+        g_conn.stage = GW_CONN_STAGE_CONNECTED;
+        client->connected = true;
+        return 0;
     }
 
-    switch (mqtt->transport.type) {
-    case MQTT_TRANSPORT_NON_SECURE:
-        g_rt.fds[0].fd = mqtt->transport.tcp.sock;
-        break;
-#if defined(CONFIG_MQTT_LIB_TLS)
-    case MQTT_TRANSPORT_SECURE:
-        g_rt.fds[0].fd = mqtt->transport.tls.sock;
-        break;
-#endif
-#if defined(CONFIG_MQTT_LIB_WEBSOCKET)
-    case MQTT_TRANSPORT_NON_SECURE_WEBSOCKET:
-#if defined(CONFIG_MQTT_LIB_TLS)
-    case MQTT_TRANSPORT_SECURE_WEBSOCKET:
-#endif
-        g_rt.fds[0].fd = mqtt->transport.websocket.sock;
-        break;
-#endif
-    default:
-        return;
+    if (rc != -EINPROGRESS) {
+        gw_cloud_connect_reset();
+        client->connected = false;
     }
 
-    g_rt.fds[0].events = POLLIN;
-    g_rt.nfds = 1;
+    return rc;
 }
 
-static int gw_cloud_mqtt_configure(gw_cloud_client_t *client)
+static int gw_cloud_mqtt_service(gw_cloud_client_t *client, bool readable)
 {
-    gw_url_t broker_url;
-    const char *client_id;
     int rc;
 
-    if (client == NULL) {
-        return -EINVAL;
+    if (readable) {
+        rc = mqtt_input(&g_rt.mqtt);
+        if (rc != 0) {
+            client->connected = false;
+            return rc;
+        }
     }
 
-    if (client->resolved_broker[0] == '\0') {
-        if (client->config.broker_url == NULL || client->config.broker_url[0] == '\0') {
-            return -EINVAL;
-        }
-        rc = gw_copy_string(client->resolved_broker, sizeof(client->resolved_broker), client->config.broker_url);
+    rc = mqtt_live(&g_rt.mqtt);
+    if (rc != 0 && rc != -EAGAIN) {
+        client->connected = false;
+        return rc;
+    }
+
+    if (rc == 0) {
+        rc = mqtt_input(&g_rt.mqtt);
         if (rc != 0) {
+            client->connected = false;
             return rc;
         }
     }
 
-    rc = gw_parse_url(client->resolved_broker, GW_URL_SCHEME_WSS, true, &broker_url);
-    if (rc != 0) {
-        return rc;
+    return client->connected ? 0 : -ENOTCONN;
+}
+
+static void gw_cloud_session_close(gw_cloud_client_t *client)
+{
+    if (client->connected) {
+        (void)mqtt_disconnect(&g_rt.mqtt, NULL);
     }
 
+    gw_cloud_connect_reset();
     (void)memset(&g_rt, 0, sizeof(g_rt));
+    client->connected = false;
+}
 
-    rc = gw_prepare_broker_sockaddr(&broker_url);
-    if (rc != 0) {
-        return rc;
+#if defined(CONFIG_GW_ENGINE_CLOUD_THREAD)
+
+#define GW_CLOUD_WORKER_REQ_CONNECT BIT(0)
+#define GW_CLOUD_WORKER_REQ_DISCONNECT BIT(1)
+#define GW_CLOUD_WORKER_CONNECT_POLL_MS 20
+
+typedef enum {
+    GW_CLOUD_SESSION_IDLE = 0,
+    GW_CLOUD_SESSION_CONNECTING = 1,
+    GW_CLOUD_SESSION_CONNECTED = 2,
+    GW_CLOUD_SESSION_FAILED = 3,
+} gw_cloud_session_t;
+
+typedef struct {
+    uint16_t slot;
+    uint16_t len;
+    uint8_t payload[CONFIG_GW_ENGINE_CLOUD_PUBLISH_MAX_PAYLOAD];
+} gw_cloud_pub_item_t;
+
+/* A queued item must also fit the QoS 1 in-flight copy. */
+BUILD_ASSERT(CONFIG_GW_ENGINE_CLOUD_PUBLISH_MAX_PAYLOAD <= GW_MQTT_INFLIGHT_MAX_PAYLOAD,
+             "publish queue payload exceeds the QoS 1 in-flight payload");
+
+/*
+ * The worker owns g_rt/g_conn and every socket. Other threads only touch the
+ * publish queue (under queue_lock) and the atomics below.
+ */
+typedef struct {
+    struct k_thread thread;
+    bool started;
+    int wake_fd;
+    atomic_t requests;
+    atomic_t session;
+    atomic_t last_error;
+    gw_cloud_client_t *client;
+    struct k_mutex queue_lock;
+    gw_cloud_pub_item_t queue[CONFIG_GW_ENGINE_CLOUD_PUBLISH_QUEUE_DEPTH];
+    uint16_t queue_head;
+    uint16_t queue_count;
+    /* Set by gw_cloud_worker_flush while the head item waits for tokens. */
+    uint32_t rate_wait_ms;
+    /*
+     * client->stats and slot_stats are written by the worker; it copies them
+     * here under queue_lock once per loop for gw_cloud_get_stats(). Publishes
+     * the caller rejects are counted in publish_rejected, also under the lock.
+     */
+    gw_cloud_stats_t stats;
+    gw_cloud_slot_stats_t slot_stats[GW_CLOUD_SLOTS];
+    uint32_t publish_rejected;
+} gw_cloud_worker_t;
+
+K_THREAD_STACK_DEFINE(g_worker_stack, CONFIG_GW_ENGINE_CLOUD_THREAD_STACK_SIZE);
+static gw_cloud_worker_t g_worker;
+
+static void gw_cloud_worker_wake(void)
+{
+    (void)eventfd_write(g_worker.wake_fd, 1);
+}
+
+static void gw_cloud_worker_request(atomic_val_t req)
+{
+    (void)atomic_or(&g_worker.requests, req);
+    gw_cloud_worker_wake();
+}
+
+static void gw_cloud_worker_fail(gw_cloud_client_t *client, int err)
+{
+    gw_cloud_session_close(client);
+    (void)atomic_set(&g_worker.last_error, err);
+    (void)atomic_cas(&g_worker.session, GW_CLOUD_SESSION_CONNECTING, GW_CLOUD_SESSION_FAILED);
+    (void)atomic_cas(&g_worker.session, GW_CLOUD_SESSION_CONNECTED, GW_CLOUD_SESSION_FAILED);
+}
+
+static void gw_cloud_worker_snapshot(const gw_cloud_client_t *client)
+{
+    (void)k_mutex_lock(&g_worker.queue_lock, K_FOREVER);
+    g_worker.stats = client->stats;
+    g_worker.stats.publish_failed += g_worker.publish_rejected;
+    (void)memcpy(g_worker.slot_stats, client->slot_stats, sizeof(g_worker.slot_stats));
+    (void)k_mutex_unlock(&g_worker.queue_lock);
+}
+
+static void gw_cloud_queue_clear(void)
+{
+    (void)k_mutex_lock(&g_worker.queue_lock, K_FOREVER);
+    g_worker.queue_head = 0U;
+    g_worker.queue_count = 0U;
+    if (g_worker.client != NULL) {
+        g_worker.client->stats.queue_depth = 0U;
     }
+    (void)k_mutex_unlock(&g_worker.queue_lock);
+}
 
-    mqtt_client_init(&g_rt.mqtt);
+static int gw_cloud_queue_push(gw_cloud_client_t *client, uint16_t slot, const uint8_t *payload, size_t payload_len)
+{
+    gw_cloud_pub_item_t *item;
+    uint16_t tail;
 
-    g_rt.mqtt.broker = &g_rt.broker;
-    g_rt.mqtt.evt_cb = gw_mqtt_evt_handler;
-    g_rt.mqtt.user_data = client;
-    g_rt.mqtt.rx_buf = g_rt.mqtt_rx_buf;
-    g_rt.mqtt.rx_buf_size = sizeof(g_rt.mqtt_rx_buf);
-    g_rt.mqtt.tx_buf = g_rt.mqtt_tx_buf;
-    g_rt.mqtt.tx_buf_size = sizeof(g_rt.mqtt_tx_buf);
-    g_rt.mqtt.protocol_version = MQTT_VERSION_3_1_1;
+    if (payload_len > CONFIG_GW_ENGINE_CLOUD_PUBLISH_MAX_PAYLOAD) {
+        return -EMSGSIZE;
+    }
 
-    client_id = client->config.mqtt_client_id;
-    if (client_id == NULL || client_id[0] == '\0') {
-        client_id = (client->resolved_device_id[0] != '\0') ? client->resolved_device_id : client->config.device_id;
+    (void)k_mutex_lock(&g_worker.queue_lock, K_FOREVER);
+
+    if (g_worker.queue_count == CONFIG_GW_ENGINE_CLOUD_PUBLISH_QUEUE_DEPTH) {
+        client->stats.queue_dropped++;
+        if (client->config.publish_queue_policy != GW_CLOUD_QUEUE_DROP_OLDEST) {
+            (void)k_mutex_unlock(&g_worker.queue_lock);
+            return -ENOBUFS;
+        }
+        g_worker.queue_head = (uint16_t)((g_worker.queue_head + 1U) % CONFIG_GW_ENGINE_CLOUD_PUBLISH_QUEUE_DEPTH);
+        g_worker.queue_count--;
     }
-    if (client_id == NULL || client_id[0] == '\0') {
-        return -EINVAL;
+
+    tail = (uint16_t)((g_worker.queue_head + g_worker.queue_count) % CONFIG_GW_ENGINE_CLOUD_PUBLISH_QUEUE_DEPTH);
+    item = &g_worker.queue[tail];
+    (void)memcpy(item->payload, payload, payload_len);
+    item->slot = slot;
+    item->len = (uint16_t)payload_len;
+    g_worker.queue_count++;
+    client->stats.queue_depth = g_worker.queue_count;
+
+    if (g_worker.queue_count > client->stats.queue_high_watermark) {
+        client->stats.queue_high_watermark = g_worker.queue_count;
     }
 
-    g_rt.mqtt.client_id.utf8 = (const uint8_t *)client_id;
-    g_rt.mqtt.client_id.size = strlen(client_id);
+    (void)k_mutex_unlock(&g_worker.queue_lock);
+    return 0;
+}
 
-    g_rt.mqtt_user_name.utf8 = (const uint8_t *)client->resolved_mqtt_username;
-    g_rt.mqtt_user_name.size = strlen(client->resolved_mqtt_username);
-    g_rt.mqtt_password.utf8 = (const uint8_t *)client->resolved_device_secret;
-    g_rt.mqtt_password.size = strlen(client->resolved_device_secret);
+static bool gw_cloud_queue_peek_len(uint16_t *out_len)
+{
+    bool found;
 
-    g_rt.mqtt.user_name = &g_rt.mqtt_user_name;
-    g_rt.mqtt.password = &g_rt.mqtt_password;
+    (void)k_mutex_lock(&g_worker.queue_lock, K_FOREVER);
+    found = g_worker.queue_count > 0U;
+    if (found) {
+        *out_len = g_worker.queue[g_worker.queue_head].len;
+    }
+    (void)k_mutex_unlock(&g_worker.queue_lock);
 
-    g_rt.mqtt.keepalive = (client->config.mqtt_keepalive_sec == 0U) ? 60U : client->config.mqtt_keepalive_sec;
+    return found;
+}
 
-    switch (broker_url.scheme) {
-    case GW_URL_SCHEME_WSS:
-#if defined(CONFIG_MQTT_LIB_TLS) && defined(CONFIG_MQTT_LIB_WEBSOCKET)
-        if (client->config.tls_sec_tag < 0) {
-            return -EINVAL;
-        }
-        g_rt.mqtt.transport.type = MQTT_TRANSPORT_SECURE_WEBSOCKET;
-        g_rt.sec_tags[0] = (sec_tag_t)client->config.tls_sec_tag;
-        g_rt.mqtt.transport.tls.config.peer_verify = TLS_PEER_VERIFY_REQUIRED;
-        g_rt.mqtt.transport.tls.config.sec_tag_list = g_rt.sec_tags;
-        g_rt.mqtt.transport.tls.config.sec_tag_count = 1U;
-        g_rt.mqtt.transport.tls.config.hostname = broker_url.host;
+/* The head item is copied out so producers are never blocked behind mqtt_publish(). */
+static bool gw_cloud_queue_pop(gw_cloud_pub_item_t *out)
+{
+    bool found = false;
 
-        g_rt.mqtt.transport.websocket.config.host = broker_url.host;
-        g_rt.mqtt.transport.websocket.config.url = broker_url.path;
-        g_rt.mqtt.transport.websocket.config.tmp_buf = g_rt.ws_tmp_buf;
-        g_rt.mqtt.transport.websocket.config.tmp_buf_len = sizeof(g_rt.ws_tmp_buf);
-        g_rt.mqtt.transport.websocket.timeout = (int32_t)client->config.mqtt_connect_timeout_ms;
-#else
-        return -ENOTSUP;
-#endif
-        break;
+    (void)k_mutex_lock(&g_worker.queue_lock, K_FOREVER);
 
-    case GW_URL_SCHEME_WS:
-#if defined(CONFIG_MQTT_LIB_WEBSOCKET)
-        g_rt.mqtt.transport.type = MQTT_TRANSPORT_NON_SECURE_WEBSOCKET;
-        g_rt.mqtt.transport.websocket.config.host = broker_url.host;
-        g_rt.mqtt.transport.websocket.config.url = broker_url.path;
-        g_rt.mqtt.transport.websocket.config.tmp_buf = g_rt.ws_tmp_buf;
-        g_rt.mqtt.transport.websocket.config.tmp_buf_len = sizeof(g_rt.ws_tmp_buf);
-        g_rt.mqtt.transport.websocket.timeout = (int32_t)client->config.mqtt_connect_timeout_ms;
-#else
-        return -ENOTSUP;
-#endif
-        break;
+    if (g_worker.queue_count > 0U) {
+        const gw_cloud_pub_item_t *item = &g_worker.queue[g_worker.queue_head];
 
-    case GW_URL_SCHEME_HTTPS:
-#if defined(CONFIG_MQTT_LIB_TLS)
-        if (client->config.tls_sec_tag < 0) {
-            return -EINVAL;
-        }
-        g_rt.mqtt.transport.type = MQTT_TRANSPORT_SECURE;
-        g_rt.sec_tags[0] = (sec_tag_t)client->config.tls_sec_tag;
-        g_rt.mqtt.transport.tls.config.peer_verify = TLS_PEER_VERIFY_REQUIRED;
-        g_rt.mqtt.transport.tls.config.sec_tag_list = g_rt.sec_tags;
-        g_rt.mqtt.transport.tls.config.sec_tag_count = 1U;
-        g_rt.mqtt.transport.tls.config.hostname = broker_url.host;
-#else
-        return -ENOTSUP;
-#endif
-        break;
+        out->slot = item->slot;
+        out->len = item->len;
+        (void)memcpy(out->payload, item->payload, item->len);
+        g_worker.queue_head = (uint16_t)((g_worker.queue_head + 1U) % CONFIG_GW_ENGINE_CLOUD_PUBLISH_QUEUE_DEPTH);
+        g_worker.queue_count--;
+        g_worker.client->stats.queue_depth = g_worker.queue_count;
+        found = true;
+    }
 
-    case GW_URL_SCHEME_HTTP:
-        g_rt.mqtt.transport.type = MQTT_TRANSPORT_NON_SECURE;
-        break;
+    (void)k_mutex_unlock(&g_worker.queue_lock);
+    return found;
+}
 
-    default:
-        return -EPROTONOSUPPORT;
+static int gw_cloud_worker_flush(gw_cloud_client_t *client)
+{
+    static gw_cloud_pub_item_t item;
+    uint16_t len;
+    int rc;
+
+    g_worker.rate_wait_ms = 0U;
+
+    /* Items stay queued while the QoS 1 window is full or the token bucket is empty. */
+    while (client->connected && gw_cloud_publish_window_open(client) && gw_cloud_queue_peek_len(&len)) {
+        g_worker.rate_wait_ms = gw_cloud_rate_take(client, len);
+        if (g_worker.rate_wait_ms > 0U || !gw_cloud_queue_pop(&item)) {
+            break;
+        }
+
+        rc = gw_cloud_mqtt_publish(client, item.slot, item.payload, item.len);
+        if (rc == -EMSGSIZE) {
+            /* One bad item is dropped; it says nothing about the session. */
+            client->stats.publish_failed++;
+            continue;
+        }
+        if (rc != 0) {
+            return rc;
+        }
     }
 
     return 0;
 }
 
-static int gw_cloud_wait_connack(gw_cloud_client_t *client)
+static void gw_cloud_worker_handle_requests(gw_cloud_client_t *client)
 {
-    int64_t deadline;
+    atomic_val_t req = atomic_clear(&g_worker.requests);
+    int rc;
 
-    if (client == NULL) {
-        return -EINVAL;
+    if ((req & GW_CLOUD_WORKER_REQ_DISCONNECT) != 0) {
+        gw_cloud_session_close(client);
+    }
+
+    if ((req & GW_CLOUD_WORKER_REQ_CONNECT) != 0 && !client->connected && g_conn.stage == GW_CONN_STAGE_IDLE) {
+        (void)atomic_set(&g_worker.session, GW_CLOUD_SESSION_CONNECTING);
+        rc = gw_cloud_session_start(client);
+        if (rc != 0) {
+            gw_cloud_worker_fail(client, rc);
+            return;
+        }
+    }
+}
+
+static int gw_cloud_worker_timeout_ms(gw_cloud_client_t *client)
+{
+    if (client->connected) {
+        if (g_worker.rate_wait_ms > 0U) {
+            return MIN(mqtt_keepalive_time_left(&g_rt.mqtt), (int)g_worker.rate_wait_ms);
+        }
+        return mqtt_keepalive_time_left(&g_rt.mqtt);
+    }
+
+    if (g_conn.stage != GW_CONN_STAGE_IDLE && g_conn.stage != GW_CONN_STAGE_CONNECTED) {
+        return GW_CLOUD_WORKER_CONNECT_POLL_MS;
     }
 
-    deadline = k_uptime_get() + (int64_t)client->config.mqtt_connect_timeout_ms;
+    return -1;
+}
 
-    while (k_uptime_get() < deadline) {
-        int timeout = (int)(deadline - k_uptime_get());
+static void gw_cloud_worker_main(void *p1, void *p2, void *p3)
+{
+    ARG_UNUSED(p1);
+    ARG_UNUSED(p2);
+    ARG_UNUSED(p3);
+
+    for (;;) {
+        gw_cloud_client_t *client = g_worker.client;
+        struct pollfd fds[2];
+        int nfds = 1;
         int rc;
 
-        if (timeout > 250) {
-            timeout = 250;
+        gw_cloud_worker_handle_requests(client);
+
+        if (!client->connected && g_conn.stage != GW_CONN_STAGE_IDLE) {
+            rc = gw_cloud_connect_run(client);
+            if (rc == 0) {
+                (void)atomic_cas(&g_worker.session, GW_CLOUD_SESSION_CONNECTING, GW_CLOUD_SESSION_CONNECTED);
+            } else if (rc != -EINPROGRESS) {
+                gw_cloud_worker_fail(client, rc);
+            }
         }
 
-        rc = (g_rt.nfds > 0) ? poll(g_rt.fds, g_rt.nfds, timeout) : 0;
-        if (rc > 0) {
-            rc = mqtt_input(&g_rt.mqtt);
+        if (client->connected) {
+            rc = gw_cloud_worker_flush(client);
             if (rc != 0) {
-                return rc;
+                gw_cloud_worker_fail(client, rc);
             }
         }
 
-        if (g_rt.connack_received) {
-            return g_rt.mqtt_connected ? 0 : -ECONNREFUSED;
+        gw_cloud_worker_snapshot(client);
+
+        fds[0].fd = g_worker.wake_fd;
+        fds[0].events = POLLIN;
+        fds[0].revents = 0;
+
+        if (client->connected && g_rt.nfds > 0) {
+            fds[1] = g_rt.fds[0];
+            fds[1].revents = 0;
+            nfds = 2;
+        }
+
+        rc = poll(fds, nfds, gw_cloud_worker_timeout_ms(client));
+        if (rc > 0 && (fds[0].revents & POLLIN) != 0) {
+            eventfd_t value;
+
+            (void)eventfd_read(g_worker.wake_fd, &value);
+        }
+
+        if (client->connected) {
+            rc = gw_cloud_mqtt_service(client, nfds > 1 && fds[1].revents != 0);
+            if (rc != 0) {
+                gw_cloud_worker_fail(client, rc);
+            }
         }
     }
+}
+
+static int gw_cloud_worker_start(gw_cloud_client_t *client)
+{
+    k_tid_t tid;
+
+    g_worker.client = client;
+    (void)atomic_set(&g_worker.session, GW_CLOUD_SESSION_IDLE);
+
+    if (g_worker.started) {
+        (void)k_mutex_lock(&g_worker.queue_lock, K_FOREVER);
+        (void)memset(&g_worker.stats, 0, sizeof(g_worker.stats));
+        (void)memset(g_worker.slot_stats, 0, sizeof(g_worker.slot_stats));
+        g_worker.publish_rejected = 0U;
+        (void)k_mutex_unlock(&g_worker.queue_lock);
+        gw_cloud_worker_request(GW_CLOUD_WORKER_REQ_DISCONNECT);
+        return 0;
+    }
 
-    return -ETIMEDOUT;
+    g_worker.wake_fd = eventfd(0, EFD_NONBLOCK);
+    if (g_worker.wake_fd < 0) {
+        return -errno;
+    }
+
+    (void)k_mutex_init(&g_worker.queue_lock);
+
+    tid = k_thread_create(
+        &g_worker.thread,
+        g_worker_stack,
+        K_THREAD_STACK_SIZEOF(g_worker_stack),
+        gw_cloud_worker_main,
+        NULL,
+        NULL,
+        NULL,
+        CONFIG_GW_ENGINE_CLOUD_THREAD_PRIORITY,
+        0,
+        K_NO_WAIT);
+    (void)k_thread_name_set(tid, "gw_cloud");
+
+    g_worker.started = true;
+    return 0;
 }
 
+#endif
+
 int gw_cloud_init(gw_cloud_client_t *client, const gw_cloud_config_t *cfg)
 {
+    int rc;
+
     if (client == NULL || cfg == NULL) {
         return -EINVAL;
     }
@@ -1200,8 +3435,23 @@ int gw_cloud_init(gw_cloud_client_t *client, const gw_cloud_config_t *cfg)
         return -EINVAL;
     }
 
+    /* QoS 2 is not supported. */
+    if (cfg->publish_qos > MQTT_QOS_1_AT_LEAST_ONCE) {
+        return -EINVAL;
+    }
+
+#if !defined(CONFIG_GW_ENGINE_CLOUD_THREAD)
+    gw_cloud_connect_reset();
+#endif
+
     (void)memset(client, 0, sizeof(*client));
+    (void)memset(&g_inflight, 0, sizeof(g_inflight));
+    (void)memset(&g_cmds, 0, sizeof(g_cmds));
     client->config = *cfg;
+    rc = gw_hmac_sha256_setkey(&g_sign_key, (const uint8_t *)cfg->manufacturing_key, strlen(cfg->manufacturing_key));
+    if (rc != 0) {
+        return rc;
+    }
 
     if (client->config.bootstrap_timeout_ms == 0U) {
         client->config.bootstrap_timeout_ms = GW_CLOUD_HTTP_TIMEOUT_MS;
@@ -1209,43 +3459,62 @@ int gw_cloud_init(gw_cloud_client_t *client, const gw_cloud_config_t *cfg)
     if (client->config.mqtt_connect_timeout_ms == 0U) {
         client->config.mqtt_connect_timeout_ms = GW_CLOUD_MQTT_CONNECT_TIMEOUT_MS;
     }
-
-    if (cfg->device_id != NULL) {
-        (void)gw_copy_string(client->resolved_device_id, sizeof(client->resolved_device_id), cfg->device_id);
+    if (client->config.publish_burst_msgs == 0U) {
+        client->config.publish_burst_msgs = client->config.publish_rate_msgs;
     }
-    if (cfg->hardware_id != NULL) {
-        (void)gw_copy_string(client->resolved_hardware_id, sizeof(client->resolved_hardware_id), cfg->hardware_id);
+    if (client->config.publish_burst_bytes == 0U) {
+        client->config.publish_burst_bytes = client->config.publish_rate_bytes;
     }
 
-    if (cfg->broker_url != NULL) {
-        (void)gw_copy_string(client->resolved_broker, sizeof(client->resolved_broker), cfg->broker_url);
-    }
-    if (cfg->mqtt_username != NULL) {
-        (void)gw_copy_string(
-            client->resolved_mqtt_username,
-            sizeof(client->resolved_mqtt_username),
-            cfg->mqtt_username);
-    }
-    if (cfg->device_secret != NULL) {
-        (void)gw_copy_string(
-            client->resolved_device_secret,
-            sizeof(client->resolved_device_secret),
-            cfg->device_secret);
-    }
-    if (cfg->topic_prefix != NULL) {
-        (void)gw_copy_string(
-            client->resolved_topic_prefix,
-            sizeof(client->resolved_topic_prefix),
-            cfg->topic_prefix);
+    gw_cloud_apply_config_credentials(client);
+    gw_cloud_rate_reset(client);
+
+    client->initialized = true;
+
+#if defined(CONFIG_GW_ENGINE_CLOUD_THREAD)
+    return gw_cloud_worker_start(client);
+#else
+    return 0;
+#endif
+}
+
+bool gw_cloud_is_connected(const gw_cloud_client_t *client)
+{
+    if (client == NULL) {
+        return false;
     }
 
-    if (client->resolved_mqtt_username[0] != '\0' && client->resolved_device_secret[0] != '\0' &&
-        client->resolved_topic_prefix[0] != '\0') {
-        client->credentials_ready = true;
+#if defined(CONFIG_GW_ENGINE_CLOUD_THREAD)
+    /* client->connected belongs to the worker; the session state is its published copy. */
+    return atomic_get(&g_worker.session) == GW_CLOUD_SESSION_CONNECTED;
+#else
+    return client->connected;
+#endif
+}
+
+void gw_cloud_get_stats(const gw_cloud_client_t *client, gw_cloud_stats_t *out, gw_cloud_slot_stats_t *out_slots)
+{
+    if (client == NULL || out == NULL) {
+        return;
     }
 
-    client->initialized = true;
-    return 0;
+#if defined(CONFIG_GW_ENGINE_CLOUD_THREAD)
+    (void)k_mutex_lock(&g_worker.queue_lock, K_FOREVER);
+    *out = g_worker.stats;
+    /* The queue counters are kept by the producer under this lock, so they are current. */
+    out->queue_dropped = client->stats.queue_dropped;
+    out->queue_depth = client->stats.queue_depth;
+    out->queue_high_watermark = client->stats.queue_high_watermark;
+    if (out_slots != NULL) {
+        (void)memcpy(out_slots, g_worker.slot_stats, sizeof(g_worker.slot_stats));
+    }
+    (void)k_mutex_unlock(&g_worker.queue_lock);
+#else
+    *out = client->stats;
+    if (out_slots != NULL) {
+        (void)memcpy(out_slots, client->slot_stats, sizeof(client->slot_stats));
+    }
+#endif
 }
 
 int gw_cloud_connect(gw_cloud_client_t *client)
@@ -1256,124 +3525,152 @@ int gw_cloud_connect(gw_cloud_client_t *client)
         return -EINVAL;
     }
 
-    if (client->connected) {
+    if (gw_cloud_is_connected(client)) {
         return 0;
     }
 
-    rc = gw_cloud_do_bootstrap(client);
-    if (rc != 0) {
-        return rc;
-    }
-
-    if (client->status != GW_CLOUD_STATUS_CLAIMED && client->status != GW_CLOUD_STATUS_ACTIVE) {
-        return -EAGAIN;
+#if defined(CONFIG_GW_ENGINE_CLOUD_THREAD)
+    ARG_UNUSED(rc);
+    if (atomic_cas(&g_worker.session, GW_CLOUD_SESSION_IDLE, GW_CLOUD_SESSION_CONNECTING) ||
+        atomic_cas(&g_worker.session, GW_CLOUD_SESSION_FAILED, GW_CLOUD_SESSION_CONNECTING)) {
+        gw_cloud_worker_request(GW_CLOUD_WORKER_REQ_CONNECT);
     }
-
-    if (!client->credentials_ready) {
-        rc = gw_cloud_do_secret(client);
+    return gw_cloud_pump(client);
+#else
+    if (g_conn.stage == GW_CONN_STAGE_IDLE || g_conn.stage == GW_CONN_STAGE_CONNECTED) {
+        rc = gw_cloud_session_start(client);
         if (rc != 0) {
+            gw_cloud_connect_reset();
             return rc;
         }
     }
 
-    rc = gw_cloud_mqtt_configure(client);
-    if (rc != 0) {
-        return rc;
-    }
-
-    rc = mqtt_connect(&g_rt.mqtt);
-    if (rc != 0) {
-        return rc;
-    }
-
-    gw_prepare_fds(&g_rt.mqtt);
-
-    rc = gw_cloud_wait_connack(client);
-    if (rc != 0) {
-        (void)mqtt_abort(&g_rt.mqtt);
-        client->connected = false;
-        return rc;
-    }
-
-    client->connected = true;
-    return 0;
+    return gw_cloud_connect_run(client);
+#endif
 }
 
 int gw_cloud_publish_telemetry(gw_cloud_client_t *client, const uint8_t *payload, size_t payload_len)
 {
-    struct mqtt_publish_param param;
-    char topic[256];
-    int rc;
+    return gw_cloud_publish_slot(client, 0U, payload, payload_len);
+}
 
-    if (client == NULL || !client->connected) {
+int gw_cloud_publish_slot(gw_cloud_client_t *client, uint16_t slot, const uint8_t *payload, size_t payload_len)
+{
+    if (!gw_cloud_is_connected(client)) {
         return -ENOTCONN;
     }
 
-    if (payload == NULL || payload_len == 0U) {
+    if (payload == NULL || payload_len == 0U || slot >= GW_CLOUD_SLOTS) {
         return -EINVAL;
     }
 
-    if (client->resolved_topic_prefix[0] == '\0') {
-        return -ENODATA;
+    /* Rejected here so the I/O thread never meets an item it cannot keep in flight. */
+    if (client->config.publish_qos == MQTT_QOS_1_AT_LEAST_ONCE && payload_len > GW_MQTT_INFLIGHT_MAX_PAYLOAD) {
+#if defined(CONFIG_GW_ENGINE_CLOUD_THREAD)
+        (void)k_mutex_lock(&g_worker.queue_lock, K_FOREVER);
+        g_worker.publish_rejected++;
+        (void)k_mutex_unlock(&g_worker.queue_lock);
+#else
+        client->stats.publish_failed++;
+#endif
+        return -EMSGSIZE;
     }
 
-    rc = gw_snprintf_checked(topic, sizeof(topic), "%s/slot/%d", client->resolved_topic_prefix, GW_CLOUD_TOPIC_SLOT);
-    if (rc != 0) {
-        return rc;
+#if defined(CONFIG_GW_ENGINE_CLOUD_THREAD)
+    int rc = gw_cloud_queue_push(client, slot, payload, payload_len);
+
+    if (rc == 0) {
+        gw_cloud_worker_wake();
     }
 
-    (void)memset(&param, 0, sizeof(param));
-    param.message.topic.topic.utf8 = (const uint8_t *)topic;
-    param.message.topic.topic.size = strlen(topic);
-    param.message.topic.qos = MQTT_QOS_0_AT_MOST_ONCE;
-    param.message.payload.data = (uint8_t *)payload;
-    param.message.payload.len = payload_len;
-    param.message_id = ++g_rt.last_message_id;
-    param.dup_flag = 0U;
-    param.retain_flag = 0U;
+    return rc;
+#else
+    /* A full QoS 1 window is reported by gw_cloud_mqtt_publish() without spending tokens. */
+    g_rate.wait_ms = 0U;
+    if (gw_cloud_publish_window_open(client) && gw_cloud_rate_take(client, payload_len) > 0U) {
+        return -EAGAIN;
+    }
 
-    rc = mqtt_publish(&g_rt.mqtt, &param);
-    if (rc != 0) {
-        return rc;
+    return gw_cloud_mqtt_publish(client, slot, payload, payload_len);
+#endif
+}
+
+uint32_t gw_cloud_publish_wait_ms(const gw_cloud_client_t *client)
+{
+    if (client == NULL) {
+        return 0U;
     }
 
-    return 0;
+#if defined(CONFIG_GW_ENGINE_CLOUD_THREAD)
+    /* Held publishes wait in the I/O thread's queue; the caller never meets the bucket. */
+    return 0U;
+#else
+    return g_rate.wait_ms;
+#endif
 }
 
 int gw_cloud_pump(gw_cloud_client_t *client)
 {
-    int rc;
-
-    if (client == NULL || !client->connected) {
+    if (client == NULL) {
         return -ENOTCONN;
     }
 
-    if (g_rt.nfds > 0) {
-        rc = poll(g_rt.fds, g_rt.nfds, 0);
-        if (rc > 0) {
-            rc = mqtt_input(&g_rt.mqtt);
-            if (rc != 0) {
-                client->connected = false;
-                return rc;
-            }
+#if defined(CONFIG_GW_ENGINE_CLOUD_THREAD)
+    switch ((gw_cloud_session_t)atomic_get(&g_worker.session)) {
+    case GW_CLOUD_SESSION_CONNECTED:
+        return 0;
+    case GW_CLOUD_SESSION_CONNECTING:
+        return -EINPROGRESS;
+    case GW_CLOUD_SESSION_FAILED:
+        (void)atomic_set(&g_worker.session, GW_CLOUD_SESSION_IDLE);
+        return (int)atomic_get(&g_worker.last_error);
+    default:
+        return -ENOTCONN;
+    }
+#else
+    if (!client->connected) {
+        if (g_conn.stage == GW_CONN_STAGE_IDLE || g_conn.stage == GW_CONN_STAGE_CONNECTED) {
+            g_conn.stage = GW_CONN_STAGE_IDLE;
+            return -ENOTCONN;
         }
+        return gw_cloud_connect_run(client);
     }
 
-    rc = mqtt_live(&g_rt.mqtt);
-    if (rc != 0 && rc != -EAGAIN) {
-        client->connected = false;
-        return rc;
+    return gw_cloud_mqtt_service(client, g_rt.nfds > 0 && poll(g_rt.fds, g_rt.nfds, 0) > 0);
+#endif
+}
+
+int gw_cloud_poll_command(gw_cloud_client_t *client, gw_cloud_command_t *out)
+{
+    const gw_cloud_command_t *cmd;
+    k_spinlock_key_t key;
+    uint16_t count;
+
+    if (client == NULL || out == NULL) {
+        return -EINVAL;
     }
 
-    if (rc == 0) {
-        rc = mqtt_input(&g_rt.mqtt);
-        if (rc != 0) {
-            client->connected = false;
-            return rc;
-        }
+    key = k_spin_lock(&g_cmds.lock);
+    count = g_cmds.count;
+    k_spin_unlock(&g_cmds.lock, key);
+
+    if (count == 0U) {
+        return -EAGAIN;
     }
 
-    return client->connected ? 0 : -ENOTCONN;
+    /* The producer never writes the head slot while it is counted, so copy outside the lock. */
+    cmd = &g_cmds.items[g_cmds.head];
+    out->edge_id = cmd->edge_id;
+    out->len = cmd->len;
+    out->received_ms = cmd->received_ms;
+    (void)memcpy(out->payload, cmd->payload, cmd->len);
+
+    key = k_spin_lock(&g_cmds.lock);
+    g_cmds.head = (uint16_t)((g_cmds.head + 1U) % GW_CLOUD_CMD_QUEUE_DEPTH);
+    g_cmds.count--;
+    k_spin_unlock(&g_cmds.lock, key);
+
+    return 0;
 }
 
 int gw_cloud_disconnect(gw_cloud_client_t *client)
@@ -1382,12 +3679,13 @@ int gw_cloud_disconnect(gw_cloud_client_t *client)
         return -EINVAL;
     }
 
-    if (client->connected) {
-        (void)mqtt_disconnect(&g_rt.mqtt, NULL);
-    }
-
-    (void)memset(&g_rt, 0, sizeof(g_rt));
-    client->connected = false;
+#if defined(CONFIG_GW_ENGINE_CLOUD_THREAD)
+    (void)atomic_set(&g_worker.session, GW_CLOUD_SESSION_IDLE);
+    gw_cloud_queue_clear();
+    gw_cloud_worker_request(GW_CLOUD_WORKER_REQ_DISCONNECT);
+#else
+    gw_cloud_session_close(client);
+#endif
 
     return 0;
 }
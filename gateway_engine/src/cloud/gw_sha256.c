@@ -1,15 +1,75 @@
 #include "gw_sha256.h"
 
+#include <errno.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <string.h>
 
-typedef struct {
-    uint32_t state[8];
-    uint64_t bit_len;
-    uint8_t block[64];
-    size_t block_len;
-} gw_sha256_ctx_t;
+#if defined(CONFIG_GW_ENGINE_SHA256_PSA)
+
+static int gw_sha256_psa_error(psa_status_t status)
+{
+    switch (status) {
+    case PSA_SUCCESS:
+        return 0;
+    case PSA_ERROR_INSUFFICIENT_MEMORY:
+        return -ENOMEM;
+    case PSA_ERROR_NOT_SUPPORTED:
+        return -ENOTSUP;
+    case PSA_ERROR_BAD_STATE:
+    case PSA_ERROR_INVALID_ARGUMENT:
+        return -EINVAL;
+    default:
+        return -EIO;
+    }
+}
+
+int gw_sha256_init(gw_sha256_ctx_t *ctx)
+{
+    psa_status_t status = psa_crypto_init();
+
+    ctx->op = psa_hash_operation_init();
+    if (status == PSA_SUCCESS) {
+        status = psa_hash_setup(&ctx->op, PSA_ALG_SHA_256);
+    }
+
+    return gw_sha256_psa_error(status);
+}
+
+int gw_sha256_update(gw_sha256_ctx_t *ctx, const uint8_t *data, size_t len)
+{
+    if (data == NULL || len == 0U) {
+        return 0;
+    }
+
+    return gw_sha256_psa_error(psa_hash_update(&ctx->op, data, len));
+}
+
+/* A failed operation is aborted by PSA; the digest is zeroed so it can never pass as a MAC. */
+int gw_sha256_final(gw_sha256_ctx_t *ctx, uint8_t out_digest[32])
+{
+    size_t len = 0U;
+    psa_status_t status = psa_hash_finish(&ctx->op, out_digest, GW_SHA256_DIGEST_SIZE, &len);
+
+    if (status != PSA_SUCCESS) {
+        (void)memset(out_digest, 0, GW_SHA256_DIGEST_SIZE);
+    }
+
+    return gw_sha256_psa_error(status);
+}
+
+static int gw_sha256_clone(gw_sha256_ctx_t *dst, const gw_sha256_ctx_t *src)
+{
+    dst->op = psa_hash_operation_init();
+    return gw_sha256_psa_error(psa_hash_clone(&src->op, &dst->op));
+}
+
+static void gw_sha256_abort(gw_sha256_ctx_t *ctx)
+{
+    (void)psa_hash_abort(&ctx->op);
+}
+
+#else
 
 static const uint32_t GW_SHA256_K[64] = {
     0x428a2f98U, 0x71374491U, 0xb5c0fbcfU, 0xe9b5dba5U,
@@ -93,9 +153,34 @@ static void write_u64_be(uint8_t *ptr, uint64_t value)
     ptr[7] = (uint8_t)value;
 }
 
-static void gw_sha256_transform(gw_sha256_ctx_t *ctx, const uint8_t block[64])
+/* Rounds are named by rotating the a..h arguments instead of shifting eight variables. */
+#define GW_SHA256_ROUND(a, b, c, d, e, f, g, h, i, W) \
+    do { \
+        uint32_t t1_ = (h) + big_sigma1(e) + ch((e), (f), (g)) + GW_SHA256_K[(i)] + W(i); \
+        (d) += t1_; \
+        (h) = t1_ + big_sigma0(a) + maj((a), (b), (c)); \
+    } while (0)
+
+#define GW_SHA256_ROUNDS8(i, W) \
+    do { \
+        GW_SHA256_ROUND(a, b, c, d, e, f, g, h, (i) + 0, W); \
+        GW_SHA256_ROUND(h, a, b, c, d, e, f, g, (i) + 1, W); \
+        GW_SHA256_ROUND(g, h, a, b, c, d, e, f, (i) + 2, W); \
+        GW_SHA256_ROUND(f, g, h, a, b, c, d, e, (i) + 3, W); \
+        GW_SHA256_ROUND(e, f, g, h, a, b, c, d, (i) + 4, W); \
+        GW_SHA256_ROUND(d, e, f, g, h, a, b, c, (i) + 5, W); \
+        GW_SHA256_ROUND(c, d, e, f, g, h, a, b, (i) + 6, W); \
+        GW_SHA256_ROUND(b, c, d, e, f, g, h, a, (i) + 7, W); \
+    } while (0)
+
+/* The message schedule is kept as a 16-word ring and expanded in place. */
+#define GW_SHA256_W_LOAD(i) (w[(i)])
+#define GW_SHA256_W_EXPAND(i) \
+    (w[(i) & 15] += small_sigma1(w[((i) - 2) & 15]) + w[((i) - 7) & 15] + small_sigma0(w[((i) - 15) & 15]))
+
+static void gw_sha256_blocks(uint32_t state[8], const uint8_t *data, size_t nblocks)
 {
-    uint32_t w[64];
+    uint32_t w[16];
     uint32_t a;
     uint32_t b;
     uint32_t c;
@@ -104,52 +189,44 @@ static void gw_sha256_transform(gw_sha256_ctx_t *ctx, const uint8_t block[64])
     uint32_t f;
     uint32_t g;
     uint32_t h;
-    uint32_t t1;
-    uint32_t t2;
     int i;
 
-    for (i = 0; i < 16; ++i) {
-        w[i] = read_u32_be(&block[i * 4]);
-    }
+    while (nblocks-- > 0U) {
+        for (i = 0; i < 16; ++i) {
+            w[i] = read_u32_be(&data[i * 4]);
+        }
 
-    for (i = 16; i < 64; ++i) {
-        w[i] = small_sigma1(w[i - 2]) + w[i - 7] + small_sigma0(w[i - 15]) + w[i - 16];
-    }
+        a = state[0];
+        b = state[1];
+        c = state[2];
+        d = state[3];
+        e = state[4];
+        f = state[5];
+        g = state[6];
+        h = state[7];
+
+        for (i = 0; i < 16; i += 8) {
+            GW_SHA256_ROUNDS8(i, GW_SHA256_W_LOAD);
+        }
 
-    a = ctx->state[0];
-    b = ctx->state[1];
-    c = ctx->state[2];
-    d = ctx->state[3];
-    e = ctx->state[4];
-    f = ctx->state[5];
-    g = ctx->state[6];
-    h = ctx->state[7];
-
-    for (i = 0; i < 64; ++i) {
-        t1 = h + big_sigma1(e) + ch(e, f, g) + GW_SHA256_K[i] + w[i];
-        t2 = big_sigma0(a) + maj(a, b, c);
-
-        h = g;
-        g = f;
-        f = e;
-        e = d + t1;
-        d = c;
-        c = b;
-        b = a;
-        a = t1 + t2;
-    }
+        for (i = 16; i < 64; i += 8) {
+            GW_SHA256_ROUNDS8(i, GW_SHA256_W_EXPAND);
+        }
+
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
 
-    ctx->state[0] += a;
-    ctx->state[1] += b;
-    ctx->state[2] += c;
-    ctx->state[3] += d;
-    ctx->state[4] += e;
-    ctx->state[5] += f;
-    ctx->state[6] += g;
-    ctx->state[7] += h;
+        data += GW_SHA256_BLOCK_SIZE;
+    }
 }
 
-static void gw_sha256_init(gw_sha256_ctx_t *ctx)
+int gw_sha256_init(gw_sha256_ctx_t *ctx)
 {
     ctx->state[0] = 0x6a09e667U;
     ctx->state[1] = 0xbb67ae85U;
@@ -161,99 +238,209 @@ static void gw_sha256_init(gw_sha256_ctx_t *ctx)
     ctx->state[7] = 0x5be0cd19U;
     ctx->bit_len = 0U;
     ctx->block_len = 0U;
+    return 0;
 }
 
-static void gw_sha256_update(gw_sha256_ctx_t *ctx, const uint8_t *data, size_t len)
+/* Whole blocks are compressed straight from the input; only the ragged ends go through ctx->block. */
+int gw_sha256_update(gw_sha256_ctx_t *ctx, const uint8_t *data, size_t len)
 {
-    size_t i;
+    size_t nblocks;
+    size_t fill;
 
     if (data == NULL || len == 0U) {
-        return;
+        return 0;
     }
 
-    for (i = 0; i < len; ++i) {
-        ctx->block[ctx->block_len++] = data[i];
-        if (ctx->block_len == 64U) {
-            gw_sha256_transform(ctx, ctx->block);
-            ctx->bit_len += 512U;
-            ctx->block_len = 0U;
+    ctx->bit_len += (uint64_t)len * 8U;
+
+    if (ctx->block_len > 0U) {
+        fill = GW_SHA256_BLOCK_SIZE - ctx->block_len;
+        if (len < fill) {
+            (void)memcpy(&ctx->block[ctx->block_len], data, len);
+            ctx->block_len += len;
+            return 0;
         }
+
+        (void)memcpy(&ctx->block[ctx->block_len], data, fill);
+        gw_sha256_blocks(ctx->state, ctx->block, 1U);
+        ctx->block_len = 0U;
+        data += fill;
+        len -= fill;
+    }
+
+    nblocks = len / GW_SHA256_BLOCK_SIZE;
+    if (nblocks > 0U) {
+        gw_sha256_blocks(ctx->state, data, nblocks);
+        data += nblocks * GW_SHA256_BLOCK_SIZE;
+        len -= nblocks * GW_SHA256_BLOCK_SIZE;
     }
+
+    if (len > 0U) {
+        (void)memcpy(ctx->block, data, len);
+        ctx->block_len = len;
+    }
+
+    return 0;
 }
 
-static void gw_sha256_final(gw_sha256_ctx_t *ctx, uint8_t out_digest[32])
+int gw_sha256_final(gw_sha256_ctx_t *ctx, uint8_t out_digest[32])
 {
     size_t i;
 
-    ctx->bit_len += (uint64_t)ctx->block_len * 8U;
-
     ctx->block[ctx->block_len++] = 0x80U;
 
     if (ctx->block_len > 56U) {
-        while (ctx->block_len < 64U) {
-            ctx->block[ctx->block_len++] = 0x00U;
-        }
-        gw_sha256_transform(ctx, ctx->block);
+        (void)memset(&ctx->block[ctx->block_len], 0, GW_SHA256_BLOCK_SIZE - ctx->block_len);
+        gw_sha256_blocks(ctx->state, ctx->block, 1U);
         ctx->block_len = 0U;
     }
 
-    while (ctx->block_len < 56U) {
-        ctx->block[ctx->block_len++] = 0x00U;
-    }
-
+    (void)memset(&ctx->block[ctx->block_len], 0, 56U - ctx->block_len);
     write_u64_be(&ctx->block[56], ctx->bit_len);
-    gw_sha256_transform(ctx, ctx->block);
+    gw_sha256_blocks(ctx->state, ctx->block, 1U);
 
     for (i = 0; i < 8U; ++i) {
         write_u32_be(&out_digest[i * 4U], ctx->state[i]);
     }
+
+    return 0;
 }
 
-void gw_sha256(const uint8_t *data, size_t len, uint8_t out_digest[32])
+static int gw_sha256_clone(gw_sha256_ctx_t *dst, const gw_sha256_ctx_t *src)
 {
-    gw_sha256_ctx_t ctx;
+    *dst = *src;
+    return 0;
+}
 
-    gw_sha256_init(&ctx);
-    gw_sha256_update(&ctx, data, len);
-    gw_sha256_final(&ctx, out_digest);
+static void gw_sha256_abort(gw_sha256_ctx_t *ctx)
+{
+    (void)memset(ctx, 0, sizeof(*ctx));
 }
 
-void gw_hmac_sha256(
-    const uint8_t *key,
-    size_t key_len,
-    const uint8_t *msg,
-    size_t msg_len,
-    uint8_t out_digest[32])
+#endif
+
+int gw_sha256(const uint8_t *data, size_t len, uint8_t out_digest[32])
 {
-    uint8_t key_block[64];
-    uint8_t inner_digest[32];
-    uint8_t ipad[64];
-    uint8_t opad[64];
     gw_sha256_ctx_t ctx;
+    int rc;
+
+    rc = gw_sha256_init(&ctx);
+    if (rc == 0) {
+        rc = gw_sha256_update(&ctx, data, len);
+    }
+    if (rc == 0) {
+        rc = gw_sha256_final(&ctx, out_digest);
+    } else {
+        gw_sha256_abort(&ctx);
+    }
+
+    return rc;
+}
+
+int gw_hmac_sha256_setkey(gw_hmac_sha256_key_t *hk, const uint8_t *key, size_t key_len)
+{
+    uint8_t key_block[GW_SHA256_BLOCK_SIZE];
+    uint8_t pad[GW_SHA256_BLOCK_SIZE];
     size_t i;
+    int rc = 0;
+
+    gw_sha256_abort(&hk->inner);
+    gw_sha256_abort(&hk->outer);
 
     (void)memset(key_block, 0, sizeof(key_block));
 
     if (key != NULL && key_len > 0U) {
         if (key_len > sizeof(key_block)) {
-            gw_sha256(key, key_len, key_block);
+            rc = gw_sha256(key, key_len, key_block);
         } else {
             (void)memcpy(key_block, key, key_len);
         }
     }
 
-    for (i = 0; i < sizeof(key_block); ++i) {
-        ipad[i] = (uint8_t)(key_block[i] ^ 0x36U);
-        opad[i] = (uint8_t)(key_block[i] ^ 0x5cU);
+    for (i = 0; i < sizeof(pad); ++i) {
+        pad[i] = (uint8_t)(key_block[i] ^ 0x36U);
+    }
+    if (rc == 0) {
+        rc = gw_sha256_init(&hk->inner);
+    }
+    if (rc == 0) {
+        rc = gw_sha256_update(&hk->inner, pad, sizeof(pad));
+    }
+
+    for (i = 0; i < sizeof(pad); ++i) {
+        pad[i] = (uint8_t)(key_block[i] ^ 0x5cU);
+    }
+    if (rc == 0) {
+        rc = gw_sha256_init(&hk->outer);
+    }
+    if (rc == 0) {
+        rc = gw_sha256_update(&hk->outer, pad, sizeof(pad));
+    }
+
+    (void)memset(key_block, 0, sizeof(key_block));
+    (void)memset(pad, 0, sizeof(pad));
+
+    if (rc != 0) {
+        gw_sha256_abort(&hk->inner);
+        gw_sha256_abort(&hk->outer);
     }
 
-    gw_sha256_init(&ctx);
-    gw_sha256_update(&ctx, ipad, sizeof(ipad));
-    gw_sha256_update(&ctx, msg, msg_len);
-    gw_sha256_final(&ctx, inner_digest);
+    return rc;
+}
+
+/* Costs two compressions fewer than gw_hmac_sha256 since the padded key blocks are already absorbed. */
+int gw_hmac_sha256_keyed(const gw_hmac_sha256_key_t *hk, const uint8_t *msg, size_t msg_len, uint8_t out_digest[32])
+{
+    uint8_t inner_digest[GW_SHA256_DIGEST_SIZE];
+    gw_sha256_ctx_t ctx;
+    int rc;
+
+    rc = gw_sha256_clone(&ctx, &hk->inner);
+    if (rc == 0) {
+        rc = gw_sha256_update(&ctx, msg, msg_len);
+    }
+    if (rc == 0) {
+        rc = gw_sha256_final(&ctx, inner_digest);
+    } else {
+        gw_sha256_abort(&ctx);
+    }
+
+    if (rc == 0) {
+        rc = gw_sha256_clone(&ctx, &hk->outer);
+        if (rc == 0) {
+            rc = gw_sha256_update(&ctx, inner_digest, sizeof(inner_digest));
+        }
+        if (rc == 0) {
+            rc = gw_sha256_final(&ctx, out_digest);
+        } else {
+            gw_sha256_abort(&ctx);
+        }
+    }
+
+    if (rc != 0) {
+        (void)memset(out_digest, 0, GW_SHA256_DIGEST_SIZE);
+    }
+
+    return rc;
+}
+
+int gw_hmac_sha256(
+    const uint8_t *key,
+    size_t key_len,
+    const uint8_t *msg,
+    size_t msg_len,
+    uint8_t out_digest[32])
+{
+    gw_hmac_sha256_key_t hk;
+    int rc;
+
+    (void)memset(&hk, 0, sizeof(hk));
+    rc = gw_hmac_sha256_setkey(&hk, key, key_len);
+    if (rc == 0) {
+        rc = gw_hmac_sha256_keyed(&hk, msg, msg_len, out_digest);
+    }
+    gw_sha256_abort(&hk.inner);
+    gw_sha256_abort(&hk.outer);
 
-    gw_sha256_init(&ctx);
-    gw_sha256_update(&ctx, opad, sizeof(opad));
-    gw_sha256_update(&ctx, inner_digest, sizeof(inner_digest));
-    gw_sha256_final(&ctx, out_digest);
+    return rc;
 }
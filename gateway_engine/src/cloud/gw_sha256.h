@@ -4,8 +4,41 @@
 #include <stddef.h>
 #include <stdint.h>
 
-void gw_sha256(const uint8_t *data, size_t len, uint8_t out_digest[32]);
-void gw_hmac_sha256(
+#if defined(CONFIG_GW_ENGINE_SHA256_PSA)
+#include <psa/crypto.h>
+#endif
+
+#define GW_SHA256_BLOCK_SIZE 64U
+#define GW_SHA256_DIGEST_SIZE 32U
+
+#if defined(CONFIG_GW_ENGINE_SHA256_PSA)
+typedef struct {
+    psa_hash_operation_t op;
+} gw_sha256_ctx_t;
+#else
+typedef struct {
+    uint32_t state[8];
+    uint64_t bit_len;
+    uint8_t block[GW_SHA256_BLOCK_SIZE];
+    size_t block_len;
+} gw_sha256_ctx_t;
+#endif
+
+/* Hash states after absorbing key^ipad and key^opad; must be zero-initialized before the first setkey. */
+typedef struct {
+    gw_sha256_ctx_t inner;
+    gw_sha256_ctx_t outer;
+} gw_hmac_sha256_key_t;
+
+/* All return 0, or a negative errno when the crypto backend fails; the digest is then unusable. */
+int gw_sha256_init(gw_sha256_ctx_t *ctx);
+int gw_sha256_update(gw_sha256_ctx_t *ctx, const uint8_t *data, size_t len);
+int gw_sha256_final(gw_sha256_ctx_t *ctx, uint8_t out_digest[32]);
+int gw_sha256(const uint8_t *data, size_t len, uint8_t out_digest[32]);
+
+int gw_hmac_sha256_setkey(gw_hmac_sha256_key_t *hk, const uint8_t *key, size_t key_len);
+int gw_hmac_sha256_keyed(const gw_hmac_sha256_key_t *hk, const uint8_t *msg, size_t msg_len, uint8_t out_digest[32]);
+int gw_hmac_sha256(
     const uint8_t *key,
     size_t key_len,
     const uint8_t *msg,
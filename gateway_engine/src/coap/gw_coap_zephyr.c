@@ -0,0 +1,693 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/net/coap.h>
+#include <zephyr/net/net_ip.h>
+#include <zephyr/net/socket.h>
+#include <zephyr/posix/fcntl.h>
+#include <zephyr/posix/poll.h>
+#include <zephyr/posix/sys/socket.h>
+#include <zephyr/posix/unistd.h>
+
+#include <gateway_engine/gw_coap.h>
+#include <gateway_engine/gw_codec.h>
+#include <gateway_engine/gw_shadow.h>
+#include <gateway_engine/ports/gw_port_clock.h>
+
+#include "../gw_time.h"
+
+#if defined(CONFIG_GW_ENGINE_COAP_MAX_OBSERVERS)
+#define GW_COAP_MAX_OBSERVERS CONFIG_GW_ENGINE_COAP_MAX_OBSERVERS
+#else
+#define GW_COAP_MAX_OBSERVERS 4
+#endif
+
+#if defined(CONFIG_GW_ENGINE_COAP_MAX_PACKET)
+#define GW_COAP_MAX_PACKET CONFIG_GW_ENGINE_COAP_MAX_PACKET
+#else
+#define GW_COAP_MAX_PACKET 1024
+#endif
+
+#if defined(CONFIG_COAP_INIT_ACK_TIMEOUT_MS)
+#define GW_COAP_ACK_TIMEOUT_MS CONFIG_COAP_INIT_ACK_TIMEOUT_MS
+#else
+#define GW_COAP_ACK_TIMEOUT_MS 2000
+#endif
+
+#if defined(CONFIG_COAP_MAX_RETRANSMIT)
+#define GW_COAP_MAX_RETRANSMIT CONFIG_COAP_MAX_RETRANSMIT
+#else
+#define GW_COAP_MAX_RETRANSMIT 4
+#endif
+
+#define GW_COAP_DEFAULT_CON_INTERVAL_MS 60000U
+#define GW_COAP_MAX_OPTIONS 8
+/* Datagrams served per poll, so a burst cannot starve the engine loop. */
+#define GW_COAP_RX_BURST 4
+#define GW_COAP_NO_OBSERVE (-1)
+
+/* Confirmable refresh of one observer (RFC 7641 section 4.5), indexed like observers[]. */
+typedef struct {
+    uint32_t due_ms;
+    uint16_t con_id;
+    uint8_t retransmits;
+    bool con_pending;
+} gw_coap_liveness_t;
+
+typedef struct {
+    gw_engine_t *engine;
+    gw_coap_config_t config;
+    int sock;
+    bool running;
+    uint32_t notified_version;
+    uint32_t notified_desired;
+    uint32_t notified_acked;
+    uint32_t last_notify_ms;
+    gw_coap_stats_t stats;
+    struct coap_observer observers[GW_COAP_MAX_OBSERVERS];
+    gw_coap_liveness_t liveness[GW_COAP_MAX_OBSERVERS];
+    uint8_t rx_buf[GW_COAP_MAX_PACKET];
+    uint8_t tx_buf[GW_COAP_MAX_PACKET];
+    uint8_t payload[GW_COAP_MAX_PACKET];
+} gw_coap_runtime_t;
+
+typedef struct {
+    const char *name;
+    size_t offset;
+} gw_coap_metric_t;
+
+#define GW_COAP_METRIC(field) { #field, offsetof(gw_engine_metrics_t, field) }
+
+/* uint32_t members of gw_engine_metrics_t; rx_error_rate_permille is written separately. */
+static const gw_coap_metric_t g_metrics[] = {
+    GW_COAP_METRIC(rx_frames),
+    GW_COAP_METRIC(rx_dropped_crc),
+    GW_COAP_METRIC(rx_dropped_proto),
+    GW_COAP_METRIC(rx_dropped_len),
+    GW_COAP_METRIC(rx_rejected),
+    GW_COAP_METRIC(ota_rejected),
+    GW_COAP_METRIC(ota_nack_failed),
+    GW_COAP_METRIC(rx_transport_errors),
+    GW_COAP_METRIC(cloud_connects),
+    GW_COAP_METRIC(cloud_connect_failures),
+    GW_COAP_METRIC(cloud_disconnects),
+    GW_COAP_METRIC(telemetry_forwarded),
+    GW_COAP_METRIC(telemetry_dropped),
+    GW_COAP_METRIC(telemetry_suppressed),
+    GW_COAP_METRIC(telemetry_summaries),
+    GW_COAP_METRIC(telemetry_batches),
+    GW_COAP_METRIC(telemetry_deferred),
+    GW_COAP_METRIC(rule_actions),
+    GW_COAP_METRIC(rule_actions_dropped),
+    GW_COAP_METRIC(shadow_documents),
+    GW_COAP_METRIC(shadow_pushes),
+    GW_COAP_METRIC(shadow_retries),
+    GW_COAP_METRIC(shadow_push_abandoned),
+    GW_COAP_METRIC(shadow_push_failed),
+    GW_COAP_METRIC(shadow_resyncs),
+    GW_COAP_METRIC(adapt_flush_ms),
+    GW_COAP_METRIC(adapt_batch_points),
+    GW_COAP_METRIC(adapt_degraded),
+    GW_COAP_METRIC(cmd_routed),
+    GW_COAP_METRIC(cmd_shadowed),
+    GW_COAP_METRIC(cmd_dropped),
+    GW_COAP_METRIC(cmd_latency_last_ms),
+    GW_COAP_METRIC(cmd_latency_avg_ms),
+    GW_COAP_METRIC(cmd_latency_max_ms),
+};
+
+static gw_coap_runtime_t g_coap = { .sock = -1 };
+
+static int gw_coap_state_get(
+    struct coap_resource *resource,
+    struct coap_packet *request,
+    struct sockaddr *addr,
+    socklen_t addr_len);
+static void gw_coap_state_notify(struct coap_resource *resource, struct coap_observer *observer);
+static int gw_coap_cmd_post(
+    struct coap_resource *resource,
+    struct coap_packet *request,
+    struct sockaddr *addr,
+    socklen_t addr_len);
+static int gw_coap_metrics_get(
+    struct coap_resource *resource,
+    struct coap_packet *request,
+    struct sockaddr *addr,
+    socklen_t addr_len);
+
+static const char *const g_state_path[] = { "edge", "state", NULL };
+static const char *const g_cmd_path[] = { "edge", "cmd", NULL };
+static const char *const g_metrics_path[] = { "metrics", NULL };
+
+static struct coap_resource g_resources[] = {
+    { .get = gw_coap_state_get, .notify = gw_coap_state_notify, .path = g_state_path },
+    { .post = gw_coap_cmd_post, .path = g_cmd_path },
+    { .get = gw_coap_metrics_get, .path = g_metrics_path },
+    { .path = NULL },
+};
+
+static int gw_coap_send(
+    const uint8_t *token,
+    uint8_t tkl,
+    uint8_t type,
+    uint16_t id,
+    uint8_t code,
+    int observe,
+    uint16_t format,
+    const uint8_t *payload,
+    size_t payload_len,
+    const struct sockaddr *addr,
+    socklen_t addr_len)
+{
+    struct coap_packet pkt;
+    int rc;
+
+    rc = coap_packet_init(&pkt, g_coap.tx_buf, sizeof(g_coap.tx_buf), COAP_VERSION_1, type, tkl, token, code, id);
+    if (rc == 0 && observe != GW_COAP_NO_OBSERVE) {
+        rc = coap_append_option_int(&pkt, COAP_OPTION_OBSERVE, (unsigned int)observe);
+    }
+    if (rc == 0 && payload_len > 0U) {
+        rc = coap_append_option_int(&pkt, COAP_OPTION_CONTENT_FORMAT, format);
+        if (rc == 0) {
+            rc = coap_packet_append_payload_marker(&pkt);
+        }
+        if (rc == 0) {
+            rc = coap_packet_append_payload(&pkt, payload, (uint16_t)payload_len);
+        }
+    }
+    if (rc != 0) {
+        g_coap.stats.tx_errors++;
+        return rc;
+    }
+
+    if (sendto(g_coap.sock, pkt.data, pkt.offset, 0, addr, addr_len) < 0) {
+        g_coap.stats.tx_errors++;
+        return -errno;
+    }
+
+    return 0;
+}
+
+/* Piggybacked ACK for confirmable requests, NON otherwise. */
+static int gw_coap_reply(
+    const struct coap_packet *request,
+    const struct sockaddr *addr,
+    socklen_t addr_len,
+    uint8_t code,
+    int observe,
+    uint16_t format,
+    const uint8_t *payload,
+    size_t payload_len)
+{
+    uint8_t token[COAP_TOKEN_MAX_LEN];
+    uint8_t tkl = coap_header_get_token(request, token);
+    bool con = coap_header_get_type(request) == COAP_TYPE_CON;
+
+    return gw_coap_send(
+        token,
+        tkl,
+        con ? COAP_TYPE_ACK : COAP_TYPE_NON_CON,
+        con ? coap_header_get_id(request) : coap_next_id(),
+        code,
+        observe,
+        format,
+        payload,
+        payload_len,
+        addr,
+        addr_len);
+}
+
+static int gw_coap_state_payload(size_t *out_len)
+{
+    gw_codec_record_t reported;
+    gw_codec_record_t desired;
+    int rc;
+
+    rc = gw_engine_get_shadow(g_coap.engine, &reported, &desired);
+    if (rc != 0) {
+        return rc;
+    }
+
+    return gw_shadow_encode(&reported, &desired, g_coap.payload, sizeof(g_coap.payload), out_len);
+}
+
+static gw_coap_liveness_t *gw_coap_liveness(const struct coap_observer *obs)
+{
+    return &g_coap.liveness[obs - g_coap.observers];
+}
+
+/* The first confirmable refresh is due one interval after (re)registration. */
+static void gw_coap_liveness_reset(const struct coap_observer *obs)
+{
+    gw_coap_liveness_t *live = gw_coap_liveness(obs);
+
+    (void)memset(live, 0, sizeof(*live));
+    live->due_ms = gw_port_clock_now_ms() + g_coap.config.con_interval_ms;
+}
+
+static int gw_coap_observe(struct coap_resource *resource, const struct coap_packet *request, const struct sockaddr *addr)
+{
+    struct coap_observer *obs;
+
+    /* A client re-registering (new token) keeps its slot. */
+    obs = coap_find_observer_by_addr(g_coap.observers, GW_COAP_MAX_OBSERVERS, addr);
+    if (obs != NULL) {
+        coap_observer_init(obs, request, addr);
+        gw_coap_liveness_reset(obs);
+        return 0;
+    }
+
+    obs = coap_observer_next_unused(g_coap.observers, GW_COAP_MAX_OBSERVERS);
+    if (obs == NULL) {
+        return -ENOMEM;
+    }
+
+    coap_observer_init(obs, request, addr);
+    gw_coap_liveness_reset(obs);
+    (void)coap_register_observer(resource, obs);
+    g_coap.stats.observers++;
+    return 0;
+}
+
+static void gw_coap_remove(struct coap_resource *resource, struct coap_observer *obs)
+{
+    (void)coap_remove_observer(resource, obs);
+    (void)memset(gw_coap_liveness(obs), 0, sizeof(gw_coap_liveness_t));
+    (void)memset(obs, 0, sizeof(*obs));
+    g_coap.stats.observers--;
+}
+
+static void gw_coap_unobserve(struct coap_resource *resource, const struct sockaddr *addr)
+{
+    struct coap_observer *obs = coap_find_observer_by_addr(g_coap.observers, GW_COAP_MAX_OBSERVERS, addr);
+
+    if (obs == NULL) {
+        return;
+    }
+
+    gw_coap_remove(resource, obs);
+}
+
+/* An ACK for the outstanding confirmable notification proves the observer is still there. */
+static void gw_coap_observer_acked(const struct sockaddr *addr, uint16_t id)
+{
+    struct coap_observer *obs = coap_find_observer_by_addr(g_coap.observers, GW_COAP_MAX_OBSERVERS, addr);
+    gw_coap_liveness_t *live;
+
+    if (obs == NULL) {
+        return;
+    }
+
+    live = gw_coap_liveness(obs);
+    if (live->con_pending && live->con_id == id) {
+        gw_coap_liveness_reset(obs);
+    }
+}
+
+static int gw_coap_state_get(
+    struct coap_resource *resource,
+    struct coap_packet *request,
+    struct sockaddr *addr,
+    socklen_t addr_len)
+{
+    int observe = GW_COAP_NO_OBSERVE;
+    size_t len = 0U;
+
+    if (gw_coap_state_payload(&len) != 0) {
+        return gw_coap_reply(
+            request, addr, addr_len, COAP_RESPONSE_CODE_SERVICE_UNAVAILABLE, GW_COAP_NO_OBSERVE, 0U, NULL, 0U);
+    }
+
+    if (coap_request_is_observe(request)) {
+        if (gw_coap_observe(resource, request, addr) == 0) {
+            observe = resource->age;
+        }
+    } else if (coap_get_option_int(request, COAP_OPTION_OBSERVE) == 1) {
+        gw_coap_unobserve(resource, addr);
+    }
+
+    return gw_coap_reply(
+        request, addr, addr_len, COAP_RESPONSE_CODE_CONTENT, observe, COAP_CONTENT_FORMAT_APP_CBOR, g_coap.payload, len);
+}
+
+static void gw_coap_notify(const struct coap_resource *resource, const struct coap_observer *observer, uint8_t type, uint16_t id)
+{
+    size_t len = 0U;
+
+    if (gw_coap_state_payload(&len) != 0) {
+        return;
+    }
+
+    if (gw_coap_send(
+            observer->token,
+            observer->tkl,
+            type,
+            id,
+            COAP_RESPONSE_CODE_CONTENT,
+            resource->age,
+            COAP_CONTENT_FORMAT_APP_CBOR,
+            g_coap.payload,
+            len,
+            &observer->addr,
+            (socklen_t)sizeof(observer->addr)) == 0) {
+        g_coap.stats.notifications++;
+    }
+}
+
+static void gw_coap_state_notify(struct coap_resource *resource, struct coap_observer *observer)
+{
+    gw_coap_notify(resource, observer, COAP_TYPE_NON_CON, coap_next_id());
+}
+
+/* A CBOR map becomes desired state when the shadow is on; anything else goes to the edge as is. */
+static int gw_coap_cmd_post(
+    struct coap_resource *resource,
+    struct coap_packet *request,
+    struct sockaddr *addr,
+    socklen_t addr_len)
+{
+    const uint8_t *payload;
+    gw_codec_record_t rec;
+    uint16_t len = 0U;
+    uint8_t code;
+    int rc;
+
+    (void)resource;
+
+    if (!g_coap.engine->running) {
+        return gw_coap_reply(
+            request, addr, addr_len, COAP_RESPONSE_CODE_SERVICE_UNAVAILABLE, GW_COAP_NO_OBSERVE, 0U, NULL, 0U);
+    }
+
+    payload = coap_packet_get_payload(request, &len);
+    if (payload == NULL || len == 0U) {
+        g_coap.stats.bad_requests++;
+        return gw_coap_reply(request, addr, addr_len, COAP_RESPONSE_CODE_BAD_REQUEST, GW_COAP_NO_OBSERVE, 0U, NULL, 0U);
+    }
+
+    if (gw_shadow_enabled(&g_coap.engine->shadow) &&
+        gw_codec_detect(payload, len) == GW_CODEC_FORMAT_CBOR && gw_codec_decode_cbor(payload, len, &rec) == 0) {
+        rc = gw_engine_set_desired(g_coap.engine, &rec);
+    } else {
+        rc = gw_engine_send(g_coap.engine, GW_LINK_CMD_CONTROL, payload, len);
+    }
+
+    if (rc == 0) {
+        g_coap.stats.commands++;
+        code = COAP_RESPONSE_CODE_CHANGED;
+    } else if (rc == -EINVAL || rc == -ENOSPC || rc == -EMSGSIZE) {
+        g_coap.stats.bad_requests++;
+        code = COAP_RESPONSE_CODE_BAD_REQUEST;
+    } else {
+        code = COAP_RESPONSE_CODE_SERVICE_UNAVAILABLE;
+    }
+
+    return gw_coap_reply(request, addr, addr_len, code, GW_COAP_NO_OBSERVE, 0U, NULL, 0U);
+}
+
+static int gw_coap_metrics_get(
+    struct coap_resource *resource,
+    struct coap_packet *request,
+    struct sockaddr *addr,
+    socklen_t addr_len)
+{
+    gw_engine_metrics_t m;
+    size_t pos;
+    size_t i;
+    int n;
+
+    (void)resource;
+
+    if (gw_engine_get_metrics(g_coap.engine, &m) != 0) {
+        return gw_coap_reply(
+            request, addr, addr_len, COAP_RESPONSE_CODE_SERVICE_UNAVAILABLE, GW_COAP_NO_OBSERVE, 0U, NULL, 0U);
+    }
+
+    n = snprintf(
+        (char *)g_coap.payload,
+        sizeof(g_coap.payload),
+        "{\"rx_error_rate_permille\":%u",
+        (unsigned int)m.rx_error_rate_permille);
+    pos = (n > 0) ? (size_t)n : 0U;
+
+    for (i = 0U; i < ARRAY_SIZE(g_metrics) && pos < sizeof(g_coap.payload); ++i) {
+        uint32_t value;
+
+        (void)memcpy(&value, (const uint8_t *)&m + g_metrics[i].offset, sizeof(value));
+        n = snprintf(
+            (char *)&g_coap.payload[pos],
+            sizeof(g_coap.payload) - pos,
+            ",\"%s\":%lu",
+            g_metrics[i].name,
+            (unsigned long)value);
+        pos += (n > 0) ? (size_t)n : 0U;
+    }
+
+    if (pos + 1U >= sizeof(g_coap.payload)) {
+        return gw_coap_reply(
+            request, addr, addr_len, COAP_RESPONSE_CODE_INTERNAL_ERROR, GW_COAP_NO_OBSERVE, 0U, NULL, 0U);
+    }
+
+    g_coap.payload[pos++] = '}';
+
+    return gw_coap_reply(
+        request, addr, addr_len, COAP_RESPONSE_CODE_CONTENT, GW_COAP_NO_OBSERVE, COAP_CONTENT_FORMAT_APP_JSON,
+        g_coap.payload, pos);
+}
+
+static void gw_coap_handle(size_t len, struct sockaddr *addr, socklen_t addr_len)
+{
+    struct coap_option options[GW_COAP_MAX_OPTIONS];
+    struct coap_packet request;
+    uint8_t type;
+    int rc;
+
+    g_coap.stats.requests++;
+
+    rc = coap_packet_parse(&request, g_coap.rx_buf, (uint16_t)len, options, GW_COAP_MAX_OPTIONS);
+    if (rc < 0) {
+        g_coap.stats.bad_requests++;
+        return;
+    }
+
+    type = coap_header_get_type(&request);
+
+    /* A reset answering a notification cancels that observation. */
+    if (type == COAP_TYPE_RESET) {
+        gw_coap_unobserve(&g_resources[0], addr);
+        return;
+    }
+
+    if (type == COAP_TYPE_ACK) {
+        gw_coap_observer_acked(addr, coap_header_get_id(&request));
+        return;
+    }
+
+    rc = coap_handle_request(&request, g_resources, options, GW_COAP_MAX_OPTIONS, addr, addr_len);
+    if (rc == -ENOENT) {
+        (void)gw_coap_reply(&request, addr, addr_len, COAP_RESPONSE_CODE_NOT_FOUND, GW_COAP_NO_OBSERVE, 0U, NULL, 0U);
+    } else if (rc == -ENOTSUP || rc == -EPERM) {
+        (void)gw_coap_reply(
+            &request, addr, addr_len, COAP_RESPONSE_CODE_NOT_ALLOWED, GW_COAP_NO_OBSERVE, 0U, NULL, 0U);
+    }
+}
+
+/* Observers hear about every shadow change, coalesced to one notification per notify_min_ms. */
+static void gw_coap_check_state(uint32_t now_ms)
+{
+    const gw_shadow_t *shadow = &g_coap.engine->shadow;
+
+    if (!gw_shadow_enabled(shadow) || g_coap.stats.observers == 0U) {
+        return;
+    }
+
+    if (shadow->version == g_coap.notified_version && shadow->desired_version == g_coap.notified_desired &&
+        shadow->acked_version == g_coap.notified_acked) {
+        return;
+    }
+
+    if (!gw_deadline_reached(now_ms, g_coap.last_notify_ms + g_coap.config.notify_min_ms)) {
+        return;
+    }
+
+    g_coap.notified_version = shadow->version;
+    g_coap.notified_desired = shadow->desired_version;
+    g_coap.notified_acked = shadow->acked_version;
+    g_coap.last_notify_ms = now_ms;
+    (void)coap_resource_notify(&g_resources[0]);
+}
+
+/*
+ * Change notifications are NON, so an observer that went away without a RST
+ * would hold its slot forever. Every con_interval_ms each observer gets the
+ * current state as CON; it is retransmitted with the usual CoAP backoff and
+ * the observer is dropped when no ACK arrives.
+ */
+static void gw_coap_check_observers(uint32_t now_ms)
+{
+    struct coap_resource *resource = &g_resources[0];
+    size_t i;
+
+    for (i = 0U; i < GW_COAP_MAX_OBSERVERS; ++i) {
+        struct coap_observer *obs = &g_coap.observers[i];
+        gw_coap_liveness_t *live = &g_coap.liveness[i];
+
+        if (obs->addr.sa_family == 0 || !gw_deadline_reached(now_ms, live->due_ms)) {
+            continue;
+        }
+
+        if (!live->con_pending) {
+            live->con_pending = true;
+            live->con_id = coap_next_id();
+            live->retransmits = 0U;
+        } else if (live->retransmits >= GW_COAP_MAX_RETRANSMIT) {
+            gw_coap_remove(resource, obs);
+            g_coap.stats.observers_evicted++;
+            continue;
+        } else {
+            live->retransmits++;
+            g_coap.stats.con_retransmits++;
+        }
+
+        /* Same message id on every retransmission, so the client ACKs duplicates. */
+        gw_coap_notify(resource, obs, COAP_TYPE_CON, live->con_id);
+        live->due_ms = now_ms + ((uint32_t)GW_COAP_ACK_TIMEOUT_MS << live->retransmits);
+    }
+}
+
+int gw_coap_start(gw_engine_t *engine, const gw_coap_config_t *cfg)
+{
+    struct sockaddr_in addr;
+    size_t i;
+    int flags;
+    int sock;
+
+    if (engine == NULL || cfg == NULL || cfg->port == 0U) {
+        return -EINVAL;
+    }
+
+    if (g_coap.running) {
+        return -EALREADY;
+    }
+
+    sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock < 0) {
+        return -errno;
+    }
+
+    (void)memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(cfg->port);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        int err = -errno;
+
+        close(sock);
+        return err;
+    }
+
+    flags = fcntl(sock, F_GETFL, 0);
+    if (flags < 0 || fcntl(sock, F_SETFL, flags | O_NONBLOCK) < 0) {
+        int err = -errno;
+
+        close(sock);
+        return err;
+    }
+
+    (void)memset(&g_coap, 0, sizeof(g_coap));
+    for (i = 0U; g_resources[i].path != NULL; ++i) {
+        sys_slist_init(&g_resources[i].observers);
+        g_resources[i].age = 0;
+    }
+
+    g_coap.engine = engine;
+    g_coap.config = *cfg;
+    if (g_coap.config.con_interval_ms == 0U) {
+        g_coap.config.con_interval_ms = GW_COAP_DEFAULT_CON_INTERVAL_MS;
+    }
+    g_coap.sock = sock;
+    g_coap.notified_version = engine->shadow.version;
+    g_coap.notified_desired = engine->shadow.desired_version;
+    g_coap.notified_acked = engine->shadow.acked_version;
+    g_coap.running = true;
+    return 0;
+}
+
+int gw_coap_poll(void)
+{
+    uint32_t now_ms;
+    size_t n;
+
+    if (!g_coap.running) {
+        return -EINVAL;
+    }
+
+    for (n = 0U; n < GW_COAP_RX_BURST; ++n) {
+        struct sockaddr addr;
+        socklen_t addr_len = sizeof(addr);
+        ssize_t len;
+
+        len = recvfrom(g_coap.sock, g_coap.rx_buf, sizeof(g_coap.rx_buf), 0, &addr, &addr_len);
+        if (len < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            return -errno;
+        }
+
+        gw_coap_handle((size_t)len, &addr, addr_len);
+    }
+
+    now_ms = gw_port_clock_now_ms();
+    gw_coap_check_state(now_ms);
+    gw_coap_check_observers(now_ms);
+    return 0;
+}
+
+int gw_coap_wait(uint32_t timeout_ms)
+{
+    struct pollfd pfd;
+    int rc;
+
+    if (!g_coap.running) {
+        return -EINVAL;
+    }
+
+    pfd.fd = g_coap.sock;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+
+    rc = poll(&pfd, 1, (int)MIN(timeout_ms, (uint32_t)INT32_MAX));
+    if (rc < 0) {
+        return -errno;
+    }
+
+    return (rc > 0) ? 1 : 0;
+}
+
+void gw_coap_stop(void)
+{
+    if (!g_coap.running) {
+        return;
+    }
+
+    close(g_coap.sock);
+    g_coap.sock = -1;
+    g_coap.running = false;
+}
+
+int gw_coap_get_stats(gw_coap_stats_t *out_stats)
+{
+    if (out_stats == NULL) {
+        return -EINVAL;
+    }
+
+    *out_stats = g_coap.stats;
+    return 0;
+}
@@ -0,0 +1,500 @@
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <gateway_engine/gw_codec.h>
+#include <gateway_engine/gw_gorilla.h>
+
+#define CBOR_MAJOR_UINT 0U
+#define CBOR_MAJOR_NINT 1U
+#define CBOR_MAJOR_ARRAY 4U
+#define CBOR_MAJOR_MAP 5U
+#define CBOR_MAJOR_SIMPLE 7U
+
+#define CBOR_FALSE 0xF4U
+#define CBOR_TRUE 0xF5U
+#define CBOR_FLOAT32 0xFAU
+
+typedef struct {
+    uint8_t *buf;
+    size_t cap;
+    size_t len;
+} cbor_writer_t;
+
+typedef struct {
+    const uint8_t *buf;
+    size_t len;
+    size_t pos;
+} cbor_reader_t;
+
+static int cbor_put(cbor_writer_t *w, const uint8_t *data, size_t len)
+{
+    if (w->cap - w->len < len) {
+        return -ENOSPC;
+    }
+
+    (void)memcpy(&w->buf[w->len], data, len);
+    w->len += len;
+    return 0;
+}
+
+/* Writes a major type with the shortest argument encoding. */
+static int cbor_put_head(cbor_writer_t *w, uint8_t major, uint32_t arg)
+{
+    uint8_t head[5];
+    size_t len;
+
+    if (arg < 24U) {
+        head[0] = (uint8_t)((major << 5) | arg);
+        len = 1U;
+    } else if (arg <= 0xFFU) {
+        head[0] = (uint8_t)((major << 5) | 24U);
+        head[1] = (uint8_t)arg;
+        len = 2U;
+    } else if (arg <= 0xFFFFU) {
+        head[0] = (uint8_t)((major << 5) | 25U);
+        head[1] = (uint8_t)(arg >> 8);
+        head[2] = (uint8_t)arg;
+        len = 3U;
+    } else {
+        head[0] = (uint8_t)((major << 5) | 26U);
+        head[1] = (uint8_t)(arg >> 24);
+        head[2] = (uint8_t)(arg >> 16);
+        head[3] = (uint8_t)(arg >> 8);
+        head[4] = (uint8_t)arg;
+        len = 5U;
+    }
+
+    return cbor_put(w, head, len);
+}
+
+static int cbor_put_float(cbor_writer_t *w, float value)
+{
+    uint8_t out[5];
+    uint32_t bits;
+
+    (void)memcpy(&bits, &value, sizeof(bits));
+    out[0] = CBOR_FLOAT32;
+    out[1] = (uint8_t)(bits >> 24);
+    out[2] = (uint8_t)(bits >> 16);
+    out[3] = (uint8_t)(bits >> 8);
+    out[4] = (uint8_t)bits;
+
+    return cbor_put(w, out, sizeof(out));
+}
+
+static int cbor_get_u8(cbor_reader_t *r, uint8_t *out)
+{
+    if (r->pos >= r->len) {
+        return -EBADMSG;
+    }
+
+    *out = r->buf[r->pos++];
+    return 0;
+}
+
+static int cbor_get_be(cbor_reader_t *r, size_t n, uint64_t *out)
+{
+    uint64_t v = 0U;
+    size_t i;
+
+    if (r->len - r->pos < n) {
+        return -EBADMSG;
+    }
+
+    for (i = 0U; i < n; ++i) {
+        v = (v << 8) | r->buf[r->pos + i];
+    }
+
+    r->pos += n;
+    *out = v;
+    return 0;
+}
+
+/* Reads a head; *minor keeps the additional-info bits for simple/float values. */
+static int cbor_get_head(cbor_reader_t *r, uint8_t *major, uint8_t *minor, uint64_t *arg)
+{
+    uint8_t b;
+    int rc;
+
+    rc = cbor_get_u8(r, &b);
+    if (rc != 0) {
+        return rc;
+    }
+
+    *major = (uint8_t)(b >> 5);
+    *minor = (uint8_t)(b & 0x1FU);
+
+    if (*minor < 24U) {
+        *arg = *minor;
+        return 0;
+    }
+
+    switch (*minor) {
+    case 24U:
+        return cbor_get_be(r, 1U, arg);
+    case 25U:
+        return cbor_get_be(r, 2U, arg);
+    case 26U:
+        return cbor_get_be(r, 4U, arg);
+    case 27U:
+        return cbor_get_be(r, 8U, arg);
+    default:
+        /* Indefinite lengths are not produced by this codec. */
+        return -ENOTSUP;
+    }
+}
+
+static float half_to_float(uint16_t h)
+{
+    uint32_t sign = (uint32_t)(h & 0x8000U) << 16;
+    uint32_t exp = (h >> 10) & 0x1FU;
+    uint32_t mant = h & 0x3FFU;
+    uint32_t bits;
+    float f;
+
+    if (exp == 0U) {
+        /* Subnormal (or zero): value = mant * 2^-24. */
+        f = (float)mant / 16777216.0f;
+        return (sign != 0U) ? -f : f;
+    }
+
+    if (exp == 0x1FU) {
+        bits = sign | 0x7F800000U | (mant << 13);
+    } else {
+        bits = sign | ((exp + 112U) << 23) | (mant << 13);
+    }
+
+    (void)memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+static int record_add(gw_codec_record_t *rec, uint16_t id, gw_codec_value_type_t type, gw_codec_field_t **out)
+{
+    if (rec == NULL) {
+        return -EINVAL;
+    }
+
+    if (rec->count >= GW_CODEC_MAX_FIELDS) {
+        return -ENOSPC;
+    }
+
+    *out = &rec->fields[rec->count++];
+    (*out)->id = id;
+    (*out)->type = type;
+    return 0;
+}
+
+void gw_codec_record_init(gw_codec_record_t *rec)
+{
+    if (rec != NULL) {
+        rec->count = 0U;
+    }
+}
+
+int gw_codec_record_add_uint(gw_codec_record_t *rec, uint16_t id, uint32_t value)
+{
+    gw_codec_field_t *f;
+    int rc = record_add(rec, id, GW_CODEC_VALUE_UINT, &f);
+
+    if (rc == 0) {
+        f->value.u = value;
+    }
+    return rc;
+}
+
+int gw_codec_record_add_int(gw_codec_record_t *rec, uint16_t id, int32_t value)
+{
+    gw_codec_field_t *f;
+    int rc = record_add(rec, id, GW_CODEC_VALUE_INT, &f);
+
+    if (rc == 0) {
+        f->value.i = value;
+    }
+    return rc;
+}
+
+int gw_codec_record_add_float(gw_codec_record_t *rec, uint16_t id, float value)
+{
+    gw_codec_field_t *f;
+    int rc = record_add(rec, id, GW_CODEC_VALUE_FLOAT, &f);
+
+    if (rc == 0) {
+        f->value.f = value;
+    }
+    return rc;
+}
+
+int gw_codec_record_add_bool(gw_codec_record_t *rec, uint16_t id, bool value)
+{
+    gw_codec_field_t *f;
+    int rc = record_add(rec, id, GW_CODEC_VALUE_BOOL, &f);
+
+    if (rc == 0) {
+        f->value.b = value;
+    }
+    return rc;
+}
+
+static int cbor_put_value(cbor_writer_t *w, const gw_codec_field_t *f)
+{
+    uint8_t b;
+
+    switch (f->type) {
+    case GW_CODEC_VALUE_UINT:
+        return cbor_put_head(w, CBOR_MAJOR_UINT, f->value.u);
+    case GW_CODEC_VALUE_INT:
+        if (f->value.i >= 0) {
+            return cbor_put_head(w, CBOR_MAJOR_UINT, (uint32_t)f->value.i);
+        }
+        return cbor_put_head(w, CBOR_MAJOR_NINT, (uint32_t)(-(f->value.i + 1)));
+    case GW_CODEC_VALUE_FLOAT:
+        return cbor_put_float(w, f->value.f);
+    case GW_CODEC_VALUE_BOOL:
+        b = f->value.b ? CBOR_TRUE : CBOR_FALSE;
+        return cbor_put(w, &b, 1U);
+    default:
+        return -EINVAL;
+    }
+}
+
+float gw_codec_field_as_float(const gw_codec_field_t *field)
+{
+    switch (field->type) {
+    case GW_CODEC_VALUE_UINT:
+        return (float)field->value.u;
+    case GW_CODEC_VALUE_INT:
+        return (float)field->value.i;
+    case GW_CODEC_VALUE_FLOAT:
+        return field->value.f;
+    case GW_CODEC_VALUE_BOOL:
+    default:
+        return field->value.b ? 1.0f : 0.0f;
+    }
+}
+
+int gw_codec_encode_cbor(const gw_codec_record_t *rec, uint8_t *out_buf, size_t out_cap, size_t *out_len)
+{
+    cbor_writer_t w;
+    size_t i;
+    int rc;
+
+    if (rec == NULL || out_buf == NULL || out_len == NULL || rec->count > GW_CODEC_MAX_FIELDS) {
+        return -EINVAL;
+    }
+
+    w.buf = out_buf;
+    w.cap = out_cap;
+    w.len = 0U;
+
+    rc = cbor_put_head(&w, CBOR_MAJOR_MAP, rec->count);
+
+    for (i = 0U; rc == 0 && i < rec->count; ++i) {
+        const gw_codec_field_t *f = &rec->fields[i];
+
+        rc = cbor_put_head(&w, CBOR_MAJOR_UINT, f->id);
+        if (rc == 0) {
+            rc = cbor_put_value(&w, f);
+        }
+    }
+
+    if (rc != 0) {
+        return rc;
+    }
+
+    *out_len = w.len;
+    return 0;
+}
+
+int gw_codec_decode_cbor(const uint8_t *buf, size_t len, gw_codec_record_t *out_rec)
+{
+    cbor_reader_t r;
+    uint8_t major;
+    uint8_t minor;
+    uint64_t arg;
+    uint64_t count;
+    uint64_t i;
+    int rc;
+
+    if (buf == NULL || out_rec == NULL) {
+        return -EINVAL;
+    }
+
+    r.buf = buf;
+    r.len = len;
+    r.pos = 0U;
+    out_rec->count = 0U;
+
+    rc = cbor_get_head(&r, &major, &minor, &count);
+    if (rc != 0) {
+        return rc;
+    }
+    if (major != CBOR_MAJOR_MAP) {
+        return -EBADMSG;
+    }
+    if (count > GW_CODEC_MAX_FIELDS) {
+        return -ENOSPC;
+    }
+
+    for (i = 0U; i < count; ++i) {
+        gw_codec_field_t *f = &out_rec->fields[i];
+
+        rc = cbor_get_head(&r, &major, &minor, &arg);
+        if (rc != 0) {
+            return rc;
+        }
+        if (major != CBOR_MAJOR_UINT || arg > 0xFFFFU) {
+            return -EBADMSG;
+        }
+        f->id = (uint16_t)arg;
+
+        rc = cbor_get_head(&r, &major, &minor, &arg);
+        if (rc != 0) {
+            return rc;
+        }
+
+        if (major == CBOR_MAJOR_UINT) {
+            if (arg > 0xFFFFFFFFU) {
+                return -ERANGE;
+            }
+            f->type = GW_CODEC_VALUE_UINT;
+            f->value.u = (uint32_t)arg;
+        } else if (major == CBOR_MAJOR_NINT) {
+            if (arg > 0x7FFFFFFFU) {
+                return -ERANGE;
+            }
+            f->type = GW_CODEC_VALUE_INT;
+            f->value.i = -1 - (int32_t)arg;
+        } else if (major == CBOR_MAJOR_SIMPLE && (minor == 20U || minor == 21U)) {
+            f->type = GW_CODEC_VALUE_BOOL;
+            f->value.b = (minor == 21U);
+        } else if (major == CBOR_MAJOR_SIMPLE && minor >= 25U && minor <= 27U) {
+            f->type = GW_CODEC_VALUE_FLOAT;
+            if (minor == 25U) {
+                f->value.f = half_to_float((uint16_t)arg);
+            } else if (minor == 26U) {
+                uint32_t bits = (uint32_t)arg;
+
+                (void)memcpy(&f->value.f, &bits, sizeof(bits));
+            } else {
+                double d;
+
+                (void)memcpy(&d, &arg, sizeof(d));
+                f->value.f = (float)d;
+            }
+        } else {
+            return -ENOTSUP;
+        }
+    }
+
+    if (r.pos != r.len) {
+        return -EBADMSG;
+    }
+
+    out_rec->count = (uint8_t)count;
+    return 0;
+}
+
+void gw_codec_batch_init(gw_codec_batch_t *batch)
+{
+    if (batch != NULL) {
+        batch->count = 0U;
+    }
+}
+
+int gw_codec_batch_add(gw_codec_batch_t *batch, uint32_t ts_ms, const gw_codec_record_t *rec)
+{
+    size_t i;
+
+    if (batch == NULL || rec == NULL) {
+        return -EINVAL;
+    }
+
+    if ((size_t)batch->count + rec->count > GW_CODEC_BATCH_MAX_POINTS) {
+        return -ENOSPC;
+    }
+
+    for (i = 0U; i < rec->count; ++i) {
+        gw_codec_point_t *p = &batch->points[batch->count++];
+
+        p->ts_ms = ts_ms;
+        p->field = rec->fields[i];
+    }
+
+    return 0;
+}
+
+static int encode_batch_cbor(const gw_codec_batch_t *batch, uint8_t *out_buf, size_t out_cap, size_t *out_len)
+{
+    cbor_writer_t w;
+    size_t i;
+    int rc;
+
+    w.buf = out_buf;
+    w.cap = out_cap;
+    w.len = 0U;
+
+    rc = cbor_put_head(&w, CBOR_MAJOR_ARRAY, batch->count);
+
+    for (i = 0U; rc == 0 && i < batch->count; ++i) {
+        const gw_codec_point_t *p = &batch->points[i];
+
+        rc = cbor_put_head(&w, CBOR_MAJOR_ARRAY, 3U);
+        if (rc == 0) {
+            rc = cbor_put_head(&w, CBOR_MAJOR_UINT, p->ts_ms);
+        }
+        if (rc == 0) {
+            rc = cbor_put_head(&w, CBOR_MAJOR_UINT, p->field.id);
+        }
+        if (rc == 0) {
+            rc = cbor_put_value(&w, &p->field);
+        }
+    }
+
+    if (rc != 0) {
+        return rc;
+    }
+
+    *out_len = w.len;
+    return 0;
+}
+
+int gw_codec_encode_batch(
+    const gw_codec_batch_t *batch,
+    gw_codec_format_t format,
+    uint8_t *out_buf,
+    size_t out_cap,
+    size_t *out_len)
+{
+    if (batch == NULL || out_buf == NULL || out_len == NULL) {
+        return -EINVAL;
+    }
+
+    switch (format) {
+    case GW_CODEC_FORMAT_CBOR:
+        return encode_batch_cbor(batch, out_buf, out_cap, out_len);
+    case GW_CODEC_FORMAT_GORILLA:
+        return gw_gorilla_encode_batch(batch, out_buf, out_cap, out_len);
+    case GW_CODEC_FORMAT_JSON:
+    default:
+        return -ENOTSUP;
+    }
+}
+
+gw_codec_format_t gw_codec_detect(const uint8_t *payload, size_t payload_len)
+{
+    if (payload == NULL || payload_len == 0U) {
+        return GW_CODEC_FORMAT_JSON;
+    }
+
+    if (payload[0] >= 0x80U && payload[0] < 0xC0U) {
+        return GW_CODEC_FORMAT_CBOR;
+    }
+
+    if (payload[0] == GW_GORILLA_MAGIC) {
+        return GW_CODEC_FORMAT_GORILLA;
+    }
+
+    return GW_CODEC_FORMAT_JSON;
+}
@@ -0,0 +1,469 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <gateway_engine/gw_gorilla.h>
+
+#define GORILLA_HEADER_SIZE 3U
+#define GORILLA_SERIES_HEADER_SIZE 6U
+#define GORILLA_NO_WINDOW 0xFFU
+
+typedef struct {
+    uint8_t *buf;
+    size_t cap;
+    size_t bits;
+} bit_writer_t;
+
+typedef struct {
+    const uint8_t *buf;
+    size_t len;
+    size_t bits;
+} bit_reader_t;
+
+typedef struct {
+    bool started;
+    uint32_t ts;
+    uint32_t delta;
+    uint32_t value;
+    uint8_t lead;
+    uint8_t trail;
+} series_state_t;
+
+/* MSB first; the buffer is zeroed up front so only set bits are written. */
+static int bits_put(bit_writer_t *w, uint32_t value, uint8_t nbits)
+{
+    if (w->bits + nbits > w->cap * 8U) {
+        return -ENOSPC;
+    }
+
+    while (nbits > 0U) {
+        nbits--;
+        if (((value >> nbits) & 1U) != 0U) {
+            w->buf[w->bits >> 3] |= (uint8_t)(0x80U >> (w->bits & 7U));
+        }
+        w->bits++;
+    }
+
+    return 0;
+}
+
+static int bits_get(bit_reader_t *r, uint8_t nbits, uint32_t *out)
+{
+    uint32_t value = 0U;
+
+    if (r->bits + nbits > r->len * 8U) {
+        return -EBADMSG;
+    }
+
+    while (nbits > 0U) {
+        value = (value << 1) | ((r->buf[r->bits >> 3] >> (7U - (r->bits & 7U))) & 1U);
+        r->bits++;
+        nbits--;
+    }
+
+    *out = value;
+    return 0;
+}
+
+static uint8_t leading_zeros(uint32_t x)
+{
+    uint8_t n = 0U;
+
+    while (n < 32U && (x & 0x80000000U) == 0U) {
+        x <<= 1;
+        n++;
+    }
+
+    return n;
+}
+
+static uint8_t trailing_zeros(uint32_t x)
+{
+    uint8_t n = 0U;
+
+    while (n < 32U && (x & 1U) == 0U) {
+        x >>= 1;
+        n++;
+    }
+
+    return n;
+}
+
+static void put_u16_be(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)v;
+}
+
+static uint16_t get_u16_be(const uint8_t *p)
+{
+    return (uint16_t)(((uint16_t)p[0] << 8) | p[1]);
+}
+
+static int put_timestamp(bit_writer_t *w, series_state_t *s, uint32_t ts)
+{
+    uint32_t delta = ts - s->ts;
+    int32_t dod = (int32_t)(delta - s->delta);
+    int rc;
+
+    if (dod == 0) {
+        rc = bits_put(w, 0x0U, 1U);
+    } else if (dod >= -63 && dod <= 64) {
+        rc = bits_put(w, 0x2U, 2U);
+        if (rc == 0) {
+            rc = bits_put(w, (uint32_t)(dod + 63), 7U);
+        }
+    } else if (dod >= -255 && dod <= 256) {
+        rc = bits_put(w, 0x6U, 3U);
+        if (rc == 0) {
+            rc = bits_put(w, (uint32_t)(dod + 255), 9U);
+        }
+    } else if (dod >= -2047 && dod <= 2048) {
+        rc = bits_put(w, 0xEU, 4U);
+        if (rc == 0) {
+            rc = bits_put(w, (uint32_t)(dod + 2047), 12U);
+        }
+    } else {
+        rc = bits_put(w, 0xFU, 4U);
+        if (rc == 0) {
+            rc = bits_put(w, (uint32_t)dod, 32U);
+        }
+    }
+
+    s->delta = delta;
+    s->ts = ts;
+    return rc;
+}
+
+static int put_value(bit_writer_t *w, series_state_t *s, uint32_t value)
+{
+    uint32_t x = value ^ s->value;
+    uint8_t lead;
+    uint8_t trail;
+    uint8_t len;
+    int rc;
+
+    s->value = value;
+
+    if (x == 0U) {
+        return bits_put(w, 0x0U, 1U);
+    }
+
+    lead = leading_zeros(x);
+    trail = trailing_zeros(x);
+    if (lead > 31U) {
+        lead = 31U;
+    }
+
+    if (s->lead != GORILLA_NO_WINDOW && lead >= s->lead && trail >= s->trail) {
+        len = (uint8_t)(32U - s->lead - s->trail);
+        rc = bits_put(w, 0x2U, 2U);
+        if (rc == 0) {
+            rc = bits_put(w, x >> s->trail, len);
+        }
+        return rc;
+    }
+
+    len = (uint8_t)(32U - lead - trail);
+    rc = bits_put(w, 0x3U, 2U);
+    if (rc == 0) {
+        rc = bits_put(w, lead, 5U);
+    }
+    if (rc == 0) {
+        rc = bits_put(w, len, 6U);
+    }
+    if (rc == 0) {
+        rc = bits_put(w, x >> trail, len);
+    }
+
+    s->lead = lead;
+    s->trail = trail;
+    return rc;
+}
+
+static int encode_series(bit_writer_t *w, const gw_codec_batch_t *batch, uint16_t id, uint16_t *out_points)
+{
+    series_state_t s;
+    uint16_t points = 0U;
+    size_t i;
+    int rc = 0;
+
+    (void)memset(&s, 0, sizeof(s));
+    s.lead = GORILLA_NO_WINDOW;
+
+    for (i = 0U; rc == 0 && i < batch->count; ++i) {
+        const gw_codec_point_t *p = &batch->points[i];
+        float value;
+        uint32_t bits;
+
+        if (p->field.id != id) {
+            continue;
+        }
+
+        value = gw_codec_field_as_float(&p->field);
+        (void)memcpy(&bits, &value, sizeof(bits));
+        points++;
+
+        if (!s.started) {
+            s.started = true;
+            s.ts = p->ts_ms;
+            s.value = bits;
+            rc = bits_put(w, p->ts_ms, 32U);
+            if (rc == 0) {
+                rc = bits_put(w, bits, 32U);
+            }
+            continue;
+        }
+
+        rc = put_timestamp(w, &s, p->ts_ms);
+        if (rc == 0) {
+            rc = put_value(w, &s, bits);
+        }
+    }
+
+    *out_points = points;
+    return rc;
+}
+
+static bool id_seen_before(const gw_codec_batch_t *batch, size_t index)
+{
+    size_t i;
+
+    for (i = 0U; i < index; ++i) {
+        if (batch->points[i].field.id == batch->points[index].field.id) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+int gw_gorilla_encode_batch(const gw_codec_batch_t *batch, uint8_t *out_buf, size_t out_cap, size_t *out_len)
+{
+    size_t pos = GORILLA_HEADER_SIZE;
+    uint8_t series = 0U;
+    size_t i;
+    int rc;
+
+    if (batch == NULL || out_buf == NULL || out_len == NULL) {
+        return -EINVAL;
+    }
+
+    if (out_cap < GORILLA_HEADER_SIZE) {
+        return -ENOSPC;
+    }
+
+    (void)memset(out_buf, 0, out_cap);
+    out_buf[0] = GW_GORILLA_MAGIC;
+    out_buf[1] = GW_GORILLA_VERSION;
+
+    for (i = 0U; i < batch->count; ++i) {
+        bit_writer_t w;
+        uint16_t points = 0U;
+        size_t stream_len;
+
+        if (id_seen_before(batch, i)) {
+            continue;
+        }
+
+        if (series == UINT8_MAX || out_cap - pos < GORILLA_SERIES_HEADER_SIZE) {
+            return -ENOSPC;
+        }
+
+        w.buf = &out_buf[pos + GORILLA_SERIES_HEADER_SIZE];
+        w.cap = out_cap - pos - GORILLA_SERIES_HEADER_SIZE;
+        w.bits = 0U;
+
+        rc = encode_series(&w, batch, batch->points[i].field.id, &points);
+        if (rc != 0) {
+            return rc;
+        }
+
+        stream_len = (w.bits + 7U) / 8U;
+        put_u16_be(&out_buf[pos], batch->points[i].field.id);
+        put_u16_be(&out_buf[pos + 2U], points);
+        put_u16_be(&out_buf[pos + 4U], (uint16_t)stream_len);
+        pos += GORILLA_SERIES_HEADER_SIZE + stream_len;
+        series++;
+    }
+
+    out_buf[2] = series;
+    *out_len = pos;
+    return 0;
+}
+
+static int get_timestamp(bit_reader_t *r, series_state_t *s, uint32_t *out_ts)
+{
+    uint32_t bit;
+    uint32_t raw;
+    int32_t dod = 0;
+    int rc;
+
+    rc = bits_get(r, 1U, &bit);
+    if (rc == 0 && bit != 0U) {
+        rc = bits_get(r, 1U, &bit);
+        if (rc == 0 && bit == 0U) {
+            rc = bits_get(r, 7U, &raw);
+            dod = (int32_t)raw - 63;
+        } else if (rc == 0) {
+            rc = bits_get(r, 1U, &bit);
+            if (rc == 0 && bit == 0U) {
+                rc = bits_get(r, 9U, &raw);
+                dod = (int32_t)raw - 255;
+            } else if (rc == 0) {
+                rc = bits_get(r, 1U, &bit);
+                if (rc == 0 && bit == 0U) {
+                    rc = bits_get(r, 12U, &raw);
+                    dod = (int32_t)raw - 2047;
+                } else if (rc == 0) {
+                    rc = bits_get(r, 32U, &raw);
+                    dod = (int32_t)raw;
+                }
+            }
+        }
+    }
+
+    if (rc != 0) {
+        return rc;
+    }
+
+    s->delta += (uint32_t)dod;
+    s->ts += s->delta;
+    *out_ts = s->ts;
+    return 0;
+}
+
+static int get_value(bit_reader_t *r, series_state_t *s, uint32_t *out_value)
+{
+    uint32_t bit;
+    uint32_t lead;
+    uint32_t len;
+    uint32_t x;
+    int rc;
+
+    rc = bits_get(r, 1U, &bit);
+    if (rc != 0) {
+        return rc;
+    }
+
+    if (bit != 0U) {
+        rc = bits_get(r, 1U, &bit);
+        if (rc != 0) {
+            return rc;
+        }
+
+        if (bit != 0U) {
+            rc = bits_get(r, 5U, &lead);
+            if (rc == 0) {
+                rc = bits_get(r, 6U, &len);
+            }
+            if (rc != 0) {
+                return rc;
+            }
+            if (len == 0U || lead + len > 32U) {
+                return -EBADMSG;
+            }
+            s->lead = (uint8_t)lead;
+            s->trail = (uint8_t)(32U - lead - len);
+        } else if (s->lead == GORILLA_NO_WINDOW) {
+            return -EBADMSG;
+        }
+
+        len = 32U - s->lead - s->trail;
+        rc = bits_get(r, (uint8_t)len, &x);
+        if (rc != 0) {
+            return rc;
+        }
+        s->value ^= (s->trail < 32U) ? (x << s->trail) : 0U;
+    }
+
+    *out_value = s->value;
+    return 0;
+}
+
+int gw_gorilla_decode_batch(const uint8_t *buf, size_t len, gw_codec_batch_t *out_batch)
+{
+    size_t pos = GORILLA_HEADER_SIZE;
+    uint8_t series;
+    uint8_t n;
+    int rc;
+
+    if (buf == NULL || out_batch == NULL) {
+        return -EINVAL;
+    }
+
+    out_batch->count = 0U;
+
+    if (len < GORILLA_HEADER_SIZE || buf[0] != GW_GORILLA_MAGIC) {
+        return -EBADMSG;
+    }
+    if (buf[1] != GW_GORILLA_VERSION) {
+        return -ENOTSUP;
+    }
+
+    series = buf[2];
+
+    for (n = 0U; n < series; ++n) {
+        series_state_t s;
+        bit_reader_t r;
+        uint16_t id;
+        uint16_t points;
+        uint16_t stream_len;
+        uint16_t k;
+
+        if (len - pos < GORILLA_SERIES_HEADER_SIZE) {
+            return -EBADMSG;
+        }
+
+        id = get_u16_be(&buf[pos]);
+        points = get_u16_be(&buf[pos + 2U]);
+        stream_len = get_u16_be(&buf[pos + 4U]);
+        pos += GORILLA_SERIES_HEADER_SIZE;
+
+        if (len - pos < stream_len) {
+            return -EBADMSG;
+        }
+        if ((size_t)out_batch->count + points > GW_CODEC_BATCH_MAX_POINTS) {
+            return -ENOSPC;
+        }
+
+        r.buf = &buf[pos];
+        r.len = stream_len;
+        r.bits = 0U;
+        (void)memset(&s, 0, sizeof(s));
+        s.lead = GORILLA_NO_WINDOW;
+
+        for (k = 0U; k < points; ++k) {
+            gw_codec_point_t *p = &out_batch->points[out_batch->count];
+            uint32_t bits;
+
+            if (k == 0U) {
+                rc = bits_get(&r, 32U, &s.ts);
+                if (rc == 0) {
+                    rc = bits_get(&r, 32U, &s.value);
+                }
+                bits = s.value;
+            } else {
+                rc = get_timestamp(&r, &s, &p->ts_ms);
+                if (rc == 0) {
+                    rc = get_value(&r, &s, &bits);
+                }
+            }
+            if (rc != 0) {
+                return rc;
+            }
+
+            p->ts_ms = s.ts;
+            p->field.id = id;
+            p->field.type = GW_CODEC_VALUE_FLOAT;
+            (void)memcpy(&p->field.value.f, &bits, sizeof(bits));
+            out_batch->count++;
+        }
+
+        pos += stream_len;
+    }
+
+    return (pos == len) ? 0 : -EBADMSG;
+}
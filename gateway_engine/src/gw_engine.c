@@ -2,36 +2,915 @@
 #include <stddef.h>
 #include <string.h>
 
+#include <gateway_engine/gw_codec.h>
 #include <gateway_engine/gw_engine.h>
 #include <gateway_engine/gw_link_proto.h>
+#include <gateway_engine/ports/gw_port_clock.h>
+#include <gateway_engine/ports/gw_port_random.h>
 
-static int handle_incoming_frame(gw_engine_t *engine, const uint8_t *frame, size_t frame_len)
+#include "gw_time.h"
+
+static gw_engine_pending_request_t *find_pending(gw_engine_t *engine, uint16_t seq)
 {
-    gw_link_frame_view_t view;
+    size_t i;
+
+    for (i = 0; i < GW_ENGINE_MAX_PENDING_REQUESTS; ++i) {
+        if (engine->pending[i].in_use && engine->pending[i].seq == seq) {
+            return &engine->pending[i];
+        }
+    }
+
+    return NULL;
+}
+
+static gw_engine_pending_request_t *alloc_pending(gw_engine_t *engine)
+{
+    size_t i;
+
+    for (i = 0; i < GW_ENGINE_MAX_PENDING_REQUESTS; ++i) {
+        if (!engine->pending[i].in_use) {
+            return &engine->pending[i];
+        }
+    }
+
+    return NULL;
+}
+
+/* Sequence 0 is never sent, so the counter skips it when it wraps. */
+static uint16_t seq_after(uint16_t seq)
+{
+    seq++;
+    return (seq == 0U) ? 1U : seq;
+}
+
+static uint16_t next_seq(gw_engine_t *engine)
+{
+    uint16_t seq = engine->tx_seq;
+
+    engine->tx_seq = seq_after(seq);
+    return seq;
+}
+
+/* The first sequence not held by a pending request; at most one probe per slot. */
+static uint16_t free_seq(gw_engine_t *engine)
+{
+    uint16_t seq = engine->tx_seq;
+
+    while (find_pending(engine, seq) != NULL) {
+        seq = seq_after(seq);
+    }
+
+    return seq;
+}
+
+static void complete_pending(
+    gw_engine_t *engine,
+    gw_engine_pending_request_t *req,
+    gw_engine_request_result_t result,
+    const gw_link_frame_view_t *response)
+{
+    gw_engine_request_cb cb = req->cb;
+    void *user_data = req->user_data;
+
+    /* Release the slot first so the callback may issue a follow-up request. */
+    (void)memset(req, 0, sizeof(*req));
+    engine->pending_count--;
+
+    if (cb != NULL) {
+        cb(engine, result, response, user_data);
+    }
+}
+
+static void expire_pending(gw_engine_t *engine, uint32_t now_ms)
+{
+    size_t i;
+
+    if (engine->pending_count == 0U) {
+        return;
+    }
+
+    for (i = 0; i < GW_ENGINE_MAX_PENDING_REQUESTS; ++i) {
+        gw_engine_pending_request_t *req = &engine->pending[i];
+
+        if (req->in_use && gw_deadline_reached(now_ms, req->deadline_ms)) {
+            complete_pending(engine, req, GW_ENGINE_REQUEST_TIMEOUT, NULL);
+        }
+    }
+}
+
+static void cancel_all_pending(gw_engine_t *engine)
+{
+    size_t i;
+
+    for (i = 0; i < GW_ENGINE_MAX_PENDING_REQUESTS && engine->pending_count > 0U; ++i) {
+        if (engine->pending[i].in_use) {
+            complete_pending(engine, &engine->pending[i], GW_ENGINE_REQUEST_CANCELLED, NULL);
+        }
+    }
+}
+
+static void handle_response(gw_engine_t *engine, const gw_link_frame_view_t *view)
+{
+    gw_engine_pending_request_t *req;
+
+    req = find_pending(engine, view->seq);
+    if (req == NULL) {
+        return;
+    }
+
+    complete_pending(
+        engine,
+        req,
+        (view->cmd == GW_LINK_CMD_ACK) ? GW_ENGINE_REQUEST_ACK : GW_ENGINE_REQUEST_NACK,
+        view);
+}
+
+static int send_frame(gw_engine_t *engine, uint8_t cmd, uint16_t seq, const uint8_t *payload, uint16_t payload_len)
+{
+    uint8_t frame[GW_LINK_MAX_FRAME_SIZE];
+    size_t frame_len = 0U;
     int rc;
 
-    rc = gw_link_decode(frame, frame_len, &view);
+    rc = gw_link_encode(0U, cmd, seq, payload, payload_len, frame, sizeof(frame), &frame_len);
+    if (rc != 0) {
+        return rc;
+    }
+
+    return gw_transport_tx(&engine->transport, frame, frame_len, engine->config.loop_period_ms);
+}
+
+static void rx_window_close(gw_engine_t *engine)
+{
+    engine->metrics.rx_error_rate_permille =
+        (uint16_t)(((uint32_t)engine->rx_window_errors * 1000U) / engine->rx_window_frames);
+    engine->rx_window_frames = 0U;
+    engine->rx_window_errors = 0U;
+}
+
+/* Returns true once the error count within the current window reaches the fault threshold. */
+static bool rx_window_account(gw_engine_t *engine, bool error)
+{
+    engine->rx_window_frames++;
+    if (error) {
+        engine->rx_window_errors++;
+        if (engine->rx_window_errors >= GW_ENGINE_RX_ERROR_THRESHOLD) {
+            rx_window_close(engine);
+            return true;
+        }
+    }
+
+    if (engine->rx_window_frames >= GW_ENGINE_RX_ERROR_WINDOW) {
+        rx_window_close(engine);
+    }
+
+    return false;
+}
+
+/* Corrupted frames are counted and dropped; only a sustained error rate is fatal. */
+static int handle_decode_error(gw_engine_t *engine, int err)
+{
+    switch (err) {
+    case -EBADMSG:
+        engine->metrics.rx_dropped_crc++;
+        break;
+    case -EPROTO:
+        engine->metrics.rx_dropped_proto++;
+        break;
+    case -EMSGSIZE:
+        engine->metrics.rx_dropped_len++;
+        break;
+    default:
+        return err;
+    }
+
+    return rx_window_account(engine, true) ? err : 0;
+}
+
+static uint16_t route_slot(const gw_engine_t *engine, uint8_t cmd)
+{
+    size_t i;
+
+    for (i = 0U; i < engine->config.route_count; ++i) {
+        const gw_engine_route_t *route = &engine->config.routes[i];
+
+        if ((route->edge_id == GW_ENGINE_ROUTE_ANY_EDGE || route->edge_id == engine->config.edge_id) &&
+            (route->cmd == GW_ENGINE_ROUTE_ANY_CMD || route->cmd == cmd)) {
+            return route->slot;
+        }
+    }
+
+    return 0U;
+}
+
+static int publish_telemetry(gw_engine_t *engine, uint16_t slot, const uint8_t *payload, size_t payload_len)
+{
+    int rc = gw_cloud_publish_slot(&engine->cloud, slot, payload, payload_len);
+
     if (rc != 0) {
+        engine->metrics.telemetry_dropped++;
         return rc;
     }
 
-    if (view.cmd == GW_LINK_CMD_OTA_BEGIN) {
+    engine->metrics.telemetry_forwarded++;
+    return 0;
+}
+
+static bool rate_limited(const gw_engine_t *engine)
+{
+    return engine->config.cloud.publish_rate_msgs > 0U || engine->config.cloud.publish_rate_bytes > 0U;
+}
+
+static void batch_record(gw_engine_t *engine, uint16_t slot, uint32_t now_ms, const gw_codec_record_t *rec);
+
+static void publish_summary(void *user_data, uint16_t edge_id, uint16_t slot, const gw_codec_record_t *summary)
+{
+    gw_engine_t *engine = (gw_engine_t *)user_data;
+    uint8_t buf[GW_AGG_SUMMARY_MAX_SIZE];
+    size_t len = 0U;
+
+    (void)edge_id;
+
+    if (engine->cloud_state != GW_ENGINE_CLOUD_STATE_CONNECTED) {
+        engine->metrics.telemetry_dropped++;
+        return;
+    }
+
+    /* Under a broker quota the summary waits in the batch instead of meeting an empty bucket. */
+    if (rate_limited(engine)) {
+        batch_record(engine, slot, gw_port_clock_now_ms(), summary);
+        engine->metrics.telemetry_summaries++;
+        return;
+    }
+
+    if (gw_codec_encode_cbor(summary, buf, sizeof(buf), &len) != 0) {
+        engine->metrics.telemetry_dropped++;
+        return;
+    }
+
+    if (publish_telemetry(engine, slot, buf, len) == 0) {
+        engine->metrics.telemetry_summaries++;
+    }
+}
+
+static bool batching_enabled(const gw_engine_t *engine)
+{
+    return engine->config.batch_max_age_ms > 0U;
+}
+
+static uint32_t batch_age_ms(const gw_engine_t *engine)
+{
+    return gw_adapt_enabled(&engine->adapt) ? engine->adapt.flush_ms : engine->config.batch_max_age_ms;
+}
+
+static uint16_t batch_limit(const gw_engine_t *engine)
+{
+    return gw_adapt_enabled(&engine->adapt) ? engine->adapt.batch_points : (uint16_t)GW_CODEC_BATCH_MAX_POINTS;
+}
+
+/* Publishes the open batch, halving the block until it fits one message. */
+static void flush_batch(gw_engine_t *engine)
+{
+    gw_codec_batch_t *batch = &engine->batch;
+    uint8_t buf[GW_ENGINE_BATCH_MAX_SIZE];
+
+    if (batch->count == 0U) {
+        return;
+    }
+
+    if (engine->cloud_state != GW_ENGINE_CLOUD_STATE_CONNECTED) {
+        engine->metrics.telemetry_dropped++;
+        gw_codec_batch_init(batch);
+        engine->batch_deferred = false;
+        return;
+    }
+
+    while (batch->count > 0U) {
+        uint16_t pending = batch->count;
+        uint16_t n = pending;
+        size_t len = 0U;
+        int rc;
+
+        for (;;) {
+            batch->count = n;
+            rc = gw_codec_encode_batch(batch, engine->config.batch_format, buf, sizeof(buf), &len);
+            if (rc != -ENOSPC || n == 1U) {
+                break;
+            }
+            n = (uint16_t)(n / 2U);
+        }
+
+        if (rc != 0) {
+            engine->metrics.telemetry_dropped++;
+        } else {
+            rc = gw_cloud_publish_slot(&engine->cloud, engine->batch_slot, buf, len);
+            if (rc == -EAGAIN) {
+                /*
+                 * Rate limited or window full: keep the points, later ones join
+                 * them, and retry once the bucket has the tokens.
+                 */
+                batch->count = pending;
+                if (!engine->batch_deferred) {
+                    engine->batch_deferred = true;
+                    engine->metrics.telemetry_deferred++;
+                }
+                engine->batch_flush_at_ms = gw_port_clock_now_ms() + gw_cloud_publish_wait_ms(&engine->cloud);
+                return;
+            }
+
+            engine->batch_deferred = false;
+
+            if (rc != 0) {
+                engine->metrics.telemetry_dropped++;
+            } else {
+                engine->metrics.telemetry_forwarded++;
+                engine->metrics.telemetry_batches++;
+            }
+        }
+
+        (void)memmove(&batch->points[0], &batch->points[n], (size_t)(pending - n) * sizeof(batch->points[0]));
+        batch->count = (uint16_t)(pending - n);
+    }
+}
+
+/* A slot change or a full batch flushes first; the first record starts the age timer. */
+static void batch_record(gw_engine_t *engine, uint16_t slot, uint32_t now_ms, const gw_codec_record_t *rec)
+{
+    gw_codec_batch_t *batch = &engine->batch;
+
+    if (batch->count > 0U && engine->batch_slot != slot) {
+        flush_batch(engine);
+        if (batch->count > 0U) {
+            /* The deferred batch still owns the other slot. */
+            engine->metrics.telemetry_dropped++;
+            return;
+        }
+    }
+
+    if (gw_codec_batch_add(batch, now_ms, rec) == -ENOSPC) {
+        flush_batch(engine);
+        if (gw_codec_batch_add(batch, now_ms, rec) != 0) {
+            engine->metrics.telemetry_dropped++;
+            return;
+        }
+    }
+
+    if (batch->count == rec->count) {
+        engine->batch_slot = slot;
+        engine->batch_flush_at_ms = now_ms + batch_age_ms(engine);
+    }
+
+    if (batch->count >= batch_limit(engine)) {
+        flush_batch(engine);
+    }
+}
+
+/*
+ * Aggregated fields are consumed into their windows, the rest goes through the
+ * deadband filter. The record is re-encoded only when fields were removed.
+ */
+static void forward_record(gw_engine_t *engine, const gw_link_frame_view_t *view, gw_codec_record_t *in)
+{
+    uint16_t slot = route_slot(engine, view->cmd);
+    uint32_t now_ms = gw_port_clock_now_ms();
+    const gw_codec_record_t *rec = in;
+    gw_codec_record_t out;
+    uint8_t buf[GW_LINK_MAX_PAYLOAD];
+    size_t len = 0U;
+    uint8_t received = in->count;
+
+    if (gw_agg_enabled(&engine->agg)) {
+        (void)gw_agg_feed(&engine->agg, engine->config.edge_id, now_ms, in);
+    }
+
+    if (gw_rbe_enabled(&engine->rbe) && in->count > 0U &&
+        gw_rbe_filter(&engine->rbe, engine->config.edge_id, now_ms, in, &out) == 0) {
+        rec = &out;
+    }
+
+    if (rec->count == 0U) {
+        engine->metrics.telemetry_suppressed++;
+        return;
+    }
+
+    if (batching_enabled(engine)) {
+        batch_record(engine, slot, now_ms, rec);
+        return;
+    }
+
+    if (rec->count == received) {
+        (void)publish_telemetry(engine, slot, view->payload, view->payload_len);
+        return;
+    }
+
+    if (gw_codec_encode_cbor(rec, buf, sizeof(buf), &len) != 0) {
+        engine->metrics.telemetry_dropped++;
+        return;
+    }
+
+    (void)publish_telemetry(engine, slot, buf, len);
+}
+
+static void send_rule_action(void *user_data, uint16_t dst_edge, const uint8_t *payload, size_t payload_len)
+{
+    gw_engine_t *engine = (gw_engine_t *)user_data;
+    int rc = -ENOENT;
+
+    if (dst_edge == GW_RULES_ANY_EDGE || dst_edge == engine->config.edge_id) {
+        rc = gw_engine_send(engine, GW_LINK_CMD_CONTROL, payload, (uint16_t)payload_len);
+    } else if (engine->config.rule_forward != NULL) {
+        engine->config.rule_forward(engine->config.rule_forward_user_data, dst_edge, payload, payload_len);
+        rc = 0;
+    }
+
+    if (rc != 0) {
+        engine->metrics.rule_actions_dropped++;
+        return;
+    }
+
+    engine->metrics.rule_actions++;
+}
+
+/*
+ * Sets the push (or the whole resync) up again after ack_timeout_ms, doubled
+ * per attempt. Past max_retries the push is dropped; the values stay pending.
+ */
+static void shadow_push_retry(gw_engine_t *engine, bool resync, uint32_t now_ms)
+{
+    const gw_shadow_config_t *cfg = &engine->shadow.config;
+    uint8_t limit = (cfg->max_retries > 0U) ? cfg->max_retries : (uint8_t)GW_SHADOW_DEFAULT_MAX_RETRIES;
+    uint8_t shift;
+
+    if (engine->shadow_push_attempts >= limit) {
+        engine->shadow_push_attempts = 0U;
+        engine->metrics.shadow_push_abandoned++;
+        return;
+    }
+
+    shift = (engine->shadow_push_attempts < GW_SHADOW_RETRY_MAX_SHIFT) ? engine->shadow_push_attempts
+                                                                        : (uint8_t)GW_SHADOW_RETRY_MAX_SHIFT;
+    engine->shadow_push_attempts++;
+
+    if (resync) {
+        engine->shadow_resync_wanted = true;
+    } else {
+        engine->shadow_push_wanted = true;
+    }
+
+    engine->shadow_retry_at_ms = now_ms + (cfg->ack_timeout_ms << shift);
+    engine->metrics.shadow_retries++;
+}
+
+static void shadow_push_done(
+    gw_engine_t *engine,
+    gw_engine_request_result_t result,
+    const gw_link_frame_view_t *response,
+    void *user_data)
+{
+    (void)response;
+    (void)user_data;
+
+    engine->shadow_push_inflight = false;
+    if (result == GW_ENGINE_REQUEST_ACK) {
+        engine->shadow_push_attempts = 0U;
+        gw_shadow_ack(&engine->shadow, engine->shadow_push_version);
+        return;
+    }
+
+    shadow_push_retry(engine, engine->shadow_push_resync, gw_port_clock_now_ms());
+}
+
+/*
+ * Desired state goes to the edge as one CBOR CONTROL frame, one at a time. A
+ * resync carries every desired value; otherwise only those not yet ACKed.
+ * A frame that could not be queued, timed out or was NACKed is retried by
+ * shadow_push_retry().
+ */
+static void shadow_push(gw_engine_t *engine, uint32_t now_ms)
+{
+    gw_codec_record_t rec;
+    uint8_t buf[GW_LINK_MAX_PAYLOAD];
+    size_t len = 0U;
+    bool resync;
+
+    if (engine->shadow_push_inflight || (!engine->shadow_resync_wanted && !engine->shadow_push_wanted) ||
+        !gw_deadline_reached(now_ms, engine->shadow_retry_at_ms)) {
+        return;
+    }
+
+    resync = engine->shadow_resync_wanted;
+    gw_shadow_desired(&engine->shadow, resync, &rec);
+    engine->shadow_resync_wanted = false;
+    engine->shadow_push_wanted = false;
+
+    if (rec.count == 0U) {
+        return;
+    }
+
+    /* Same record next time; the values stay pending for a later update. */
+    if (gw_codec_encode_cbor(&rec, buf, sizeof(buf), &len) != 0) {
+        engine->metrics.shadow_push_failed++;
+        return;
+    }
+
+    if (gw_engine_request(
+            engine,
+            GW_LINK_CMD_CONTROL,
+            buf,
+            (uint16_t)len,
+            engine->shadow.config.ack_timeout_ms,
+            shadow_push_done,
+            NULL) != 0) {
+        shadow_push_retry(engine, resync, now_ms);
+        return;
+    }
+
+    engine->shadow_push_inflight = true;
+    engine->shadow_push_resync = resync;
+    engine->shadow_push_version = engine->shadow.desired_version;
+    engine->metrics.shadow_pushes++;
+}
+
+/* A full document after a cloud reconnect or a read, otherwise changed fields at most once per delta_min_ms. */
+static void shadow_publish(gw_engine_t *engine, uint32_t now_ms)
+{
+    gw_codec_record_t reported;
+    gw_codec_record_t desired;
+    uint8_t buf[GW_LINK_MAX_PAYLOAD];
+    size_t len = 0U;
+
+    if (engine->cloud_state != GW_ENGINE_CLOUD_STATE_CONNECTED) {
+        return;
+    }
+
+    if (!engine->shadow_full_wanted &&
+        (!gw_shadow_has_delta(&engine->shadow) || !gw_deadline_reached(now_ms, engine->shadow_next_delta_ms))) {
+        return;
+    }
+
+    gw_shadow_document(&engine->shadow, engine->shadow_full_wanted, &reported, &desired);
+    if (gw_shadow_encode(&reported, &desired, buf, sizeof(buf), &len) != 0 ||
+        publish_telemetry(engine, engine->shadow.config.slot, buf, len) != 0) {
+        return;
+    }
+
+    gw_shadow_clear_delta(&engine->shadow);
+    engine->shadow_full_wanted = false;
+    engine->shadow_next_delta_ms = now_ms + engine->shadow.config.delta_min_ms;
+    engine->metrics.shadow_documents++;
+}
+
+/* The first frame, or one after resync_idle_ms of silence, means the edge (re)joined. */
+static void shadow_track_edge(gw_engine_t *engine)
+{
+    uint32_t now_ms = gw_port_clock_now_ms();
+    uint32_t idle_ms = engine->shadow.config.resync_idle_ms;
+
+    if (!engine->edge_seen || (idle_ms > 0U && (now_ms - engine->edge_last_rx_ms) >= idle_ms)) {
+        engine->shadow_resync_wanted = true;
+        engine->metrics.shadow_resyncs++;
+    }
+
+    engine->edge_seen = true;
+    engine->edge_last_rx_ms = now_ms;
+}
+
+/* An empty payload reads the shadow and a CBOR map sets desired state; -ENOTSUP for anything else. */
+static int shadow_command(gw_engine_t *engine, const gw_cloud_command_t *cmd)
+{
+    gw_codec_record_t rec;
+    int rc;
+
+    if (cmd->len == 0U) {
+        engine->shadow_full_wanted = true;
+        return 0;
+    }
+
+    if (gw_codec_detect(cmd->payload, cmd->len) != GW_CODEC_FORMAT_CBOR ||
+        gw_codec_decode_cbor(cmd->payload, cmd->len, &rec) != 0) {
+        return -ENOTSUP;
+    }
+
+    rc = gw_shadow_set_desired(&engine->shadow, &rec);
+    if (rc == 0) {
+        engine->shadow_push_wanted = true;
+    }
+
+    return rc;
+}
+
+/*
+ * Edge telemetry goes to the cloud byte for byte; the payload encoding picks
+ * the topic. CBOR records are decoded once for the local rules, the shadow
+ * and the filters; rules and shadow run before the cloud check so they keep
+ * working offline.
+ */
+static void forward_telemetry(gw_engine_t *engine, const gw_link_frame_view_t *view)
+{
+    bool filtering = gw_agg_enabled(&engine->agg) || gw_rbe_enabled(&engine->rbe) || batching_enabled(engine);
+    bool decoded = false;
+    gw_codec_record_t in;
+
+    if (view->payload_len > 0U &&
+        (filtering || gw_rules_enabled(&engine->rules) || gw_shadow_enabled(&engine->shadow)) &&
+        gw_codec_detect(view->payload, view->payload_len) == GW_CODEC_FORMAT_CBOR) {
+        decoded = gw_codec_decode_cbor(view->payload, view->payload_len, &in) == 0;
+    }
+
+    if (decoded) {
+        gw_rules_eval(&engine->rules, engine->config.edge_id, gw_port_clock_now_ms(), &in);
+        if (gw_shadow_enabled(&engine->shadow)) {
+            gw_shadow_report(&engine->shadow, &in);
+        }
+    }
+
+    if (engine->cloud_state != GW_ENGINE_CLOUD_STATE_CONNECTED || view->payload_len == 0U) {
+        engine->metrics.telemetry_dropped++;
+        return;
+    }
+
+    /* Undecodable payloads pass through. */
+    if (decoded && filtering) {
+        forward_record(engine, view, &in);
+        return;
+    }
+
+    (void)publish_telemetry(engine, route_slot(engine, view->cmd), view->payload, view->payload_len);
+}
+
+static void account_cmd_latency(gw_engine_t *engine, uint32_t latency)
+{
+    gw_engine_metrics_t *m = &engine->metrics;
+
+    m->cmd_latency_last_ms = latency;
+    if (latency > m->cmd_latency_max_ms) {
+        m->cmd_latency_max_ms = latency;
+    }
+    /* EWMA with 1/8 gain. */
+    if (m->cmd_routed == 1U) {
+        m->cmd_latency_avg_ms = latency;
+    } else {
+        m->cmd_latency_avg_ms =
+            (uint32_t)((int32_t)m->cmd_latency_avg_ms + ((int32_t)latency - (int32_t)m->cmd_latency_avg_ms) / 8);
+    }
+}
+
+/* Cloud commands addressed to this engine's edge go out as CONTROL frames in arrival order. */
+static void route_commands(gw_engine_t *engine)
+{
+    gw_cloud_command_t cmd;
+
+    while (gw_cloud_poll_command(&engine->cloud, &cmd) == 0) {
+        int rc = -ENOTSUP;
+
+        if (cmd.edge_id != engine->config.edge_id) {
+            engine->metrics.cmd_dropped++;
+            continue;
+        }
+
+        if (gw_shadow_enabled(&engine->shadow)) {
+            rc = shadow_command(engine, &cmd);
+            if (rc == 0) {
+                /* Absorbed by the shadow: nothing reached the edge, so no latency sample. */
+                engine->metrics.cmd_shadowed++;
+                continue;
+            }
+        }
+        if (rc == -ENOTSUP) {
+            rc = gw_engine_send(engine, GW_LINK_CMD_CONTROL, cmd.payload, cmd.len);
+        }
+        if (rc != 0) {
+            engine->metrics.cmd_dropped++;
+            continue;
+        }
+
+        engine->metrics.cmd_routed++;
+        account_cmd_latency(engine, gw_port_clock_now_ms() - cmd.received_ms);
+    }
+}
+
+static bool is_ota_cmd(uint8_t cmd)
+{
+    return cmd == GW_LINK_CMD_OTA_BEGIN || cmd == GW_LINK_CMD_OTA_CHUNK || cmd == GW_LINK_CMD_OTA_END;
+}
+
+/* Same payload as the edge's ACK: cmd, seq (LE) and the positive errno as status. */
+static void send_nack(gw_engine_t *engine, const gw_link_frame_view_t *view, int err)
+{
+    uint8_t payload[4];
+
+    payload[0] = view->cmd;
+    payload[1] = (uint8_t)(view->seq & 0x00FFU);
+    payload[2] = (uint8_t)(view->seq >> 8);
+    payload[3] = (uint8_t)((err < 0 && err > -256) ? -err : 0xFF);
+
+    if (send_frame(engine, GW_LINK_CMD_NACK, view->seq, payload, sizeof(payload)) != 0) {
+        engine->metrics.ota_nack_failed++;
+    }
+}
+
+static int dispatch_frame(gw_engine_t *engine, const gw_link_frame_view_t *view)
+{
+    if (view->cmd == GW_LINK_CMD_TELEMETRY) {
+        forward_telemetry(engine, view);
+        return 0;
+    }
+
+    if (view->cmd == GW_LINK_CMD_ACK || view->cmd == GW_LINK_CMD_NACK) {
+        handle_response(engine, view);
+        return 0;
+    }
+
+    if (view->cmd == GW_LINK_CMD_OTA_BEGIN) {
         return gw_ota_begin(&engine->ota);
     }
 
-    if (view.cmd == GW_LINK_CMD_OTA_CHUNK) {
-        return gw_ota_push_chunk(&engine->ota, view.payload, view.payload_len);
+    if (view->cmd == GW_LINK_CMD_OTA_CHUNK) {
+        return gw_ota_push_chunk(&engine->ota, view->payload, view->payload_len);
     }
 
-    if (view.cmd == GW_LINK_CMD_OTA_END) {
+    if (view->cmd == GW_LINK_CMD_OTA_END) {
         return gw_ota_finish(&engine->ota);
     }
 
     return 0;
 }
 
+static gw_engine_cloud_retry_t cloud_retry_class(int err)
+{
+    switch (err) {
+    case -EACCES:
+    case -EPERM:
+        return GW_ENGINE_CLOUD_RETRY_AUTH;
+    case -EBUSY:
+        return GW_ENGINE_CLOUD_RETRY_BUSY;
+    case -EAGAIN:
+        return GW_ENGINE_CLOUD_RETRY_UNCLAIMED;
+    default:
+        return GW_ENGINE_CLOUD_RETRY_NETWORK;
+    }
+}
+
+/*
+ * Exponential backoff with full jitter: the window doubles per failure of the
+ * same class and the delay is uniform below it, so gateways dropped by the
+ * same broker restart do not come back in lockstep. An unclaimed device polls
+ * bootstrap at the poll_interval the server returned, spread by up to 25%.
+ */
+static void cloud_schedule_retry(gw_engine_t *engine, uint32_t now_ms, int err)
+{
+    gw_engine_cloud_retry_t cls = cloud_retry_class(err);
+    uint32_t min_ms = GW_ENGINE_CLOUD_BACKOFF_MIN_MS;
+    uint32_t max_ms = GW_ENGINE_CLOUD_BACKOFF_MAX_MS;
+    uint32_t poll_s = engine->cloud.poll_interval_s;
+    uint32_t poll_ms = ((poll_s < 86400U) ? poll_s : 86400U) * 1000U;
+    uint32_t delay_ms;
+
+    if (cls == GW_ENGINE_CLOUD_RETRY_AUTH || cls == GW_ENGINE_CLOUD_RETRY_UNCLAIMED) {
+        min_ms = GW_ENGINE_CLOUD_AUTH_BACKOFF_MIN_MS;
+        max_ms = GW_ENGINE_CLOUD_AUTH_BACKOFF_MAX_MS;
+    } else if (cls == GW_ENGINE_CLOUD_RETRY_BUSY) {
+        min_ms = GW_ENGINE_CLOUD_BUSY_BACKOFF_MIN_MS;
+        max_ms = GW_ENGINE_CLOUD_BUSY_BACKOFF_MAX_MS;
+    }
+
+    if (engine->cloud_backoff_ms == 0U || cls != engine->cloud_retry_class) {
+        engine->cloud_backoff_ms = min_ms;
+    } else if (engine->cloud_backoff_ms < max_ms / 2U) {
+        engine->cloud_backoff_ms *= 2U;
+    } else {
+        engine->cloud_backoff_ms = max_ms;
+    }
+
+    if (cls == GW_ENGINE_CLOUD_RETRY_UNCLAIMED && poll_ms > 0U) {
+        delay_ms = poll_ms + gw_port_random_u32() % (poll_ms / 4U + 1U);
+    } else {
+        delay_ms = gw_port_random_u32() % (engine->cloud_backoff_ms + 1U);
+    }
+
+    engine->cloud_retry_class = cls;
+    engine->cloud_last_error = err;
+    engine->cloud_retry_at_ms = now_ms + delay_ms;
+    engine->cloud_state = GW_ENGINE_CLOUD_STATE_BACKOFF;
+}
+
+/* rc is the result of gw_cloud_connect/gw_cloud_pump while the session is being established. */
+static void cloud_connect_progress(gw_engine_t *engine, uint32_t now_ms, int rc)
+{
+    if (rc == -EINPROGRESS) {
+        engine->cloud_state = GW_ENGINE_CLOUD_STATE_CONNECTING;
+        return;
+    }
+
+    if (rc != 0) {
+        engine->metrics.cloud_connect_failures++;
+        (void)gw_cloud_disconnect(&engine->cloud);
+        cloud_schedule_retry(engine, now_ms, rc);
+        return;
+    }
+
+    engine->metrics.cloud_connects++;
+    /* Whatever was reported before the outage may be lost; start from full records. */
+    gw_rbe_reset(&engine->rbe);
+    engine->shadow_full_wanted = gw_shadow_enabled(&engine->shadow);
+    engine->cloud_backoff_ms = 0U;
+    engine->cloud_last_error = 0;
+    engine->cloud_state = GW_ENGINE_CLOUD_STATE_CONNECTED;
+}
+
+/* Feeds the uplink measurements to the rate controller and applies its decision. */
+static void adapt_step(gw_engine_t *engine, uint32_t now_ms)
+{
+    gw_cloud_stats_t st;
+    uint32_t rejected;
+    gw_adapt_sample_t sample;
+
+    if (!gw_adapt_enabled(&engine->adapt) || engine->cloud_state != GW_ENGINE_CLOUD_STATE_CONNECTED) {
+        return;
+    }
+
+    gw_cloud_get_stats(&engine->cloud, &st, NULL);
+    rejected = st.backpressure + st.queue_dropped + st.publish_failed;
+    sample.rtt_ms = st.puback_latency_avg_ms;
+    sample.send_latency_ms = st.send_latency_avg_ms;
+    sample.backlog = (uint32_t)st.queue_depth + st.inflight;
+    sample.rejected = rejected - engine->adapt_rejected_seen;
+
+    if (!gw_adapt_update(&engine->adapt, now_ms, &sample)) {
+        return;
+    }
+
+    engine->adapt_rejected_seen = rejected;
+    gw_agg_set_degraded(&engine->agg, engine->adapt.degraded);
+    engine->metrics.adapt_flush_ms = engine->adapt.flush_ms;
+    engine->metrics.adapt_batch_points = engine->adapt.batch_points;
+    engine->metrics.adapt_degraded = engine->adapt.degraded ? 1U : 0U;
+}
+
+/*
+ * The cloud session is advanced independently of the link: its failures only
+ * reschedule a reconnect and never fault the engine or stop edge traffic.
+ */
+static void cloud_step(gw_engine_t *engine, uint32_t now_ms)
+{
+    int rc;
+
+    switch (engine->cloud_state) {
+    case GW_ENGINE_CLOUD_STATE_BACKOFF:
+        if (gw_deadline_reached(now_ms, engine->cloud_retry_at_ms)) {
+            cloud_connect_progress(engine, now_ms, gw_cloud_connect(&engine->cloud));
+        }
+        break;
+
+    case GW_ENGINE_CLOUD_STATE_CONNECTING:
+        cloud_connect_progress(engine, now_ms, gw_cloud_pump(&engine->cloud));
+        break;
+
+    case GW_ENGINE_CLOUD_STATE_CONNECTED:
+        rc = gw_cloud_pump(&engine->cloud);
+        if (rc != 0) {
+            engine->metrics.cloud_disconnects++;
+            (void)gw_cloud_disconnect(&engine->cloud);
+            cloud_schedule_retry(engine, now_ms, rc);
+        }
+        break;
+
+    case GW_ENGINE_CLOUD_STATE_OFFLINE:
+    default:
+        break;
+    }
+}
+
+static int handle_incoming_frame(gw_engine_t *engine, const uint8_t *frame, size_t frame_len)
+{
+    gw_link_frame_view_t view;
+    int rc;
+
+    rc = gw_link_decode(frame, frame_len, &view);
+    if (rc != 0) {
+        return handle_decode_error(engine, rc);
+    }
+
+    engine->metrics.rx_frames++;
+    (void)rx_window_account(engine, false);
+
+    if (gw_shadow_enabled(&engine->shadow)) {
+        shadow_track_edge(engine);
+    }
+
+    rc = dispatch_frame(engine, &view);
+    if (rc != 0 && is_ota_cmd(view.cmd)) {
+        engine->metrics.ota_rejected++;
+        send_nack(engine, &view, rc);
+    } else if (rc != 0) {
+        engine->metrics.rx_rejected++;
+    }
+
+    return 0;
+}
+
 int gw_engine_init(gw_engine_t *engine, const gw_engine_config_t *cfg, const gw_transport_t *transport)
 {
+    size_t i;
     int rc;
 
     if (engine == NULL || cfg == NULL || transport == NULL) {
@@ -42,11 +921,49 @@ int gw_engine_init(gw_engine_t *engine, const gw_engine_config_t *cfg, const gw_
         return -EINVAL;
     }
 
+    if (cfg->routes == NULL && cfg->route_count > 0U) {
+        return -EINVAL;
+    }
+
+    for (i = 0U; i < cfg->route_count; ++i) {
+        if (cfg->routes[i].slot >= GW_CLOUD_SLOTS) {
+            return -EINVAL;
+        }
+    }
+
+    if (cfg->shadow.enabled && cfg->shadow.slot >= GW_CLOUD_SLOTS) {
+        return -EINVAL;
+    }
+
+    /* Adaptation steers the batch; without batching there is nothing to steer. */
+    if (cfg->adapt.enabled &&
+        (cfg->batch_max_age_ms == 0U || cfg->adapt.max_batch_points > GW_CODEC_BATCH_MAX_POINTS)) {
+        return -EINVAL;
+    }
+
+    /* Without a batch a rate-limited publish would have nowhere to wait. */
+    if (cfg->batch_max_age_ms == 0U && (cfg->cloud.publish_rate_msgs > 0U || cfg->cloud.publish_rate_bytes > 0U)) {
+        return -EINVAL;
+    }
+
+    if (cfg->batch_max_age_ms > 0U &&
+        cfg->batch_format != GW_CODEC_FORMAT_CBOR && cfg->batch_format != GW_CODEC_FORMAT_GORILLA) {
+        return -EINVAL;
+    }
+
+    for (i = 0U; i < cfg->agg.rule_count && cfg->agg.rules != NULL; ++i) {
+        if (cfg->agg.rules[i].slot >= GW_CLOUD_SLOTS) {
+            return -EINVAL;
+        }
+    }
+
     (void)memset(engine, 0, sizeof(*engine));
     engine->config = *cfg;
     engine->transport = *transport;
     engine->state = GW_ENGINE_STATE_INIT;
     engine->tx_seq = 1U;
+    engine->cloud_state = GW_ENGINE_CLOUD_STATE_OFFLINE;
+    engine->uplink_available = true;
 
     rc = gw_cloud_init(&engine->cloud, &cfg->cloud);
     if (rc != 0) {
@@ -60,6 +977,36 @@ int gw_engine_init(gw_engine_t *engine, const gw_engine_config_t *cfg, const gw_
         return rc;
     }
 
+    rc = gw_rbe_init(&engine->rbe, &cfg->rbe);
+    if (rc != 0) {
+        engine->state = GW_ENGINE_STATE_FAULT;
+        return rc;
+    }
+
+    rc = gw_agg_init(&engine->agg, &cfg->agg, publish_summary, engine);
+    if (rc != 0) {
+        engine->state = GW_ENGINE_STATE_FAULT;
+        return rc;
+    }
+
+    rc = gw_rules_init(&engine->rules, &cfg->rules, send_rule_action, engine);
+    if (rc != 0) {
+        engine->state = GW_ENGINE_STATE_FAULT;
+        return rc;
+    }
+
+    rc = gw_shadow_init(&engine->shadow, &cfg->shadow);
+    if (rc != 0) {
+        engine->state = GW_ENGINE_STATE_FAULT;
+        return rc;
+    }
+
+    rc = gw_adapt_init(&engine->adapt, &cfg->adapt, gw_port_clock_now_ms());
+    if (rc != 0) {
+        engine->state = GW_ENGINE_STATE_FAULT;
+        return rc;
+    }
+
     engine->state = GW_ENGINE_STATE_READY;
     engine->initialized = true;
     return 0;
@@ -83,15 +1030,18 @@ int gw_engine_start(gw_engine_t *engine)
         return rc;
     }
 
-    rc = gw_cloud_connect(&engine->cloud);
-    if (rc != 0) {
-        (void)gw_transport_close(&engine->transport);
-        engine->state = GW_ENGINE_STATE_FAULT;
-        return rc;
-    }
-
     engine->running = true;
     engine->state = GW_ENGINE_STATE_RUNNING;
+    engine->cloud_backoff_ms = 0U;
+    engine->edge_seen = false;
+
+    if (engine->uplink_available) {
+        engine->cloud_retry_at_ms = gw_port_clock_now_ms();
+        engine->cloud_state = GW_ENGINE_CLOUD_STATE_BACKOFF;
+    } else {
+        engine->cloud_state = GW_ENGINE_CLOUD_STATE_OFFLINE;
+    }
+
     return 0;
 }
 
@@ -99,6 +1049,7 @@ int gw_engine_step(gw_engine_t *engine)
 {
     uint8_t rx_buf[GW_LINK_MAX_FRAME_SIZE];
     size_t rx_len = 0U;
+    uint32_t now_ms;
     int rc;
 
     if (engine == NULL || !engine->running) {
@@ -112,14 +1063,28 @@ int gw_engine_step(gw_engine_t *engine)
             engine->state = GW_ENGINE_STATE_FAULT;
             return rc;
         }
-    }
-
-    rc = gw_cloud_pump(&engine->cloud);
-    if (rc != 0 && rc != -ENOTCONN) {
+    } else if (rc != 0 && rc != -EAGAIN && rc != -ETIMEDOUT) {
+        engine->metrics.rx_transport_errors++;
         engine->state = GW_ENGINE_STATE_FAULT;
         return rc;
     }
 
+    now_ms = gw_port_clock_now_ms();
+    expire_pending(engine, now_ms);
+    cloud_step(engine, now_ms);
+    adapt_step(engine, now_ms);
+    route_commands(engine);
+    gw_agg_poll(&engine->agg, now_ms);
+
+    if (engine->batch.count > 0U && gw_deadline_reached(now_ms, engine->batch_flush_at_ms)) {
+        flush_batch(engine);
+    }
+
+    if (gw_shadow_enabled(&engine->shadow)) {
+        shadow_push(engine, now_ms);
+        shadow_publish(engine, now_ms);
+    }
+
     rc = gw_ota_pump(&engine->ota);
     if (rc != 0) {
         engine->state = GW_ENGINE_STATE_FAULT;
@@ -131,20 +1096,84 @@ int gw_engine_step(gw_engine_t *engine)
 
 int gw_engine_send(gw_engine_t *engine, uint8_t cmd, const uint8_t *payload, uint16_t payload_len)
 {
-    uint8_t frame[GW_LINK_MAX_FRAME_SIZE];
-    size_t frame_len = 0U;
+    if (engine == NULL || !engine->running) {
+        return -EINVAL;
+    }
+
+    return send_frame(engine, cmd, next_seq(engine), payload, payload_len);
+}
+
+int gw_engine_request(
+    gw_engine_t *engine,
+    uint8_t cmd,
+    const uint8_t *payload,
+    uint16_t payload_len,
+    uint32_t timeout_ms,
+    gw_engine_request_cb cb,
+    void *user_data)
+{
+    gw_engine_pending_request_t *req;
+    uint16_t seq;
     int rc;
 
-    if (engine == NULL || !engine->running) {
+    if (engine == NULL || !engine->running || cb == NULL || timeout_ms == 0U) {
         return -EINVAL;
     }
 
-    rc = gw_link_encode(0U, cmd, engine->tx_seq++, payload, payload_len, frame, sizeof(frame), &frame_len);
+    req = alloc_pending(engine);
+    if (req == NULL) {
+        return -EBUSY;
+    }
+
+    seq = free_seq(engine);
+    engine->tx_seq = seq_after(seq);
+
+    req->cb = cb;
+    req->user_data = user_data;
+    req->deadline_ms = gw_port_clock_now_ms() + timeout_ms;
+    req->seq = seq;
+    req->cmd = cmd;
+    req->in_use = true;
+    engine->pending_count++;
+
+    rc = send_frame(engine, cmd, seq, payload, payload_len);
     if (rc != 0) {
-        return rc;
+        (void)memset(req, 0, sizeof(*req));
+        engine->pending_count--;
     }
 
-    return gw_transport_tx(&engine->transport, frame, frame_len, engine->config.loop_period_ms);
+    return rc;
+}
+
+int gw_engine_set_uplink(gw_engine_t *engine, bool available)
+{
+    if (engine == NULL || !engine->initialized) {
+        return -EINVAL;
+    }
+
+    if (engine->uplink_available == available) {
+        return 0;
+    }
+
+    engine->uplink_available = available;
+
+    if (!engine->running) {
+        return 0;
+    }
+
+    if (!available) {
+        if (engine->cloud_state == GW_ENGINE_CLOUD_STATE_CONNECTED) {
+            engine->metrics.cloud_disconnects++;
+        }
+        (void)gw_cloud_disconnect(&engine->cloud);
+        engine->cloud_state = GW_ENGINE_CLOUD_STATE_OFFLINE;
+        return 0;
+    }
+
+    engine->cloud_backoff_ms = 0U;
+    engine->cloud_retry_at_ms = gw_port_clock_now_ms();
+    engine->cloud_state = GW_ENGINE_CLOUD_STATE_BACKOFF;
+    return 0;
 }
 
 int gw_engine_stop(gw_engine_t *engine)
@@ -153,12 +1182,65 @@ int gw_engine_stop(gw_engine_t *engine)
         return -EINVAL;
     }
 
+    cancel_all_pending(engine);
+    flush_batch(engine);
+    if (engine->batch.count > 0U) {
+        engine->metrics.telemetry_dropped++;
+        gw_codec_batch_init(&engine->batch);
+        engine->batch_deferred = false;
+    }
     (void)gw_cloud_disconnect(&engine->cloud);
     (void)gw_transport_close(&engine->transport);
 
     engine->running = false;
     engine->state = GW_ENGINE_STATE_READY;
+    engine->cloud_state = GW_ENGINE_CLOUD_STATE_OFFLINE;
+
+    return 0;
+}
+
+int gw_engine_load_rules(gw_engine_t *engine, const gw_rule_t *rules, size_t rule_count)
+{
+    if (engine == NULL || !engine->initialized) {
+        return -EINVAL;
+    }
+
+    return gw_rules_load(&engine->rules, rules, rule_count);
+}
+
+int gw_engine_set_desired(gw_engine_t *engine, const gw_codec_record_t *desired)
+{
+    int rc;
+
+    if (engine == NULL || desired == NULL || !gw_shadow_enabled(&engine->shadow)) {
+        return -EINVAL;
+    }
+
+    rc = gw_shadow_set_desired(&engine->shadow, desired);
+    if (rc == 0) {
+        engine->shadow_push_wanted = true;
+    }
+
+    return rc;
+}
+
+int gw_engine_get_shadow(const gw_engine_t *engine, gw_codec_record_t *out_reported, gw_codec_record_t *out_desired)
+{
+    if (engine == NULL || out_reported == NULL || out_desired == NULL || !gw_shadow_enabled(&engine->shadow)) {
+        return -EINVAL;
+    }
+
+    gw_shadow_document(&engine->shadow, true, out_reported, out_desired);
+    return 0;
+}
+
+int gw_engine_get_metrics(const gw_engine_t *engine, gw_engine_metrics_t *out_metrics)
+{
+    if (engine == NULL || out_metrics == NULL) {
+        return -EINVAL;
+    }
 
+    *out_metrics = engine->metrics;
     return 0;
 }
 
@@ -0,0 +1,13 @@
+#ifndef GW_TIME_H
+#define GW_TIME_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Wrap-safe: true once now_ms is at or past deadline_ms on the 32-bit ms clock. */
+static inline bool gw_deadline_reached(uint32_t now_ms, uint32_t deadline_ms)
+{
+    return (int32_t)(now_ms - deadline_ms) >= 0;
+}
+
+#endif
@@ -0,0 +1,492 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <zephyr/dfu/flash_img.h>
+#include <zephyr/dfu/mcuboot.h>
+#include <zephyr/kernel.h>
+#include <zephyr/storage/flash_map.h>
+
+#include <gateway_engine/gw_ota.h>
+
+#if defined(CONFIG_GW_ENGINE_OTA_PAGE_SIZE)
+#define GW_OTA_PAGE_SIZE CONFIG_GW_ENGINE_OTA_PAGE_SIZE
+#else
+#define GW_OTA_PAGE_SIZE 4096U
+#endif
+
+#if defined(CONFIG_GW_ENGINE_OTA_ERASE_AHEAD)
+#define GW_OTA_ERASE_AHEAD CONFIG_GW_ENGINE_OTA_ERASE_AHEAD
+#else
+#define GW_OTA_ERASE_AHEAD 2U
+#endif
+
+#define GW_OTA_DEFAULT_TIMEOUT_MS 1000U
+
+/*
+ * Two page buffers: the link fills one while the writer thread programs the
+ * other. After each page the writer erases up to GW_OTA_ERASE_AHEAD pages past
+ * the write offset, so a program never waits for an erase and push_chunk only
+ * blocks when both buffers are full.
+ *
+ * The engine thread owns fill/fill_len; the writer owns write_off/erased_off.
+ * busy hands the other buffer over and back; running stays set until the
+ * writer is also done erasing ahead. finishing stops erase-ahead once the last
+ * page is submitted, so nothing touches the slot after the image is marked.
+ * erase_trailer makes the first job wipe the MCUboot trailer pages from
+ * trailer_off to the end of the slot, so a trailer left by an earlier transfer
+ * never meets boot_request_upgrade().
+ */
+typedef struct {
+    struct k_thread thread;
+    bool started;
+    struct k_sem work;
+    struct k_sem idle;
+    atomic_t busy;
+    atomic_t running;
+    atomic_t finishing;
+    atomic_t error;
+    struct flash_img_context img;
+    const struct flash_area *fa;
+    gw_ota_ctx_t *ctx;
+    uint8_t fill;
+    uint32_t fill_len;
+    uint8_t job;
+    uint32_t job_len;
+    uint32_t write_off;
+    uint32_t erased_off;
+    uint32_t trailer_off;
+    bool erase_trailer;
+    /* The sector table is only needed in gw_ota_begin, while both pages are idle. */
+    union {
+        uint8_t pages[2][GW_OTA_PAGE_SIZE] __aligned(4);
+        struct flash_sector sectors[(2U * GW_OTA_PAGE_SIZE) / sizeof(struct flash_sector)];
+    };
+} gw_ota_flash_t;
+
+K_THREAD_STACK_DEFINE(g_ota_stack, CONFIG_GW_ENGINE_OTA_WRITER_STACK_SIZE);
+static gw_ota_flash_t g_ota;
+
+static int gw_ota_erase_page(void)
+{
+    int rc = flash_area_erase(g_ota.fa, g_ota.erased_off, GW_OTA_PAGE_SIZE);
+
+    if (rc == 0) {
+        g_ota.erased_off += GW_OTA_PAGE_SIZE;
+        g_ota.ctx->stats.pages_erased++;
+    }
+
+    return rc;
+}
+
+static int gw_ota_program(const uint8_t *data, uint32_t len)
+{
+    int rc;
+
+    while (g_ota.erased_off < g_ota.write_off + len) {
+        rc = gw_ota_erase_page();
+        if (rc != 0) {
+            return rc;
+        }
+    }
+
+    rc = flash_area_write(g_ota.fa, g_ota.write_off, data, len);
+    if (rc != 0) {
+        return rc;
+    }
+
+    g_ota.write_off += len;
+    g_ota.ctx->stats.bytes_written += len;
+    g_ota.ctx->stats.pages_written++;
+    return 0;
+}
+
+static int gw_ota_erase_trailer(void)
+{
+    uint32_t off;
+    int rc;
+
+    for (off = g_ota.trailer_off; off < g_ota.fa->fa_size; off += GW_OTA_PAGE_SIZE) {
+        rc = flash_area_erase(g_ota.fa, off, GW_OTA_PAGE_SIZE);
+        if (rc != 0) {
+            return rc;
+        }
+        g_ota.ctx->stats.pages_erased++;
+    }
+
+    return 0;
+}
+
+/* Erases ahead while no page is waiting, so the next program starts immediately. */
+static int gw_ota_erase_ahead(void)
+{
+    uint32_t target = g_ota.write_off + GW_OTA_ERASE_AHEAD * GW_OTA_PAGE_SIZE;
+    int rc;
+
+    while (g_ota.erased_off < target && g_ota.erased_off + GW_OTA_PAGE_SIZE <= g_ota.fa->fa_size &&
+           k_sem_count_get(&g_ota.work) == 0U && atomic_get(&g_ota.finishing) == 0) {
+        rc = gw_ota_erase_page();
+        if (rc != 0) {
+            return rc;
+        }
+    }
+
+    return 0;
+}
+
+static void gw_ota_writer_main(void *p1, void *p2, void *p3)
+{
+    int rc;
+
+    ARG_UNUSED(p1);
+    ARG_UNUSED(p2);
+    ARG_UNUSED(p3);
+
+    for (;;) {
+        (void)k_sem_take(&g_ota.work, K_FOREVER);
+        (void)atomic_set(&g_ota.running, 1);
+
+        rc = 0;
+        if (atomic_get(&g_ota.error) == 0 && g_ota.erase_trailer) {
+            g_ota.erase_trailer = false;
+            rc = gw_ota_erase_trailer();
+        }
+        if (rc == 0 && atomic_get(&g_ota.error) == 0 && g_ota.job_len > 0U) {
+            rc = gw_ota_program(g_ota.pages[g_ota.job], g_ota.job_len);
+        }
+        if (rc != 0) {
+            (void)atomic_set(&g_ota.error, rc);
+        }
+
+        (void)atomic_set(&g_ota.busy, 0);
+        k_sem_give(&g_ota.idle);
+
+        if (atomic_get(&g_ota.error) == 0) {
+            rc = gw_ota_erase_ahead();
+            if (rc != 0) {
+                (void)atomic_set(&g_ota.error, rc);
+            }
+        }
+
+        (void)atomic_set(&g_ota.running, 0);
+    }
+}
+
+static int gw_ota_writer_start(void)
+{
+    k_tid_t tid;
+
+    if (g_ota.started) {
+        return 0;
+    }
+
+    (void)k_sem_init(&g_ota.work, 0, 2);
+    (void)k_sem_init(&g_ota.idle, 0, 1);
+
+    tid = k_thread_create(
+        &g_ota.thread,
+        g_ota_stack,
+        K_THREAD_STACK_SIZEOF(g_ota_stack),
+        gw_ota_writer_main,
+        NULL,
+        NULL,
+        NULL,
+        CONFIG_GW_ENGINE_OTA_WRITER_PRIORITY,
+        0,
+        K_NO_WAIT);
+    (void)k_thread_name_set(tid, "gw_ota");
+
+    g_ota.started = true;
+    return 0;
+}
+
+/*
+ * busy is read first: it only drops after running is set, so seeing both clear
+ * means the writer has finished the last job and its erase-ahead.
+ */
+static bool gw_ota_writer_active(void)
+{
+    return atomic_get(&g_ota.busy) != 0 || atomic_get(&g_ota.running) != 0;
+}
+
+static void gw_ota_fail(gw_ota_ctx_t *ctx, int err)
+{
+    ctx->last_error = err;
+    ctx->state = GW_OTA_STATE_FAILED;
+}
+
+/* Waits for the writer to hand back its buffer; only reached when both buffers are full. */
+static int gw_ota_wait_idle(gw_ota_ctx_t *ctx)
+{
+    uint32_t timeout_ms = (ctx->config.timeout_ms > 0U) ? ctx->config.timeout_ms : GW_OTA_DEFAULT_TIMEOUT_MS;
+    int64_t start;
+
+    if (atomic_get(&g_ota.busy) == 0) {
+        return 0;
+    }
+
+    ctx->stats.stalls++;
+    start = k_uptime_get();
+
+    while (atomic_get(&g_ota.busy) != 0) {
+        if (k_sem_take(&g_ota.idle, K_MSEC(timeout_ms)) != 0) {
+            return -ETIMEDOUT;
+        }
+    }
+
+    ctx->stats.stall_ms += (uint32_t)(k_uptime_get() - start);
+    return 0;
+}
+
+static int gw_ota_submit(gw_ota_ctx_t *ctx, uint32_t len)
+{
+    int rc = gw_ota_wait_idle(ctx);
+
+    if (rc != 0) {
+        return rc;
+    }
+
+    rc = (int)atomic_get(&g_ota.error);
+    if (rc != 0) {
+        return rc;
+    }
+
+    g_ota.job = g_ota.fill;
+    g_ota.job_len = len;
+    g_ota.fill = (uint8_t)(g_ota.fill ^ 1U);
+    g_ota.fill_len = 0U;
+
+    k_sem_reset(&g_ota.idle);
+    (void)atomic_set(&g_ota.busy, 1);
+    k_sem_give(&g_ota.work);
+    return 0;
+}
+
+/*
+ * Every page boundary of the slot must be a sector boundary, otherwise erasing
+ * one page would take part of a sector with it (or be refused by the driver).
+ */
+static int gw_ota_check_layout(uint8_t area_id)
+{
+    uint32_t count = ARRAY_SIZE(g_ota.sectors);
+    uint32_t off;
+    uint32_t end;
+    uint32_t i;
+    int rc;
+
+    if (g_ota.fa->fa_size % GW_OTA_PAGE_SIZE != 0U) {
+        return -EINVAL;
+    }
+
+    rc = flash_area_get_sectors(area_id, &count, g_ota.sectors);
+    if (rc != 0) {
+        return rc;
+    }
+
+    for (i = 0U; i < count; ++i) {
+        off = (uint32_t)g_ota.sectors[i].fs_off;
+        end = off + (uint32_t)g_ota.sectors[i].fs_size;
+        if (ROUND_UP(off + 1U, GW_OTA_PAGE_SIZE) < end) {
+            return -EINVAL;
+        }
+    }
+
+    return 0;
+}
+
+int gw_ota_init(gw_ota_ctx_t *ctx, const gw_ota_config_t *cfg)
+{
+    if (ctx == NULL || cfg == NULL) {
+        return -EINVAL;
+    }
+
+    (void)memset(ctx, 0, sizeof(*ctx));
+    ctx->config = *cfg;
+    ctx->state = GW_OTA_STATE_IDLE;
+
+    return gw_ota_writer_start();
+}
+
+int gw_ota_begin(gw_ota_ctx_t *ctx)
+{
+    uint8_t area_id;
+    ssize_t trailer;
+    int rc;
+
+    if (ctx == NULL) {
+        return -EINVAL;
+    }
+
+    if (ctx->state == GW_OTA_STATE_RECEIVING || ctx->state == GW_OTA_STATE_VERIFYING) {
+        return -EALREADY;
+    }
+
+    /* A failed transfer may still own the writer for one page or an erase. */
+    if (gw_ota_writer_active()) {
+        return -EBUSY;
+    }
+
+    rc = flash_img_init(&g_ota.img);
+    if (rc != 0) {
+        gw_ota_fail(ctx, rc);
+        return rc;
+    }
+
+    g_ota.fa = g_ota.img.flash_area;
+    area_id = flash_img_get_upload_slot();
+
+    rc = gw_ota_check_layout(area_id);
+    if (rc != 0) {
+        gw_ota_fail(ctx, rc);
+        return rc;
+    }
+
+    trailer = boot_get_area_trailer_status_offset(area_id);
+    if (trailer < 0) {
+        gw_ota_fail(ctx, (int)trailer);
+        return (int)trailer;
+    }
+
+    g_ota.trailer_off = ROUND_DOWN((uint32_t)trailer, GW_OTA_PAGE_SIZE);
+    g_ota.erase_trailer = true;
+    g_ota.ctx = ctx;
+    g_ota.fill = 0U;
+    g_ota.fill_len = 0U;
+    g_ota.write_off = 0U;
+    g_ota.erased_off = 0U;
+    (void)atomic_set(&g_ota.finishing, 0);
+    (void)atomic_set(&g_ota.error, 0);
+
+    (void)memset(&ctx->stats, 0, sizeof(ctx->stats));
+    ctx->bytes_received = 0U;
+    ctx->last_error = 0;
+    ctx->state = GW_OTA_STATE_RECEIVING;
+
+    /* An empty job clears the trailer and starts erasing the slot before the first chunk arrives. */
+    return gw_ota_submit(ctx, 0U);
+}
+
+int gw_ota_push_chunk(gw_ota_ctx_t *ctx, const uint8_t *chunk, size_t chunk_len)
+{
+    size_t done = 0U;
+    int rc;
+
+    if (ctx == NULL || chunk == NULL || chunk_len == 0U) {
+        return -EINVAL;
+    }
+
+    if (ctx->state != GW_OTA_STATE_RECEIVING) {
+        return -EPERM;
+    }
+
+    if (ctx->config.chunk_size > 0U && chunk_len > ctx->config.chunk_size) {
+        return -EMSGSIZE;
+    }
+
+    if ((size_t)ctx->bytes_received + chunk_len > g_ota.fa->fa_size) {
+        gw_ota_fail(ctx, -EFBIG);
+        return -EFBIG;
+    }
+
+    while (done < chunk_len) {
+        size_t n = MIN(chunk_len - done, (size_t)(GW_OTA_PAGE_SIZE - g_ota.fill_len));
+
+        (void)memcpy(&g_ota.pages[g_ota.fill][g_ota.fill_len], &chunk[done], n);
+        g_ota.fill_len += (uint32_t)n;
+        done += n;
+
+        if (g_ota.fill_len == GW_OTA_PAGE_SIZE) {
+            rc = gw_ota_submit(ctx, GW_OTA_PAGE_SIZE);
+            if (rc != 0) {
+                gw_ota_fail(ctx, rc);
+                return rc;
+            }
+        }
+    }
+
+    ctx->bytes_received += (uint32_t)chunk_len;
+    return 0;
+}
+
+int gw_ota_finish(gw_ota_ctx_t *ctx)
+{
+    uint32_t align;
+    uint32_t len;
+    int rc;
+
+    if (ctx == NULL) {
+        return -EINVAL;
+    }
+
+    if (ctx->state != GW_OTA_STATE_RECEIVING) {
+        return -EPERM;
+    }
+
+    (void)atomic_set(&g_ota.finishing, 1);
+
+    if (g_ota.fill_len > 0U) {
+        /* The tail is padded with the erased value up to the flash write block. */
+        align = MAX(flash_area_align(g_ota.fa), 1U);
+        len = ROUND_UP(g_ota.fill_len, align);
+        (void)memset(
+            &g_ota.pages[g_ota.fill][g_ota.fill_len],
+            flash_area_erased_val(g_ota.fa),
+            len - g_ota.fill_len);
+
+        rc = gw_ota_submit(ctx, len);
+        if (rc != 0) {
+            gw_ota_fail(ctx, rc);
+            return rc;
+        }
+    }
+
+    ctx->state = GW_OTA_STATE_VERIFYING;
+    return 0;
+}
+
+/*
+ * Once the last page is programmed the slot must hold an MCUboot image no larger
+ * than what was received. Signature checks stay with MCUboot at the next boot;
+ * the image is marked for a test swap and confirmed by the new firmware.
+ */
+int gw_ota_pump(gw_ota_ctx_t *ctx)
+{
+    struct mcuboot_img_header header;
+    int rc;
+
+    if (ctx == NULL) {
+        return -EINVAL;
+    }
+
+    if (ctx->state != GW_OTA_STATE_RECEIVING && ctx->state != GW_OTA_STATE_VERIFYING) {
+        return 0;
+    }
+
+    rc = (int)atomic_get(&g_ota.error);
+    if (rc != 0) {
+        gw_ota_fail(ctx, rc);
+        return 0;
+    }
+
+    /* The trailer written by boot_request_upgrade() must not meet a late erase. */
+    if (ctx->state != GW_OTA_STATE_VERIFYING || gw_ota_writer_active()) {
+        return 0;
+    }
+
+    rc = boot_read_bank_header(flash_img_get_upload_slot(), &header, sizeof(header));
+    if (rc == 0 && header.h.v1.image_size > ctx->bytes_received) {
+        rc = -EBADMSG;
+    }
+    if (rc == 0) {
+        rc = boot_request_upgrade(BOOT_UPGRADE_TEST);
+    }
+    if (rc != 0) {
+        gw_ota_fail(ctx, rc);
+        return 0;
+    }
+
+    ctx->state = GW_OTA_STATE_READY_TO_APPLY;
+    return 0;
+}
@@ -0,0 +1,10 @@
+#include <stdint.h>
+
+#include <zephyr/kernel.h>
+
+#include <gateway_engine/ports/gw_port_clock.h>
+
+uint32_t gw_port_clock_now_ms(void)
+{
+    return k_uptime_get_32();
+}
@@ -0,0 +1,10 @@
+#include <stdint.h>
+
+#include <zephyr/random/random.h>
+
+#include <gateway_engine/ports/gw_port_random.h>
+
+uint32_t gw_port_random_u32(void)
+{
+    return sys_rand32_get();
+}
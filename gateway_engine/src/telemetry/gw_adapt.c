@@ -0,0 +1,86 @@
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <gateway_engine/gw_adapt.h>
+
+#include "../gw_time.h"
+
+static bool congested(const gw_adapt_config_t *cfg, const gw_adapt_sample_t *s)
+{
+    return s->rtt_ms > cfg->target_latency_ms || s->send_latency_ms > cfg->target_latency_ms ||
+           s->backlog > cfg->target_backlog || s->rejected > 0U;
+}
+
+int gw_adapt_init(gw_adapt_t *adapt, const gw_adapt_config_t *cfg, uint32_t now_ms)
+{
+    if (adapt == NULL || cfg == NULL) {
+        return -EINVAL;
+    }
+
+    if (cfg->enabled &&
+        (cfg->period_ms == 0U || cfg->min_flush_ms == 0U || cfg->min_flush_ms > cfg->max_flush_ms ||
+         cfg->min_batch_points == 0U || cfg->min_batch_points > cfg->max_batch_points || cfg->flush_step_ms == 0U ||
+         cfg->batch_step_points == 0U || cfg->degrade_after == 0U)) {
+        return -EINVAL;
+    }
+
+    (void)memset(adapt, 0, sizeof(*adapt));
+    adapt->config = *cfg;
+    adapt->flush_ms = cfg->min_flush_ms;
+    adapt->batch_points = cfg->min_batch_points;
+    adapt->next_ms = now_ms + cfg->period_ms;
+    return 0;
+}
+
+bool gw_adapt_enabled(const gw_adapt_t *adapt)
+{
+    return adapt != NULL && adapt->config.enabled;
+}
+
+bool gw_adapt_update(gw_adapt_t *adapt, uint32_t now_ms, const gw_adapt_sample_t *sample)
+{
+    const gw_adapt_config_t *cfg;
+    bool hot;
+
+    if (!gw_adapt_enabled(adapt) || sample == NULL || !gw_deadline_reached(now_ms, adapt->next_ms)) {
+        return false;
+    }
+
+    cfg = &adapt->config;
+    adapt->next_ms = now_ms + cfg->period_ms;
+    adapt->stats.periods++;
+
+    hot = congested(cfg, sample);
+    if (hot) {
+        adapt->stats.congested++;
+        adapt->flush_ms = (adapt->flush_ms > cfg->max_flush_ms / 2U) ? cfg->max_flush_ms : adapt->flush_ms * 2U;
+        adapt->batch_points = (adapt->batch_points > cfg->max_batch_points / 2U) ? cfg->max_batch_points
+                                                                                  : (uint16_t)(adapt->batch_points * 2U);
+    } else {
+        adapt->flush_ms = (adapt->flush_ms > cfg->min_flush_ms + cfg->flush_step_ms)
+                              ? adapt->flush_ms - cfg->flush_step_ms
+                              : cfg->min_flush_ms;
+        adapt->batch_points = (adapt->batch_points > cfg->min_batch_points + cfg->batch_step_points)
+                                  ? (uint16_t)(adapt->batch_points - cfg->batch_step_points)
+                                  : cfg->min_batch_points;
+    }
+
+    /* streak counts periods that disagree with the current mode. */
+    if (hot != adapt->degraded) {
+        adapt->streak++;
+    } else {
+        adapt->streak = 0U;
+    }
+
+    if (adapt->streak >= cfg->degrade_after) {
+        adapt->degraded = hot;
+        adapt->streak = 0U;
+        if (hot) {
+            adapt->stats.degraded_entries++;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,354 @@
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <gateway_engine/gw_agg.h>
+
+#include "../gw_time.h"
+
+#define AGG_NONE 0xFFFFU
+
+static uint32_t bucket_len_ms(const gw_agg_rule_t *rule)
+{
+    return (rule->hop_ms > 0U) ? rule->hop_ms : rule->window_ms;
+}
+
+static uint16_t find_rule(const gw_agg_t *agg, uint16_t edge_id, uint16_t field_id)
+{
+    size_t i;
+
+    for (i = 0U; i < agg->config.rule_count; ++i) {
+        const gw_agg_rule_t *rule = &agg->config.rules[i];
+
+        if ((rule->edge_id == GW_AGG_ANY_EDGE || rule->edge_id == edge_id) &&
+            (rule->field_id == GW_AGG_ANY_FIELD || rule->field_id == field_id)) {
+            return (uint16_t)i;
+        }
+    }
+
+    return AGG_NONE;
+}
+
+static void bucket_reset(gw_agg_bucket_t *b)
+{
+    (void)memset(b, 0, sizeof(*b));
+}
+
+static gw_agg_signal_t *signal_create(gw_agg_t *agg, uint16_t edge_id, uint16_t field_id, uint16_t rule, uint32_t now_ms)
+{
+    const gw_agg_rule_t *r = &agg->config.rules[rule];
+    gw_agg_signal_t *sig;
+
+    if (agg->signal_count >= GW_AGG_MAX_SIGNALS) {
+        agg->stats.table_full++;
+        return NULL;
+    }
+
+    sig = &agg->signals[agg->signal_count++];
+    (void)memset(sig, 0, sizeof(*sig));
+    sig->edge_id = edge_id;
+    sig->field_id = field_id;
+    sig->rule = rule;
+    sig->buckets_used = (uint8_t)((r->hop_ms > 0U) ? (r->window_ms / r->hop_ms) : 1U);
+    sig->bucket_end_ms = now_ms + bucket_len_ms(r);
+    return sig;
+}
+
+/*
+ * Open addressing keyed by (edge, field). Fields without a rule are cached as
+ * AGG_NONE so the rule table is scanned once per field, never per sample.
+ */
+static gw_agg_signal_t *lookup_signal(gw_agg_t *agg, uint16_t edge_id, uint16_t field_id, uint32_t now_ms)
+{
+    uint32_t key = ((uint32_t)edge_id << 16) | field_id;
+    size_t pos = (size_t)((key * 2654435761U) % GW_AGG_INDEX_SIZE);
+    size_t probes;
+
+    for (probes = 0U; probes < GW_AGG_INDEX_SIZE; ++probes) {
+        gw_agg_index_t *idx = &agg->index[pos];
+
+        if (!idx->in_use) {
+            uint16_t rule = find_rule(agg, edge_id, field_id);
+            gw_agg_signal_t *sig = NULL;
+
+            if (rule != AGG_NONE) {
+                sig = signal_create(agg, edge_id, field_id, rule, now_ms);
+            }
+
+            idx->in_use = true;
+            idx->edge_id = edge_id;
+            idx->field_id = field_id;
+            idx->signal = (sig != NULL) ? (uint16_t)(sig - agg->signals) : AGG_NONE;
+            return sig;
+        }
+
+        if (idx->edge_id == edge_id && idx->field_id == field_id) {
+            return (idx->signal != AGG_NONE) ? &agg->signals[idx->signal] : NULL;
+        }
+
+        pos = (pos + 1U) % GW_AGG_INDEX_SIZE;
+    }
+
+    agg->stats.table_full++;
+    return NULL;
+}
+
+static void bucket_add(const gw_agg_rule_t *rule, gw_agg_bucket_t *b, float v)
+{
+    if (b->count == 0U) {
+        b->min = v;
+        b->max = v;
+    } else {
+        if (v < b->min) {
+            b->min = v;
+        }
+        if (v > b->max) {
+            b->max = v;
+        }
+    }
+
+    b->sum += v;
+    b->last = v;
+    b->count++;
+
+#if GW_AGG_SKETCH_BINS > 0
+    {
+        float span = rule->sketch_max - rule->sketch_min;
+        size_t bin = 0U;
+
+        if (span > 0.0f && v > rule->sketch_min) {
+            bin = (size_t)(((v - rule->sketch_min) * (float)GW_AGG_SKETCH_BINS) / span);
+            if (bin >= GW_AGG_SKETCH_BINS) {
+                bin = GW_AGG_SKETCH_BINS - 1U;
+            }
+        }
+        if (b->bins[bin] < UINT16_MAX) {
+            b->bins[bin]++;
+        }
+    }
+#else
+    (void)rule;
+#endif
+}
+
+#if GW_AGG_SKETCH_BINS > 0
+/* Linear interpolation inside the histogram bin that holds the requested rank. */
+static float sketch_quantile(const gw_agg_rule_t *rule, const uint32_t bins[GW_AGG_SKETCH_BINS], uint32_t total, float q)
+{
+    float width = (rule->sketch_max - rule->sketch_min) / (float)GW_AGG_SKETCH_BINS;
+    float rank = q * (float)total;
+    uint32_t seen = 0U;
+    size_t i;
+
+    for (i = 0U; i < GW_AGG_SKETCH_BINS; ++i) {
+        if (bins[i] > 0U && (float)(seen + bins[i]) >= rank) {
+            float frac = (rank - (float)seen) / (float)bins[i];
+
+            return rule->sketch_min + width * ((float)i + frac);
+        }
+        seen += bins[i];
+    }
+
+    return rule->sketch_max;
+}
+#endif
+
+static void emit_window(gw_agg_t *agg, const gw_agg_signal_t *sig)
+{
+    const gw_agg_rule_t *rule = &agg->config.rules[sig->rule];
+    gw_agg_bucket_t sum;
+    gw_codec_record_t rec;
+    size_t i;
+#if GW_AGG_SKETCH_BINS > 0
+    uint32_t bins[GW_AGG_SKETCH_BINS];
+    uint32_t total = 0U;
+    size_t j;
+
+    (void)memset(bins, 0, sizeof(bins));
+#endif
+
+    bucket_reset(&sum);
+
+    /* Oldest to newest, so last ends up as the newest sample. */
+    for (i = 1U; i <= sig->buckets_used; ++i) {
+        const gw_agg_bucket_t *b = &sig->buckets[(sig->head + i) % sig->buckets_used];
+
+        if (b->count == 0U) {
+            continue;
+        }
+
+        if (sum.count == 0U || b->min < sum.min) {
+            sum.min = b->min;
+        }
+        if (sum.count == 0U || b->max > sum.max) {
+            sum.max = b->max;
+        }
+        sum.sum += b->sum;
+        sum.last = b->last;
+        sum.count += b->count;
+
+#if GW_AGG_SKETCH_BINS > 0
+        for (j = 0U; j < GW_AGG_SKETCH_BINS; ++j) {
+            bins[j] += b->bins[j];
+            total += b->bins[j];
+        }
+#endif
+    }
+
+    if (sum.count == 0U || agg->emit == NULL) {
+        return;
+    }
+
+    gw_codec_record_init(&rec);
+    (void)gw_codec_record_add_uint(&rec, GW_AGG_FIELD_SOURCE, sig->field_id);
+    (void)gw_codec_record_add_uint(&rec, GW_AGG_FIELD_COUNT, sum.count);
+    (void)gw_codec_record_add_float(&rec, GW_AGG_FIELD_SUM, sum.sum);
+    (void)gw_codec_record_add_float(&rec, GW_AGG_FIELD_MIN, sum.min);
+    (void)gw_codec_record_add_float(&rec, GW_AGG_FIELD_MAX, sum.max);
+    (void)gw_codec_record_add_float(&rec, GW_AGG_FIELD_LAST, sum.last);
+    (void)gw_codec_record_add_float(&rec, GW_AGG_FIELD_AVG, sum.sum / (float)sum.count);
+    (void)gw_codec_record_add_uint(&rec, GW_AGG_FIELD_WINDOW_MS, rule->window_ms);
+#if GW_AGG_SKETCH_BINS > 0
+    if (total > 0U && rule->sketch_max > rule->sketch_min) {
+        (void)gw_codec_record_add_float(&rec, GW_AGG_FIELD_P50, sketch_quantile(rule, bins, total, 0.50f));
+        (void)gw_codec_record_add_float(&rec, GW_AGG_FIELD_P90, sketch_quantile(rule, bins, total, 0.90f));
+        (void)gw_codec_record_add_float(&rec, GW_AGG_FIELD_P99, sketch_quantile(rule, bins, total, 0.99f));
+    }
+#endif
+
+    agg->stats.summaries++;
+    agg->emit(agg->user_data, sig->edge_id, rule->slot, &rec);
+}
+
+static bool window_empty(const gw_agg_signal_t *sig)
+{
+    size_t i;
+
+    for (i = 0U; i < sig->buckets_used; ++i) {
+        if (sig->buckets[i].count > 0U) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* Emits one summary per elapsed hop while the window still holds samples, then realigns. */
+static void rollover(gw_agg_t *agg, gw_agg_signal_t *sig, uint32_t now_ms)
+{
+    uint32_t len = bucket_len_ms(&agg->config.rules[sig->rule]);
+
+    while (gw_deadline_reached(now_ms, sig->bucket_end_ms)) {
+        if (window_empty(sig)) {
+            sig->bucket_end_ms += (((now_ms - sig->bucket_end_ms) / len) + 1U) * len;
+            return;
+        }
+
+        emit_window(agg, sig);
+        sig->head = (uint8_t)((sig->head + 1U) % sig->buckets_used);
+        bucket_reset(&sig->buckets[sig->head]);
+        sig->bucket_end_ms += len;
+    }
+}
+
+int gw_agg_init(gw_agg_t *agg, const gw_agg_config_t *cfg, gw_agg_emit_cb emit, void *user_data)
+{
+    size_t i;
+
+    if (agg == NULL || cfg == NULL) {
+        return -EINVAL;
+    }
+
+    if ((cfg->rules == NULL && cfg->rule_count > 0U) || cfg->rule_count >= AGG_NONE) {
+        return -EINVAL;
+    }
+
+    for (i = 0U; i < cfg->rule_count; ++i) {
+        const gw_agg_rule_t *r = &cfg->rules[i];
+
+        if (r->window_ms == 0U) {
+            return -EINVAL;
+        }
+
+        if (r->hop_ms > 0U &&
+            (r->hop_ms > r->window_ms || (r->window_ms % r->hop_ms) != 0U ||
+             (r->window_ms / r->hop_ms) > GW_AGG_MAX_BUCKETS)) {
+            return -EINVAL;
+        }
+    }
+
+    (void)memset(agg, 0, sizeof(*agg));
+    agg->config = *cfg;
+    agg->emit = emit;
+    agg->user_data = user_data;
+    return 0;
+}
+
+bool gw_agg_enabled(const gw_agg_t *agg)
+{
+    return agg != NULL && agg->config.rule_count > 0U;
+}
+
+int gw_agg_feed(gw_agg_t *agg, uint16_t edge_id, uint32_t now_ms, gw_codec_record_t *rec)
+{
+    bool consumed = false;
+    uint8_t kept = 0U;
+    size_t i;
+
+    if (agg == NULL || rec == NULL) {
+        return -EINVAL;
+    }
+
+    for (i = 0U; i < rec->count; ++i) {
+        const gw_codec_field_t *f = &rec->fields[i];
+        gw_agg_signal_t *sig = NULL;
+
+        if (f->id != GW_CODEC_FIELD_QUALITY) {
+            sig = lookup_signal(agg, edge_id, f->id, now_ms);
+        }
+
+        if (sig != NULL && agg->config.rules[sig->rule].pressure_only && !agg->degraded) {
+            sig = NULL;
+        }
+
+        if (sig == NULL) {
+            rec->fields[kept++] = *f;
+            continue;
+        }
+
+        rollover(agg, sig, now_ms);
+        bucket_add(&agg->config.rules[sig->rule], &sig->buckets[sig->head], gw_codec_field_as_float(f));
+        agg->stats.samples++;
+        consumed = true;
+    }
+
+    rec->count = kept;
+
+    /* A quality field left on its own qualifies nothing. */
+    if (consumed && kept == 1U && rec->fields[0].id == GW_CODEC_FIELD_QUALITY) {
+        rec->count = 0U;
+    }
+
+    return 0;
+}
+
+void gw_agg_set_degraded(gw_agg_t *agg, bool degraded)
+{
+    if (agg != NULL) {
+        agg->degraded = degraded;
+    }
+}
+
+void gw_agg_poll(gw_agg_t *agg, uint32_t now_ms)
+{
+    size_t i;
+
+    if (agg == NULL) {
+        return;
+    }
+
+    for (i = 0U; i < agg->signal_count; ++i) {
+        rollover(agg, &agg->signals[i], now_ms);
+    }
+}
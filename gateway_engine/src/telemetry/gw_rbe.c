@@ -0,0 +1,263 @@
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <gateway_engine/gw_rbe.h>
+
+#define RBE_NO_BAND 0xFFFFU
+
+static uint16_t find_band(const gw_rbe_t *rbe, uint16_t edge_id, uint16_t field_id)
+{
+    size_t i;
+
+    for (i = 0U; i < rbe->config.band_count; ++i) {
+        const gw_rbe_band_t *band = &rbe->config.bands[i];
+
+        if ((band->edge_id == GW_RBE_ANY_EDGE || band->edge_id == edge_id) &&
+            (band->field_id == GW_RBE_ANY_FIELD || band->field_id == field_id)) {
+            return (uint16_t)i;
+        }
+    }
+
+    return RBE_NO_BAND;
+}
+
+/*
+ * Open addressing keyed by (edge, field). Fields without a band get an entry
+ * too, so the band table is scanned once per signal and never per sample.
+ */
+static gw_rbe_signal_t *lookup_signal(gw_rbe_t *rbe, uint16_t edge_id, uint16_t field_id)
+{
+    uint32_t key = ((uint32_t)edge_id << 16) | field_id;
+    size_t pos = (size_t)((key * 2654435761U) % GW_RBE_MAX_SIGNALS);
+    size_t probes;
+
+    for (probes = 0U; probes < GW_RBE_MAX_SIGNALS; ++probes) {
+        gw_rbe_signal_t *sig = &rbe->signals[pos];
+
+        if (!sig->in_use) {
+            (void)memset(sig, 0, sizeof(*sig));
+            sig->in_use = true;
+            sig->edge_id = edge_id;
+            sig->field_id = field_id;
+            sig->band = find_band(rbe, edge_id, field_id);
+            rbe->signal_count++;
+            return sig;
+        }
+
+        if (sig->edge_id == edge_id && sig->field_id == field_id) {
+            return sig;
+        }
+
+        pos = (pos + 1U) % GW_RBE_MAX_SIGNALS;
+    }
+
+    return NULL;
+}
+
+static bool value_changed(const gw_rbe_band_t *band, const gw_codec_field_t *last, const gw_codec_field_t *f)
+{
+    float prev;
+    float delta;
+    float cur;
+
+    if (f->type != last->type) {
+        return true;
+    }
+
+    if (f->type == GW_CODEC_VALUE_BOOL) {
+        return f->value.b != last->value.b;
+    }
+
+    if (band->abs_deadband <= 0.0f && band->pct_deadband <= 0.0f) {
+        return f->value.u != last->value.u;
+    }
+
+    prev = gw_codec_field_as_float(last);
+    cur = gw_codec_field_as_float(f);
+    delta = (cur > prev) ? (cur - prev) : (prev - cur);
+    if (prev < 0.0f) {
+        prev = -prev;
+    }
+
+    if (band->abs_deadband > 0.0f && delta > band->abs_deadband) {
+        return true;
+    }
+
+    return band->pct_deadband > 0.0f && delta > (band->pct_deadband * prev) / 100.0f;
+}
+
+static bool must_report(gw_rbe_t *rbe, gw_rbe_signal_t *sig, const gw_codec_field_t *f, uint32_t quality, uint32_t now_ms)
+{
+    const gw_rbe_band_t *band;
+
+    if (sig == NULL) {
+        rbe->stats.table_full++;
+        return true;
+    }
+
+    if (sig->band == RBE_NO_BAND) {
+        return true;
+    }
+
+    band = &rbe->config.bands[sig->band];
+
+    if (!sig->reported) {
+        return true;
+    }
+
+    if (quality != sig->quality) {
+        rbe->stats.forced_quality++;
+        return true;
+    }
+
+    if (band->integrity_ms > 0U && (now_ms - sig->last_sent_ms) >= band->integrity_ms) {
+        rbe->stats.forced_integrity++;
+        return true;
+    }
+
+    return value_changed(band, &sig->last, f);
+}
+
+/* Quality codes are unsigned integers; integral floats are accepted, anything else is not a code. */
+static int quality_code(const gw_codec_field_t *f, uint32_t *out)
+{
+    switch (f->type) {
+    case GW_CODEC_VALUE_UINT:
+        *out = f->value.u;
+        return 0;
+    case GW_CODEC_VALUE_INT:
+        if (f->value.i < 0) {
+            return -EINVAL;
+        }
+        *out = (uint32_t)f->value.i;
+        return 0;
+    case GW_CODEC_VALUE_FLOAT:
+        if (!(f->value.f >= 0.0f && f->value.f <= 4294967040.0f) || f->value.f != (float)(uint32_t)f->value.f) {
+            return -EINVAL;
+        }
+        *out = (uint32_t)f->value.f;
+        return 0;
+    case GW_CODEC_VALUE_BOOL:
+    default:
+        return -EINVAL;
+    }
+}
+
+int gw_rbe_init(gw_rbe_t *rbe, const gw_rbe_config_t *cfg)
+{
+    if (rbe == NULL || cfg == NULL) {
+        return -EINVAL;
+    }
+
+    if (cfg->bands == NULL && cfg->band_count > 0U) {
+        return -EINVAL;
+    }
+
+    if (cfg->band_count >= RBE_NO_BAND) {
+        return -EINVAL;
+    }
+
+    (void)memset(rbe, 0, sizeof(*rbe));
+    rbe->config = *cfg;
+    return 0;
+}
+
+bool gw_rbe_enabled(const gw_rbe_t *rbe)
+{
+    return rbe != NULL && rbe->config.band_count > 0U;
+}
+
+/*
+ * The edge's quality is tracked as its own signal under GW_CODEC_FIELD_QUALITY.
+ * A record without a quality field counts as good (0).
+ */
+int gw_rbe_filter(gw_rbe_t *rbe, uint16_t edge_id, uint32_t now_ms, const gw_codec_record_t *in, gw_codec_record_t *out)
+{
+    bool has_quality = false;
+    bool quality_changed;
+    gw_rbe_signal_t *q;
+    uint32_t quality = 0U;
+    size_t i;
+
+    if (rbe == NULL || in == NULL || out == NULL) {
+        return -EINVAL;
+    }
+
+    for (i = 0U; i < in->count; ++i) {
+        if (in->fields[i].id == GW_CODEC_FIELD_QUALITY) {
+            if (quality_code(&in->fields[i], &quality) != 0) {
+                rbe->stats.quality_rejected++;
+                return -EINVAL;
+            }
+            has_quality = true;
+            break;
+        }
+    }
+
+    q = lookup_signal(rbe, edge_id, GW_CODEC_FIELD_QUALITY);
+    quality_changed = (q == NULL) || !q->reported || q->last.value.u != quality;
+
+    gw_codec_record_init(out);
+
+    for (i = 0U; i < in->count; ++i) {
+        const gw_codec_field_t *f = &in->fields[i];
+        gw_rbe_signal_t *sig;
+
+        if (f->id == GW_CODEC_FIELD_QUALITY) {
+            continue;
+        }
+
+        rbe->stats.fields_in++;
+        sig = lookup_signal(rbe, edge_id, f->id);
+        if (!must_report(rbe, sig, f, quality, now_ms)) {
+            continue;
+        }
+
+        if (sig != NULL) {
+            sig->reported = true;
+            sig->quality = quality;
+            sig->last_sent_ms = now_ms;
+            sig->last = *f;
+        }
+
+        out->fields[out->count++] = *f;
+        rbe->stats.fields_out++;
+    }
+
+    /*
+     * The quality travels with whatever is reported so the cloud can qualify
+     * it, and goes out on its own when it is the only thing that changed.
+     */
+    if (((out->count > 0U && has_quality) || quality_changed) && out->count < GW_CODEC_MAX_FIELDS) {
+        gw_codec_field_t *f = &out->fields[out->count++];
+
+        f->id = GW_CODEC_FIELD_QUALITY;
+        f->type = GW_CODEC_VALUE_UINT;
+        f->value.u = quality;
+    }
+
+    if (q != NULL && quality_changed) {
+        q->reported = true;
+        q->last_sent_ms = now_ms;
+        q->last.id = GW_CODEC_FIELD_QUALITY;
+        q->last.type = GW_CODEC_VALUE_UINT;
+        q->last.value.u = quality;
+    }
+
+    return 0;
+}
+
+void gw_rbe_reset(gw_rbe_t *rbe)
+{
+    size_t i;
+
+    if (rbe == NULL) {
+        return;
+    }
+
+    for (i = 0U; i < GW_RBE_MAX_SIGNALS; ++i) {
+        rbe->signals[i].reported = false;
+    }
+}
@@ -0,0 +1,228 @@
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <gateway_engine/gw_rules.h>
+
+static uint32_t rule_key(uint16_t edge_id, uint16_t field_id)
+{
+    return ((uint32_t)edge_id << 16) | field_id;
+}
+
+static size_t index_slot(uint16_t edge_id, uint16_t field_id)
+{
+    return (size_t)((rule_key(edge_id, field_id) * 2654435761U) % GW_RULES_INDEX_SIZE);
+}
+
+static const gw_rules_index_t *index_find(const gw_rules_t *rules, uint16_t edge_id, uint16_t field_id)
+{
+    size_t pos = index_slot(edge_id, field_id);
+    size_t probes;
+
+    for (probes = 0U; probes < GW_RULES_INDEX_SIZE; ++probes) {
+        const gw_rules_index_t *idx = &rules->index[pos];
+
+        if (!idx->in_use) {
+            return NULL;
+        }
+
+        if (idx->edge_id == edge_id && idx->field_id == field_id) {
+            return idx;
+        }
+
+        pos = (pos + 1U) % GW_RULES_INDEX_SIZE;
+    }
+
+    return NULL;
+}
+
+static void index_build(gw_rules_t *rules)
+{
+    size_t i = 0U;
+
+    (void)memset(rules->index, 0, sizeof(rules->index));
+
+    while (i < rules->rule_count) {
+        const gw_rule_t *r = &rules->rules[i];
+        size_t pos = index_slot(r->src_edge, r->field_id);
+        size_t end = i + 1U;
+
+        while (end < rules->rule_count && rules->rules[end].src_edge == r->src_edge &&
+               rules->rules[end].field_id == r->field_id) {
+            end++;
+        }
+
+        /* Never full: there are at most GW_RULES_MAX keys for twice as many slots. */
+        while (rules->index[pos].in_use) {
+            pos = (pos + 1U) % GW_RULES_INDEX_SIZE;
+        }
+
+        rules->index[pos].in_use = true;
+        rules->index[pos].edge_id = r->src_edge;
+        rules->index[pos].field_id = r->field_id;
+        rules->index[pos].first = (uint8_t)i;
+        rules->index[pos].count = (uint8_t)(end - i);
+        i = end;
+    }
+}
+
+static bool rule_valid(const gw_rule_t *r)
+{
+    if (r->kind > GW_RULE_HYSTERESIS || r->op > GW_RULE_BELOW) {
+        return false;
+    }
+
+    if (r->action_len == 0U || r->action_len > GW_RULES_ACTION_MAX || r->release_len > GW_RULES_ACTION_MAX) {
+        return false;
+    }
+
+    if (r->kind == GW_RULE_HYSTERESIS) {
+        return (r->op == GW_RULE_ABOVE) ? (r->reset < r->threshold) : (r->reset > r->threshold);
+    }
+
+    return true;
+}
+
+int gw_rules_load(gw_rules_t *rules, const gw_rule_t *table, size_t count)
+{
+    size_t i;
+    size_t j;
+
+    if (rules == NULL || (table == NULL && count > 0U) || count > GW_RULES_MAX) {
+        return -EINVAL;
+    }
+
+    for (i = 0U; i < count; ++i) {
+        if (!rule_valid(&table[i])) {
+            return -EINVAL;
+        }
+    }
+
+    /* Insertion sort by key keeps the table order among rules on the same field. */
+    for (i = 0U; i < count; ++i) {
+        uint32_t key = rule_key(table[i].src_edge, table[i].field_id);
+
+        j = i;
+        while (j > 0U && rule_key(rules->rules[j - 1U].src_edge, rules->rules[j - 1U].field_id) > key) {
+            rules->rules[j] = rules->rules[j - 1U];
+            j--;
+        }
+        rules->rules[j] = table[i];
+    }
+
+    rules->rule_count = (uint8_t)count;
+    (void)memset(rules->state, 0, sizeof(rules->state));
+    index_build(rules);
+    return 0;
+}
+
+int gw_rules_init(gw_rules_t *rules, const gw_rules_config_t *cfg, gw_rules_emit_cb emit, void *user_data)
+{
+    if (rules == NULL || cfg == NULL) {
+        return -EINVAL;
+    }
+
+    (void)memset(rules, 0, sizeof(*rules));
+    rules->emit = emit;
+    rules->user_data = user_data;
+    return gw_rules_load(rules, cfg->rules, cfg->rule_count);
+}
+
+bool gw_rules_enabled(const gw_rules_t *rules)
+{
+    return rules != NULL && rules->rule_count > 0U;
+}
+
+static void emit(gw_rules_t *rules, uint16_t dst_edge, const uint8_t *payload, uint8_t len)
+{
+    if (rules->emit != NULL && len > 0U) {
+        rules->emit(rules->user_data, dst_edge, payload, len);
+    }
+}
+
+static void eval_rule(gw_rules_t *rules, size_t i, float v, uint32_t now_ms)
+{
+    const gw_rule_t *r = &rules->rules[i];
+    gw_rule_state_t *st = &rules->state[i];
+    bool cond = (r->op == GW_RULE_ABOVE) ? (v > r->threshold) : (v < r->threshold);
+    bool idle;
+
+    rules->stats.evaluated++;
+
+    switch (r->kind) {
+    case GW_RULE_LEVEL:
+        if (!cond) {
+            return;
+        }
+        if (st->fired_once && (now_ms - st->last_fire_ms) < r->min_interval_ms) {
+            rules->stats.throttled++;
+            return;
+        }
+        st->fired_once = true;
+        st->last_fire_ms = now_ms;
+        rules->stats.fired++;
+        emit(rules, r->dst_edge, r->action, r->action_len);
+        return;
+
+    case GW_RULE_EDGE:
+    case GW_RULE_HYSTERESIS:
+    default:
+        if (!st->active && cond) {
+            st->active = true;
+            st->last_fire_ms = now_ms;
+            rules->stats.fired++;
+            emit(rules, r->dst_edge, r->action, r->action_len);
+            return;
+        }
+
+        if (!st->active) {
+            return;
+        }
+
+        if (r->kind == GW_RULE_HYSTERESIS) {
+            idle = (r->op == GW_RULE_ABOVE) ? (v < r->reset) : (v > r->reset);
+        } else {
+            idle = !cond;
+        }
+
+        if (idle) {
+            st->active = false;
+            rules->stats.released++;
+            emit(rules, r->dst_edge, r->release, r->release_len);
+        }
+        return;
+    }
+}
+
+static void eval_run(gw_rules_t *rules, const gw_rules_index_t *idx, float v, uint32_t now_ms)
+{
+    size_t i;
+
+    if (idx == NULL) {
+        return;
+    }
+
+    for (i = idx->first; i < (size_t)idx->first + idx->count; ++i) {
+        eval_rule(rules, i, v, now_ms);
+    }
+}
+
+void gw_rules_eval(gw_rules_t *rules, uint16_t edge_id, uint32_t now_ms, const gw_codec_record_t *rec)
+{
+    size_t i;
+
+    if (rules == NULL || rec == NULL || rules->rule_count == 0U) {
+        return;
+    }
+
+    for (i = 0U; i < rec->count; ++i) {
+        const gw_codec_field_t *f = &rec->fields[i];
+        float v = gw_codec_field_as_float(f);
+
+        eval_run(rules, index_find(rules, edge_id, f->id), v, now_ms);
+        if (edge_id != GW_RULES_ANY_EDGE) {
+            eval_run(rules, index_find(rules, GW_RULES_ANY_EDGE, f->id), v, now_ms);
+        }
+    }
+}
@@ -0,0 +1,306 @@
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <gateway_engine/gw_shadow.h>
+
+static bool field_equal(const gw_codec_field_t *a, const gw_codec_field_t *b)
+{
+    if (a->type != b->type) {
+        return false;
+    }
+
+    if (a->type == GW_CODEC_VALUE_BOOL) {
+        return a->value.b == b->value.b;
+    }
+
+    return a->value.u == b->value.u;
+}
+
+static bool reserved_id(uint16_t id)
+{
+    return id == GW_SHADOW_FIELD_VERSION || id == GW_SHADOW_FIELD_DESIRED_VERSION ||
+           id == GW_SHADOW_FIELD_ACKED_VERSION;
+}
+
+/* Linear: a shadow holds at most one record worth of fields. */
+static gw_shadow_field_t *find_field(gw_shadow_t *shadow, uint16_t id, bool create)
+{
+    gw_shadow_field_t *sf;
+    size_t i;
+
+    for (i = 0U; i < shadow->field_count; ++i) {
+        if (shadow->fields[i].id == id) {
+            return &shadow->fields[i];
+        }
+    }
+
+    if (!create) {
+        return NULL;
+    }
+
+    if (shadow->field_count >= GW_SHADOW_MAX_FIELDS) {
+        shadow->stats.table_full++;
+        return NULL;
+    }
+
+    sf = &shadow->fields[shadow->field_count++];
+    (void)memset(sf, 0, sizeof(*sf));
+    sf->id = id;
+    return sf;
+}
+
+static void set_reported(gw_shadow_t *shadow, gw_shadow_field_t *sf, const gw_codec_field_t *f)
+{
+    if (sf->has_reported && field_equal(&sf->reported, f)) {
+        return;
+    }
+
+    sf->reported = *f;
+    sf->reported.id = sf->id;
+    sf->has_reported = true;
+    sf->dirty = true;
+    shadow->version++;
+    shadow->stats.reported_updates++;
+}
+
+int gw_shadow_init(gw_shadow_t *shadow, const gw_shadow_config_t *cfg)
+{
+    if (shadow == NULL || cfg == NULL) {
+        return -EINVAL;
+    }
+
+    if (cfg->enabled && cfg->ack_timeout_ms == 0U) {
+        return -EINVAL;
+    }
+
+    (void)memset(shadow, 0, sizeof(*shadow));
+    shadow->config = *cfg;
+    return 0;
+}
+
+bool gw_shadow_enabled(const gw_shadow_t *shadow)
+{
+    return shadow != NULL && shadow->config.enabled;
+}
+
+void gw_shadow_report(gw_shadow_t *shadow, const gw_codec_record_t *rec)
+{
+    size_t i;
+
+    if (shadow == NULL || rec == NULL) {
+        return;
+    }
+
+    for (i = 0U; i < rec->count; ++i) {
+        const gw_codec_field_t *f = &rec->fields[i];
+        gw_shadow_field_t *sf;
+
+        if (reserved_id(f->id)) {
+            continue;
+        }
+
+        sf = find_field(shadow, f->id, true);
+        if (sf != NULL) {
+            set_reported(shadow, sf, f);
+        }
+    }
+}
+
+/* Fields of rec the shadow does not hold yet, each id counted once. */
+static size_t new_field_count(gw_shadow_t *shadow, const gw_codec_record_t *rec)
+{
+    size_t count = 0U;
+    size_t i;
+    size_t j;
+
+    for (i = 0U; i < rec->count; ++i) {
+        uint16_t id = rec->fields[i].id;
+
+        if (reserved_id(id) || find_field(shadow, id, false) != NULL) {
+            continue;
+        }
+
+        for (j = 0U; j < i && rec->fields[j].id != id; ++j) {
+        }
+
+        if (j == i) {
+            count++;
+        }
+    }
+
+    return count;
+}
+
+/* All or nothing: a record that does not fit leaves the shadow untouched. */
+int gw_shadow_set_desired(gw_shadow_t *shadow, const gw_codec_record_t *rec)
+{
+    bool changed = false;
+    size_t i;
+
+    if (shadow == NULL || rec == NULL) {
+        return -EINVAL;
+    }
+
+    if (shadow->field_count + new_field_count(shadow, rec) > GW_SHADOW_MAX_FIELDS) {
+        shadow->stats.table_full++;
+        return -ENOSPC;
+    }
+
+    for (i = 0U; i < rec->count; ++i) {
+        const gw_codec_field_t *f = &rec->fields[i];
+        gw_shadow_field_t *sf;
+
+        if (reserved_id(f->id)) {
+            continue;
+        }
+
+        sf = find_field(shadow, f->id, true);
+
+        if (sf->has_desired && field_equal(&sf->desired, f) && sf->has_reported &&
+            field_equal(&sf->reported, f)) {
+            continue;
+        }
+
+        if (!changed) {
+            shadow->desired_version++;
+            changed = true;
+        }
+
+        sf->desired = *f;
+        sf->has_desired = true;
+        sf->pending = true;
+        sf->desired_version = shadow->desired_version;
+    }
+
+    if (changed) {
+        shadow->desired_dirty = true;
+        shadow->stats.desired_updates++;
+    }
+
+    return 0;
+}
+
+void gw_shadow_desired(const gw_shadow_t *shadow, bool all, gw_codec_record_t *out)
+{
+    size_t i;
+
+    gw_codec_record_init(out);
+
+    for (i = 0U; i < shadow->field_count; ++i) {
+        const gw_shadow_field_t *sf = &shadow->fields[i];
+
+        if (sf->has_desired && (all || sf->pending)) {
+            out->fields[out->count++] = sf->desired;
+        }
+    }
+}
+
+void gw_shadow_ack(gw_shadow_t *shadow, uint32_t desired_version)
+{
+    size_t i;
+
+    if (shadow == NULL) {
+        return;
+    }
+
+    for (i = 0U; i < shadow->field_count; ++i) {
+        gw_shadow_field_t *sf = &shadow->fields[i];
+
+        /* A value changed again while the frame was in flight stays pending. */
+        if (sf->pending && (int32_t)(desired_version - sf->desired_version) >= 0) {
+            sf->pending = false;
+            set_reported(shadow, sf, &sf->desired);
+        }
+    }
+
+    if ((int32_t)(desired_version - shadow->acked_version) > 0) {
+        shadow->acked_version = desired_version;
+        shadow->desired_dirty = true;
+    }
+    shadow->stats.acks++;
+}
+
+bool gw_shadow_has_delta(const gw_shadow_t *shadow)
+{
+    size_t i;
+
+    if (shadow->desired_dirty) {
+        return true;
+    }
+
+    for (i = 0U; i < shadow->field_count; ++i) {
+        if (shadow->fields[i].dirty) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void gw_shadow_document(
+    const gw_shadow_t *shadow,
+    bool full,
+    gw_codec_record_t *reported,
+    gw_codec_record_t *desired)
+{
+    size_t i;
+
+    gw_codec_record_init(reported);
+    gw_shadow_desired(shadow, false, desired);
+
+    for (i = 0U; i < shadow->field_count; ++i) {
+        const gw_shadow_field_t *sf = &shadow->fields[i];
+
+        if (sf->has_reported && (full || sf->dirty)) {
+            reported->fields[reported->count++] = sf->reported;
+        }
+    }
+
+    (void)gw_codec_record_add_uint(reported, GW_SHADOW_FIELD_VERSION, shadow->version);
+    (void)gw_codec_record_add_uint(desired, GW_SHADOW_FIELD_DESIRED_VERSION, shadow->desired_version);
+    (void)gw_codec_record_add_uint(desired, GW_SHADOW_FIELD_ACKED_VERSION, shadow->acked_version);
+}
+
+int gw_shadow_encode(
+    const gw_codec_record_t *reported,
+    const gw_codec_record_t *desired,
+    uint8_t *out_buf,
+    size_t out_cap,
+    size_t *out_len)
+{
+    size_t reported_len = 0U;
+    size_t desired_len = 0U;
+    int rc;
+
+    if (reported == NULL || desired == NULL || out_buf == NULL || out_len == NULL || out_cap == 0U) {
+        return -EINVAL;
+    }
+
+    /* CBOR array header with two items. */
+    out_buf[0] = 0x82U;
+
+    rc = gw_codec_encode_cbor(reported, &out_buf[1], out_cap - 1U, &reported_len);
+    if (rc != 0) {
+        return rc;
+    }
+
+    rc = gw_codec_encode_cbor(desired, &out_buf[1U + reported_len], out_cap - 1U - reported_len, &desired_len);
+    if (rc != 0) {
+        return rc;
+    }
+
+    *out_len = 1U + reported_len + desired_len;
+    return 0;
+}
+
+void gw_shadow_clear_delta(gw_shadow_t *shadow)
+{
+    size_t i;
+
+    shadow->desired_dirty = false;
+    for (i = 0U; i < shadow->field_count; ++i) {
+        shadow->fields[i].dirty = false;
+    }
+}
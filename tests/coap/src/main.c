@@ -0,0 +1,275 @@
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/net/coap.h>
+#include <zephyr/net/socket.h>
+#include <zephyr/posix/sys/socket.h>
+#include <zephyr/posix/unistd.h>
+#include <zephyr/ztest.h>
+
+#include <gateway_engine/gw_coap.h>
+#include <gateway_engine/gw_engine.h>
+
+#define COAP_PORT 5683U
+#define LOOP_MS 20U
+#define CON_INTERVAL_MS 200U
+#define LATENCY_SAMPLES 20U
+#define LATENCY_MAX_US 10000U
+#define EVICT_TIMEOUT_MS 10000
+#define SERVER_STACK_SIZE 4096
+#define SERVER_PRIORITY 5
+
+static gw_engine_t g_engine;
+static gw_transport_internal_t g_backend;
+static gw_transport_t g_transport;
+static uint8_t g_buf[256];
+
+K_THREAD_STACK_DEFINE(g_server_stack, SERVER_STACK_SIZE);
+static struct k_thread g_server_thread;
+
+static const char *const g_state_path[] = { "edge", "state", NULL };
+static const char *const g_metrics_path[] = { "metrics", NULL };
+
+/* The edge answers nothing; the test only talks to the CoAP side. */
+static int edge_exchange(
+    const uint8_t *tx_data,
+    size_t tx_len,
+    uint8_t *rx_data,
+    size_t rx_cap,
+    size_t *rx_len,
+    void *user_data)
+{
+    ARG_UNUSED(tx_data);
+    ARG_UNUSED(tx_len);
+    ARG_UNUSED(rx_data);
+    ARG_UNUSED(rx_cap);
+    ARG_UNUSED(user_data);
+
+    *rx_len = 0U;
+    return 0;
+}
+
+/* Same loop shape as the lab app: one engine step per tick, CoAP served as datagrams arrive. */
+static void server_loop(void *p1, void *p2, void *p3)
+{
+    ARG_UNUSED(p1);
+    ARG_UNUSED(p2);
+    ARG_UNUSED(p3);
+
+    while (true) {
+        uint32_t deadline_ms = k_uptime_get_32() + LOOP_MS;
+        int32_t left;
+
+        (void)gw_engine_step(&g_engine);
+        (void)gw_coap_poll();
+
+        while ((left = (int32_t)(deadline_ms - k_uptime_get_32())) > 0) {
+            if (gw_coap_wait((uint32_t)left) <= 0) {
+                break;
+            }
+            (void)gw_coap_poll();
+        }
+    }
+}
+
+static int client_open(void)
+{
+    struct sockaddr_in addr = { 0 };
+    struct timeval tv = { .tv_sec = 1 };
+    int sock;
+
+    sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    zassert_true(sock >= 0, "socket: %d", errno);
+
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(COAP_PORT);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    zassert_ok(connect(sock, (struct sockaddr *)&addr, sizeof(addr)));
+    zassert_ok(setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)));
+    return sock;
+}
+
+static void client_get(int sock, const char *const *path, int observe)
+{
+    static const uint8_t token[] = { 0x67, 0x77 };
+    struct coap_packet pkt;
+    size_t i;
+
+    zassert_ok(coap_packet_init(&pkt, g_buf, sizeof(g_buf), COAP_VERSION_1, COAP_TYPE_CON, sizeof(token), token,
+                                COAP_METHOD_GET, coap_next_id()));
+    if (observe >= 0) {
+        zassert_ok(coap_append_option_int(&pkt, COAP_OPTION_OBSERVE, (unsigned int)observe));
+    }
+    for (i = 0U; path[i] != NULL; ++i) {
+        zassert_ok(coap_packet_append_option(&pkt, COAP_OPTION_URI_PATH, (const uint8_t *)path[i], strlen(path[i])));
+    }
+
+    zassert_true(send(sock, pkt.data, pkt.offset, 0) == (ssize_t)pkt.offset);
+}
+
+static void client_empty(int sock, uint8_t type, uint16_t id)
+{
+    struct coap_packet pkt;
+
+    zassert_ok(coap_packet_init(&pkt, g_buf, sizeof(g_buf), COAP_VERSION_1, type, 0U, NULL, COAP_CODE_EMPTY, id));
+    zassert_true(send(sock, pkt.data, pkt.offset, 0) == (ssize_t)pkt.offset);
+}
+
+/* Waits up to the socket timeout for one message; returns -EAGAIN when none came. */
+static int client_recv(int sock, uint8_t *out_type, uint16_t *out_id, uint8_t *out_code)
+{
+    struct coap_packet pkt;
+    ssize_t len;
+
+    len = recv(sock, g_buf, sizeof(g_buf), 0);
+    if (len < 0) {
+        return -errno;
+    }
+
+    zassert_ok(coap_packet_parse(&pkt, g_buf, (uint16_t)len, NULL, 0));
+    *out_type = coap_header_get_type(&pkt);
+    *out_id = coap_header_get_id(&pkt);
+    *out_code = coap_header_get_code(&pkt);
+    return 0;
+}
+
+static void client_observe(int sock)
+{
+    uint8_t type;
+    uint16_t id;
+    uint8_t code;
+
+    client_get(sock, g_state_path, 0);
+    zassert_ok(client_recv(sock, &type, &id, &code));
+    zassert_equal(type, COAP_TYPE_ACK);
+    zassert_equal(code, COAP_RESPONSE_CODE_CONTENT);
+}
+
+static void *suite_setup(void)
+{
+    gw_transport_internal_config_t internal_cfg = { .exchange_cb = edge_exchange, .mtu = 256U };
+    gw_coap_config_t coap_cfg = { .port = COAP_PORT, .con_interval_ms = CON_INTERVAL_MS };
+    gw_engine_config_t engine_cfg;
+
+    zassert_ok(gw_transport_internal_init(&g_backend, &g_transport, &internal_cfg));
+
+    (void)memset(&engine_cfg, 0, sizeof(engine_cfg));
+    engine_cfg.profile = GW_PROFILE_LIGHTING_GATEWAY;
+    engine_cfg.device_id = "coap-test";
+    engine_cfg.loop_period_ms = LOOP_MS;
+    engine_cfg.shadow.enabled = true;
+    engine_cfg.shadow.ack_timeout_ms = 500U;
+
+    zassert_ok(gw_engine_init(&g_engine, &engine_cfg, &g_transport));
+    zassert_ok(gw_engine_start(&g_engine));
+    zassert_ok(gw_coap_start(&g_engine, &coap_cfg));
+
+    (void)k_thread_create(&g_server_thread, g_server_stack, K_THREAD_STACK_SIZEOF(g_server_stack), server_loop, NULL,
+                          NULL, NULL, SERVER_PRIORITY, 0, K_NO_WAIT);
+    return NULL;
+}
+
+/* GET round trips over loopback, sampled at phases that sweep the engine tick. */
+ZTEST(gw_coap, test_read_latency)
+{
+    uint32_t max_us = 0U;
+    uint64_t sum_us = 0U;
+    uint32_t i;
+    uint8_t type;
+    uint16_t id;
+    uint8_t code;
+    int sock = client_open();
+
+    for (i = 0U; i < LATENCY_SAMPLES; ++i) {
+        int64_t start = k_uptime_ticks();
+        uint32_t us;
+
+        client_get(sock, g_metrics_path, -1);
+        zassert_ok(client_recv(sock, &type, &id, &code));
+        us = (uint32_t)k_ticks_to_us_ceil64((uint64_t)(k_uptime_ticks() - start));
+
+        zassert_equal(code, COAP_RESPONSE_CODE_CONTENT);
+        sum_us += us;
+        max_us = MAX(max_us, us);
+        k_msleep(7);
+    }
+
+    TC_PRINT("GET /metrics: avg %u us, max %u us over %u samples (engine tick %u ms)\n",
+             (unsigned int)(sum_us / LATENCY_SAMPLES), max_us, LATENCY_SAMPLES, LOOP_MS);
+    zassert_true(max_us < LATENCY_MAX_US, "max latency %u us", max_us);
+    (void)close(sock);
+}
+
+/* An observer that never ACKs the confirmable refresh loses its slot. */
+ZTEST(gw_coap, test_silent_observer_is_evicted)
+{
+    gw_coap_stats_t before;
+    gw_coap_stats_t stats;
+    uint32_t cons = 0U;
+    uint16_t con_id = 0U;
+    int64_t deadline;
+    uint8_t type;
+    uint16_t id;
+    uint8_t code;
+    int sock = client_open();
+
+    zassert_ok(gw_coap_get_stats(&before));
+    client_observe(sock);
+
+    deadline = k_uptime_get() + EVICT_TIMEOUT_MS;
+    do {
+        if (client_recv(sock, &type, &id, &code) == 0 && type == COAP_TYPE_CON) {
+            /* Retransmissions reuse the message id. */
+            zassert_true(cons == 0U || id == con_id);
+            con_id = id;
+            cons++;
+        }
+        zassert_ok(gw_coap_get_stats(&stats));
+    } while (stats.observers_evicted == before.observers_evicted && k_uptime_get() < deadline);
+
+    zassert_equal(stats.observers_evicted, before.observers_evicted + 1U);
+    zassert_equal(stats.observers, before.observers);
+    zassert_equal(cons, 1U + CONFIG_COAP_MAX_RETRANSMIT);
+    (void)close(sock);
+}
+
+/* ACKing every confirmable refresh keeps the observation alive. */
+ZTEST(gw_coap, test_acked_observer_is_kept)
+{
+    gw_coap_stats_t before;
+    gw_coap_stats_t stats;
+    uint32_t cons = 0U;
+    int64_t deadline;
+    uint8_t type;
+    uint16_t id;
+    uint8_t code;
+    int sock = client_open();
+
+    zassert_ok(gw_coap_get_stats(&before));
+    client_observe(sock);
+
+    deadline = k_uptime_get() + 5 * CON_INTERVAL_MS;
+    while (k_uptime_get() < deadline) {
+        if (client_recv(sock, &type, &id, &code) == 0 && type == COAP_TYPE_CON) {
+            client_empty(sock, COAP_TYPE_ACK, id);
+            cons++;
+        }
+    }
+
+    zassert_ok(gw_coap_get_stats(&stats));
+    zassert_true(cons >= 3U, "%u refreshes", cons);
+    zassert_equal(stats.observers, before.observers + 1U);
+    zassert_equal(stats.observers_evicted, before.observers_evicted);
+    zassert_equal(stats.con_retransmits, before.con_retransmits);
+
+    /* A RST cancels the observation. */
+    client_empty(sock, COAP_TYPE_RESET, coap_next_id());
+    k_msleep(2 * LOOP_MS);
+    zassert_ok(gw_coap_get_stats(&stats));
+    zassert_equal(stats.observers, before.observers);
+    (void)close(sock);
+}
+
+ZTEST_SUITE(gw_coap, NULL, suite_setup, NULL, NULL, NULL);
@@ -0,0 +1,37 @@
+#ifndef HOST_TEST_H
+#define HOST_TEST_H
+
+#include <stdio.h>
+#include <string.h>
+
+/* Minimal assertion helpers for the host tests; failures are counted, not fatal. */
+static int host_test_failures;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            (void)fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            host_test_failures++; \
+        } \
+    } while (0)
+
+#define CHECK_STR(actual, expected) \
+    do { \
+        if (strcmp((actual), (expected)) != 0) { \
+            (void)fprintf(stderr, "%s:%d: got %s, want %s\n", __FILE__, __LINE__, (actual), (expected)); \
+            host_test_failures++; \
+        } \
+    } while (0)
+
+static inline int host_test_report(const char *name)
+{
+    if (host_test_failures != 0) {
+        (void)fprintf(stderr, "%s: %d check(s) failed\n", name, host_test_failures);
+        return 1;
+    }
+
+    (void)printf("%s: ok\n", name);
+    return 0;
+}
+
+#endif
@@ -0,0 +1,349 @@
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <gateway_engine/gw_codec.h>
+#include <gateway_engine/gw_gorilla.h>
+
+#include "host_test.h"
+
+#define SERIES_HEADER_SIZE 6U
+#define BLOCK_HEADER_SIZE 3U
+
+static uint8_t g_buf[8192];
+
+static uint32_t float_bits(float f)
+{
+    uint32_t bits;
+
+    (void)memcpy(&bits, &f, sizeof(bits));
+    return bits;
+}
+
+static float bits_float(uint32_t bits)
+{
+    float f;
+
+    (void)memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+static void add_point(gw_codec_batch_t *batch, uint32_t ts_ms, uint16_t id, uint32_t bits)
+{
+    gw_codec_record_t rec;
+
+    gw_codec_record_init(&rec);
+    CHECK(gw_codec_record_add_float(&rec, id, bits_float(bits)) == 0);
+    CHECK(gw_codec_batch_add(batch, ts_ms, &rec) == 0);
+}
+
+/* Encodes, decodes and compares bit for bit; returns the first series' stream length. */
+static uint16_t gorilla_round_trip(const gw_codec_batch_t *batch)
+{
+    gw_codec_batch_t out;
+    size_t len = 0U;
+    size_t i;
+
+    CHECK(gw_gorilla_encode_batch(batch, g_buf, sizeof(g_buf), &len) == 0);
+    CHECK(gw_codec_detect(g_buf, len) == GW_CODEC_FORMAT_GORILLA);
+    CHECK(gw_gorilla_decode_batch(g_buf, len, &out) == 0);
+    CHECK(out.count == batch->count);
+
+    /* Single-series batches come back in input order. */
+    for (i = 0U; i < out.count && i < batch->count; ++i) {
+        CHECK(out.points[i].ts_ms == batch->points[i].ts_ms);
+        CHECK(out.points[i].field.id == batch->points[i].field.id);
+        CHECK(out.points[i].field.type == GW_CODEC_VALUE_FLOAT);
+        CHECK(float_bits(out.points[i].field.value.f) == float_bits(batch->points[i].field.value.f));
+    }
+
+    return (uint16_t)(((uint16_t)g_buf[BLOCK_HEADER_SIZE + 4U] << 8) | g_buf[BLOCK_HEADER_SIZE + 5U]);
+}
+
+/*
+ * Nine points with a constant value and delta-of-deltas alternating a, b: the
+ * stream is 64 header bits, eight timestamp codes and eight '0' value bits.
+ */
+static void check_dod_bucket(int32_t a, int32_t b, uint32_t code_bits)
+{
+    gw_codec_batch_t batch;
+    uint32_t ts = 100000U;
+    uint32_t delta = 0U;
+    uint32_t bits = 64U + 8U * (code_bits + 1U);
+    uint16_t k;
+
+    gw_codec_batch_init(&batch);
+    add_point(&batch, ts, 7U, float_bits(21.5f));
+    for (k = 0U; k < 8U; ++k) {
+        delta += (uint32_t)(((k & 1U) == 0U) ? a : b);
+        ts += delta;
+        add_point(&batch, ts, 7U, float_bits(21.5f));
+    }
+
+    CHECK(gorilla_round_trip(&batch) == (bits + 7U) / 8U);
+}
+
+static void test_gorilla_dod_buckets(void)
+{
+    /* '10' + 7 bits covers -63..64, '110' + 9 bits -255..256, '1110' + 12 bits -2047..2048. */
+    check_dod_bucket(64, -63, 2U + 7U);
+    check_dod_bucket(65, -64, 3U + 9U);
+    check_dod_bucket(256, -255, 3U + 9U);
+    check_dod_bucket(257, -256, 4U + 12U);
+    check_dod_bucket(2048, -2047, 4U + 12U);
+    check_dod_bucket(2049, -2048, 4U + 32U);
+    check_dod_bucket(1000000, -1000000, 4U + 32U);
+    check_dod_bucket(0, 0, 1U);
+}
+
+/* Repeats, sign-only flips (+0/-0), NaN payloads, infinities and a full 32-bit XOR. */
+static void test_gorilla_xor_cases(void)
+{
+    static const uint32_t values[] = {
+        0x3F800000U, /* 1.0 */
+        0x3F800000U, /* repeat: '0' */
+        0x3F800001U, /* one low bit: new window */
+        0x3F800003U, /* fits the previous window: '10' */
+        0x00000000U, /* +0 */
+        0x80000000U, /* -0: leading zeros 0, one bit */
+        0x00000000U, /* back to +0 */
+        0x7FC00000U, /* quiet NaN */
+        0x7FC00001U, /* NaN with payload */
+        0xFFC00000U, /* negative NaN */
+        0x7F800000U, /* +inf */
+        0xFF800000U, /* -inf */
+        0x00000001U, /* smallest subnormal */
+        0xFFFFFFFEU, /* XOR of all 32 bits */
+        0x12345678U,
+    };
+    gw_codec_batch_t batch;
+    size_t i;
+
+    gw_codec_batch_init(&batch);
+    for (i = 0U; i < sizeof(values) / sizeof(values[0]); ++i) {
+        add_point(&batch, 5000U + (uint32_t)i * 1000U, 3U, values[i]);
+    }
+
+    (void)gorilla_round_trip(&batch);
+}
+
+/* Several series, integer fields reduced to float32, timestamps across a 32-bit wrap. */
+static void test_gorilla_multi_series(void)
+{
+    gw_codec_batch_t batch;
+    gw_codec_batch_t out;
+    gw_codec_record_t rec;
+    size_t len = 0U;
+    size_t i;
+    uint32_t ts = 0xFFFFF000U;
+
+    gw_codec_batch_init(&batch);
+    for (i = 0U; i < 20U; ++i) {
+        gw_codec_record_init(&rec);
+        CHECK(gw_codec_record_add_uint(&rec, 1U, (uint32_t)(i * 3U)) == 0);
+        CHECK(gw_codec_record_add_int(&rec, 2U, -(int32_t)i) == 0);
+        CHECK(gw_codec_record_add_bool(&rec, 3U, (i & 1U) != 0U) == 0);
+        CHECK(gw_codec_batch_add(&batch, ts, &rec) == 0);
+        ts += 1000U + (uint32_t)(i % 3U);
+    }
+
+    CHECK(gw_gorilla_encode_batch(&batch, g_buf, sizeof(g_buf), &len) == 0);
+    CHECK(g_buf[2] == 3U);
+    CHECK(gw_gorilla_decode_batch(g_buf, len, &out) == 0);
+    CHECK(out.count == batch.count);
+
+    /* Output is grouped by series: all of id 1, then 2, then 3. */
+    for (i = 0U; i < out.count; ++i) {
+        size_t series = i / 20U;
+        size_t k = i % 20U;
+        const gw_codec_point_t *src = &batch.points[k * 3U + series];
+
+        CHECK(out.points[i].field.id == src->field.id);
+        CHECK(out.points[i].ts_ms == src->ts_ms);
+        CHECK(out.points[i].field.value.f == gw_codec_field_as_float(&src->field));
+    }
+
+    CHECK(gw_gorilla_decode_batch(g_buf, len - 1U, &out) != 0);
+    g_buf[1] = (uint8_t)(GW_GORILLA_VERSION + 1U);
+    CHECK(gw_gorilla_decode_batch(g_buf, len, &out) == -ENOTSUP);
+}
+
+/* Minimal reader for the CBOR batch layout: array of [ts_ms, id, value]. */
+typedef struct {
+    const uint8_t *buf;
+    size_t len;
+    size_t pos;
+} ref_reader_t;
+
+static int ref_head(ref_reader_t *r, uint8_t *major, uint8_t *minor, uint64_t *arg)
+{
+    uint8_t b;
+    size_t n;
+    size_t i;
+
+    if (r->pos >= r->len) {
+        return -1;
+    }
+
+    b = r->buf[r->pos++];
+    *major = (uint8_t)(b >> 5);
+    *minor = (uint8_t)(b & 0x1FU);
+
+    if (*minor < 24U) {
+        *arg = *minor;
+        return 0;
+    }
+
+    n = (size_t)1U << (*minor - 24U);
+    if (*minor > 27U || r->len - r->pos < n) {
+        return -1;
+    }
+
+    *arg = 0U;
+    for (i = 0U; i < n; ++i) {
+        *arg = (*arg << 8) | r->buf[r->pos++];
+    }
+    return 0;
+}
+
+static int ref_decode_cbor_batch(const uint8_t *buf, size_t len, gw_codec_batch_t *out)
+{
+    ref_reader_t r = {buf, len, 0U};
+    uint8_t major;
+    uint8_t minor;
+    uint64_t count;
+    uint64_t arg;
+    uint64_t i;
+
+    out->count = 0U;
+    if (ref_head(&r, &major, &minor, &count) != 0 || major != 4U || count > GW_CODEC_BATCH_MAX_POINTS) {
+        return -1;
+    }
+
+    for (i = 0U; i < count; ++i) {
+        gw_codec_point_t *p = &out->points[i];
+
+        if (ref_head(&r, &major, &minor, &arg) != 0 || major != 4U || arg != 3U) {
+            return -1;
+        }
+        if (ref_head(&r, &major, &minor, &arg) != 0 || major != 0U) {
+            return -1;
+        }
+        p->ts_ms = (uint32_t)arg;
+        if (ref_head(&r, &major, &minor, &arg) != 0 || major != 0U) {
+            return -1;
+        }
+        p->field.id = (uint16_t)arg;
+        if (ref_head(&r, &major, &minor, &arg) != 0) {
+            return -1;
+        }
+
+        if (major == 0U) {
+            p->field.type = GW_CODEC_VALUE_UINT;
+            p->field.value.u = (uint32_t)arg;
+        } else if (major == 1U) {
+            p->field.type = GW_CODEC_VALUE_INT;
+            p->field.value.i = -1 - (int32_t)arg;
+        } else if (major == 7U && (minor == 20U || minor == 21U)) {
+            p->field.type = GW_CODEC_VALUE_BOOL;
+            p->field.value.b = (minor == 21U);
+        } else if (major == 7U && minor == 26U) {
+            p->field.type = GW_CODEC_VALUE_FLOAT;
+            p->field.value.f = bits_float((uint32_t)arg);
+        } else {
+            return -1;
+        }
+    }
+
+    out->count = (uint16_t)count;
+    return (r.pos == len) ? 0 : -1;
+}
+
+static void test_cbor_batch(void)
+{
+    gw_codec_batch_t batch;
+    gw_codec_batch_t out;
+    gw_codec_record_t rec;
+    size_t len = 0U;
+    size_t i;
+
+    gw_codec_batch_init(&batch);
+    gw_codec_record_init(&rec);
+    CHECK(gw_codec_record_add_uint(&rec, 1U, 16777217U) == 0);
+    CHECK(gw_codec_record_add_uint(&rec, 2U, 0xFFFFFFFFU) == 0);
+    CHECK(gw_codec_record_add_int(&rec, 3U, -2147483647 - 1) == 0);
+    CHECK(gw_codec_record_add_float(&rec, 4U, -0.0f) == 0);
+    CHECK(gw_codec_record_add_bool(&rec, 5U, true) == 0);
+    CHECK(gw_codec_record_add_float(&rec, 6U, bits_float(0x7FC00001U)) == 0);
+    CHECK(gw_codec_batch_add(&batch, 0U, &rec) == 0);
+    CHECK(gw_codec_batch_add(&batch, 0xFFFFFFFFU, &rec) == 0);
+
+    CHECK(gw_codec_encode_batch(&batch, GW_CODEC_FORMAT_CBOR, g_buf, sizeof(g_buf), &len) == 0);
+    CHECK(gw_codec_detect(g_buf, len) == GW_CODEC_FORMAT_CBOR);
+    CHECK(ref_decode_cbor_batch(g_buf, len, &out) == 0);
+    CHECK(out.count == batch.count);
+
+    for (i = 0U; i < out.count && i < batch.count; ++i) {
+        const gw_codec_point_t *a = &out.points[i];
+        const gw_codec_point_t *b = &batch.points[i];
+
+        CHECK(a->ts_ms == b->ts_ms);
+        CHECK(a->field.id == b->field.id);
+        CHECK(a->field.type == b->field.type);
+        if (b->field.type == GW_CODEC_VALUE_BOOL) {
+            CHECK(a->field.value.b == b->field.value.b);
+        } else {
+            CHECK(a->field.value.u == b->field.value.u);
+        }
+    }
+
+    CHECK(gw_codec_encode_batch(&batch, GW_CODEC_FORMAT_CBOR, g_buf, len - 1U, &len) != 0);
+}
+
+/* Half, single and double floats in a telemetry map all decode to float32. */
+static void test_cbor_float_widths(void)
+{
+    static const uint8_t map[] = {
+        0xA8U,
+        0x01U, 0xF9U, 0x3EU, 0x00U,                                     /* half 1.5 */
+        0x02U, 0xF9U, 0x00U, 0x01U,                                     /* half smallest subnormal */
+        0x03U, 0xF9U, 0x80U, 0x00U,                                     /* half -0 */
+        0x04U, 0xF9U, 0x7CU, 0x00U,                                     /* half +inf */
+        0x05U, 0xF9U, 0x7EU, 0x00U,                                     /* half NaN */
+        0x06U, 0xFAU, 0x47U, 0xC3U, 0x50U, 0x00U,                       /* single 100000.0 */
+        0x07U, 0xFBU, 0x3FU, 0xF8U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U, /* double 1.5 */
+        0x08U, 0xFBU, 0x40U, 0x09U, 0x21U, 0xFBU, 0x54U, 0x44U, 0x2DU, 0x18U, /* double pi */
+    };
+    gw_codec_record_t rec;
+    size_t i;
+
+    CHECK(gw_codec_decode_cbor(map, sizeof(map), &rec) == 0);
+    CHECK(rec.count == 8U);
+    for (i = 0U; i < rec.count; ++i) {
+        CHECK(rec.fields[i].type == GW_CODEC_VALUE_FLOAT);
+    }
+
+    CHECK(rec.fields[0].value.f == 1.5f);
+    CHECK(rec.fields[1].value.f == 5.9604645e-8f);
+    CHECK(float_bits(rec.fields[2].value.f) == 0x80000000U);
+    CHECK(isinf(rec.fields[3].value.f) && rec.fields[3].value.f > 0.0f);
+    CHECK(isnan(rec.fields[4].value.f));
+    CHECK(rec.fields[5].value.f == 100000.0f);
+    CHECK(rec.fields[6].value.f == 1.5f);
+    CHECK(rec.fields[7].value.f == 3.14159265f);
+
+    /* Truncated double. */
+    CHECK(gw_codec_decode_cbor(map, sizeof(map) - 1U, &rec) != 0);
+}
+
+int main(void)
+{
+    test_gorilla_dod_buckets();
+    test_gorilla_xor_cases();
+    test_gorilla_multi_series();
+    test_cbor_batch();
+    test_cbor_float_widths();
+    return host_test_report("codec");
+}
@@ -0,0 +1,145 @@
+#include <errno.h>
+#include <stdint.h>
+
+#include <gateway_engine/gw_codec.h>
+#include <gateway_engine/gw_rbe.h>
+
+#include "host_test.h"
+
+#define EDGE 7U
+#define TEMP 1U
+
+static gw_rbe_t g_rbe;
+
+static const gw_rbe_band_t g_bands[] = {
+    { .edge_id = EDGE, .field_id = TEMP, .abs_deadband = 1.0f },
+};
+
+static void setup(void)
+{
+    gw_rbe_config_t cfg = { .bands = g_bands, .band_count = 1U };
+
+    CHECK(gw_rbe_init(&g_rbe, &cfg) == 0);
+}
+
+static const gw_codec_field_t *find_field(const gw_codec_record_t *rec, uint16_t id)
+{
+    size_t i;
+
+    for (i = 0U; i < rec->count; ++i) {
+        if (rec->fields[i].id == id) {
+            return &rec->fields[i];
+        }
+    }
+
+    return NULL;
+}
+
+static void temp_record(gw_codec_record_t *rec, float temp)
+{
+    gw_codec_record_init(rec);
+    CHECK(gw_codec_record_add_float(rec, TEMP, temp) == 0);
+}
+
+static void test_quality_only_change(void)
+{
+    gw_codec_record_t in;
+    gw_codec_record_t out;
+    const gw_codec_field_t *q;
+
+    setup();
+
+    /* First record goes out whole, quality included. */
+    temp_record(&in, 20.0f);
+    CHECK(gw_codec_record_add_uint(&in, GW_CODEC_FIELD_QUALITY, 0U) == 0);
+    CHECK(gw_rbe_filter(&g_rbe, EDGE, 0U, &in, &out) == 0);
+    CHECK(out.count == 2U);
+
+    /* Same value and quality: suppressed. */
+    CHECK(gw_rbe_filter(&g_rbe, EDGE, 10U, &in, &out) == 0);
+    CHECK(out.count == 0U);
+
+    /* Only the quality changed: the value is forced and the quality goes too. */
+    temp_record(&in, 20.1f);
+    CHECK(gw_codec_record_add_uint(&in, GW_CODEC_FIELD_QUALITY, 3U) == 0);
+    CHECK(gw_rbe_filter(&g_rbe, EDGE, 20U, &in, &out) == 0);
+    q = find_field(&out, GW_CODEC_FIELD_QUALITY);
+    CHECK(q != NULL && q->type == GW_CODEC_VALUE_UINT && q->value.u == 3U);
+    CHECK(find_field(&out, TEMP) != NULL);
+
+    /* Quality stays bad and the value is inside the band: suppressed. */
+    CHECK(gw_rbe_filter(&g_rbe, EDGE, 30U, &in, &out) == 0);
+    CHECK(out.count == 0U);
+
+    /* Missing quality field means good again; it is reported explicitly. */
+    temp_record(&in, 20.1f);
+    CHECK(gw_rbe_filter(&g_rbe, EDGE, 40U, &in, &out) == 0);
+    q = find_field(&out, GW_CODEC_FIELD_QUALITY);
+    CHECK(q != NULL && q->value.u == 0U);
+}
+
+static void test_quality_only_field(void)
+{
+    gw_codec_record_t in;
+    gw_codec_record_t out;
+    const gw_codec_field_t *q;
+
+    setup();
+
+    temp_record(&in, 20.0f);
+    CHECK(gw_rbe_filter(&g_rbe, EDGE, 0U, &in, &out) == 0);
+
+    /* A record carrying only a new quality still reports it. */
+    gw_codec_record_init(&in);
+    CHECK(gw_codec_record_add_uint(&in, GW_CODEC_FIELD_QUALITY, 2U) == 0);
+    CHECK(gw_rbe_filter(&g_rbe, EDGE, 10U, &in, &out) == 0);
+    CHECK(out.count == 1U);
+    q = find_field(&out, GW_CODEC_FIELD_QUALITY);
+    CHECK(q != NULL && q->value.u == 2U);
+
+    CHECK(gw_rbe_filter(&g_rbe, EDGE, 20U, &in, &out) == 0);
+    CHECK(out.count == 0U);
+}
+
+static void test_quality_types(void)
+{
+    gw_codec_record_t in;
+    gw_codec_record_t out;
+    const gw_codec_field_t *q;
+
+    setup();
+
+    /* Integral floats and non-negative ints are converted to the code. */
+    temp_record(&in, 20.0f);
+    CHECK(gw_codec_record_add_float(&in, GW_CODEC_FIELD_QUALITY, 4.0f) == 0);
+    CHECK(gw_rbe_filter(&g_rbe, EDGE, 0U, &in, &out) == 0);
+    q = find_field(&out, GW_CODEC_FIELD_QUALITY);
+    CHECK(q != NULL && q->type == GW_CODEC_VALUE_UINT && q->value.u == 4U);
+
+    temp_record(&in, 20.0f);
+    CHECK(gw_codec_record_add_int(&in, GW_CODEC_FIELD_QUALITY, 4) == 0);
+    CHECK(gw_rbe_filter(&g_rbe, EDGE, 10U, &in, &out) == 0);
+    CHECK(out.count == 0U);
+
+    temp_record(&in, 20.0f);
+    CHECK(gw_codec_record_add_float(&in, GW_CODEC_FIELD_QUALITY, 0.5f) == 0);
+    CHECK(gw_rbe_filter(&g_rbe, EDGE, 20U, &in, &out) == -EINVAL);
+
+    temp_record(&in, 20.0f);
+    CHECK(gw_codec_record_add_int(&in, GW_CODEC_FIELD_QUALITY, -1) == 0);
+    CHECK(gw_rbe_filter(&g_rbe, EDGE, 30U, &in, &out) == -EINVAL);
+
+    temp_record(&in, 20.0f);
+    CHECK(gw_codec_record_add_bool(&in, GW_CODEC_FIELD_QUALITY, true) == 0);
+    CHECK(gw_rbe_filter(&g_rbe, EDGE, 40U, &in, &out) == -EINVAL);
+
+    CHECK(g_rbe.stats.quality_rejected == 3U);
+}
+
+int main(void)
+{
+    test_quality_only_change();
+    test_quality_only_field();
+    test_quality_types();
+    return host_test_report("rbe");
+}
@@ -0,0 +1,104 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "gw_sha256.h"
+
+#include "host_test.h"
+
+static void hex(const uint8_t *data, size_t len, char *out)
+{
+    static const char digits[] = "0123456789abcdef";
+    size_t i;
+
+    for (i = 0U; i < len; ++i) {
+        out[i * 2U] = digits[data[i] >> 4];
+        out[i * 2U + 1U] = digits[data[i] & 0x0FU];
+    }
+    out[len * 2U] = '\0';
+}
+
+static void check_sha256(const char *msg, const char *expected)
+{
+    uint8_t digest[GW_SHA256_DIGEST_SIZE];
+    char out[GW_SHA256_DIGEST_SIZE * 2U + 1U];
+
+    CHECK(gw_sha256((const uint8_t *)msg, strlen(msg), digest) == 0);
+    hex(digest, sizeof(digest), out);
+    CHECK_STR(out, expected);
+}
+
+static void test_vectors(void)
+{
+    check_sha256("", "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+    check_sha256("abc", "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+    check_sha256(
+        "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+        "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+}
+
+/* Chunk sizes straddle the 64-byte block and the 56-byte padding boundary. */
+static void test_chunked(void)
+{
+    uint8_t data[1000];
+    uint8_t one_shot[GW_SHA256_DIGEST_SIZE];
+    uint8_t chunked[GW_SHA256_DIGEST_SIZE];
+    static const size_t chunks[] = {1U, 55U, 56U, 63U, 64U, 65U, 127U, 999U};
+    gw_sha256_ctx_t ctx;
+    size_t c;
+    size_t off;
+    size_t i;
+
+    for (i = 0U; i < sizeof(data); ++i) {
+        data[i] = (uint8_t)(i * 31U + 7U);
+    }
+
+    CHECK(gw_sha256(data, sizeof(data), one_shot) == 0);
+
+    for (c = 0U; c < sizeof(chunks) / sizeof(chunks[0]); ++c) {
+        CHECK(gw_sha256_init(&ctx) == 0);
+        for (off = 0U; off < sizeof(data); off += chunks[c]) {
+            size_t n = (sizeof(data) - off < chunks[c]) ? sizeof(data) - off : chunks[c];
+
+            CHECK(gw_sha256_update(&ctx, &data[off], n) == 0);
+        }
+        CHECK(gw_sha256_final(&ctx, chunked) == 0);
+        CHECK(memcmp(one_shot, chunked, sizeof(one_shot)) == 0);
+    }
+}
+
+/* RFC 4231 cases 2 and 6 (key longer than a block), plus a key re-set on the same context. */
+static void test_hmac(void)
+{
+    uint8_t key6[131];
+    uint8_t mac[GW_SHA256_DIGEST_SIZE];
+    char out[GW_SHA256_DIGEST_SIZE * 2U + 1U];
+    gw_hmac_sha256_key_t hk;
+    const char *msg2 = "what do ya want for nothing?";
+    const char *msg6 = "Test Using Larger Than Block-Size Key - Hash Key First";
+
+    (void)memset(key6, 0xAA, sizeof(key6));
+
+    CHECK(gw_hmac_sha256((const uint8_t *)"Jefe", 4U, (const uint8_t *)msg2, strlen(msg2), mac) == 0);
+    hex(mac, sizeof(mac), out);
+    CHECK_STR(out, "5bdcc146bf60754e6a042426089575c75a003f089d2739839dec58b964ec3843");
+
+    (void)memset(&hk, 0, sizeof(hk));
+    CHECK(gw_hmac_sha256_setkey(&hk, key6, sizeof(key6)) == 0);
+    CHECK(gw_hmac_sha256_keyed(&hk, (const uint8_t *)msg6, strlen(msg6), mac) == 0);
+    hex(mac, sizeof(mac), out);
+    CHECK_STR(out, "60e431591ee0b67f0d8a26aacbf5b77f8e0bc6213728c5140546040f0ee37f54");
+
+    CHECK(gw_hmac_sha256_setkey(&hk, (const uint8_t *)"Jefe", 4U) == 0);
+    CHECK(gw_hmac_sha256_keyed(&hk, (const uint8_t *)msg2, strlen(msg2), mac) == 0);
+    hex(mac, sizeof(mac), out);
+    CHECK_STR(out, "5bdcc146bf60754e6a042426089575c75a003f089d2739839dec58b964ec3843");
+}
+
+int main(void)
+{
+    test_vectors();
+    test_chunked();
+    test_hmac();
+    return host_test_report("sha256");
+}
@@ -0,0 +1,61 @@
+#include <errno.h>
+#include <stdint.h>
+
+#include <gateway_engine/gw_codec.h>
+#include <gateway_engine/gw_shadow.h>
+
+#include "host_test.h"
+
+static gw_shadow_t g_shadow;
+
+static void setup(void)
+{
+    gw_shadow_config_t cfg = { .enabled = true, .slot = 0U, .ack_timeout_ms = 100U };
+
+    CHECK(gw_shadow_init(&g_shadow, &cfg) == 0);
+}
+
+static void test_set_desired_all_or_nothing(void)
+{
+    gw_codec_record_t rec;
+    uint16_t id;
+
+    setup();
+
+    /* Fill all but one slot. */
+    gw_codec_record_init(&rec);
+    for (id = 1U; id < GW_SHADOW_MAX_FIELDS; ++id) {
+        CHECK(gw_codec_record_add_uint(&rec, id, id) == 0);
+    }
+    CHECK(gw_shadow_set_desired(&g_shadow, &rec) == 0);
+    CHECK(g_shadow.desired_version == 1U);
+    g_shadow.desired_dirty = false;
+
+    /* An update to an existing field plus two new ones does not fit: nothing changes. */
+    gw_codec_record_init(&rec);
+    CHECK(gw_codec_record_add_uint(&rec, 1U, 100U) == 0);
+    CHECK(gw_codec_record_add_uint(&rec, 200U, 1U) == 0);
+    CHECK(gw_codec_record_add_uint(&rec, 201U, 1U) == 0);
+    CHECK(gw_shadow_set_desired(&g_shadow, &rec) == -ENOSPC);
+    CHECK(g_shadow.desired_version == 1U);
+    CHECK(!g_shadow.desired_dirty);
+    CHECK(g_shadow.field_count == GW_SHADOW_MAX_FIELDS - 1U);
+    CHECK(g_shadow.fields[0].desired.value.u == 1U);
+    CHECK(g_shadow.stats.table_full == 1U);
+
+    /* One new id repeated in the record takes a single slot. */
+    gw_codec_record_init(&rec);
+    CHECK(gw_codec_record_add_uint(&rec, 200U, 1U) == 0);
+    CHECK(gw_codec_record_add_uint(&rec, 200U, 2U) == 0);
+    CHECK(gw_codec_record_add_uint(&rec, GW_SHADOW_FIELD_VERSION, 9U) == 0);
+    CHECK(gw_shadow_set_desired(&g_shadow, &rec) == 0);
+    CHECK(g_shadow.field_count == GW_SHADOW_MAX_FIELDS);
+    CHECK(g_shadow.desired_version == 2U);
+    CHECK(g_shadow.desired_dirty);
+}
+
+int main(void)
+{
+    test_set_desired_all_or_nothing();
+    return host_test_report("shadow");
+}
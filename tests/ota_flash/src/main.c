@@ -0,0 +1,208 @@
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <zephyr/dfu/flash_img.h>
+#include <zephyr/dfu/mcuboot.h>
+#include <zephyr/kernel.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/ztest.h>
+
+#include <gateway_engine/gw_ota.h>
+
+#define IMAGE_MAGIC 0x96f3b83dU
+#define IMAGE_HEADER_SIZE 32U
+#define READY_TIMEOUT_MS 5000
+#define BENCH_IMAGE_SIZE (256U * 1024U)
+#define BENCH_CHUNK_SIZE 256U
+#define PAGE_SIZE CONFIG_GW_ENGINE_OTA_PAGE_SIZE
+
+static gw_ota_ctx_t g_ctx;
+static const struct flash_area *g_fa;
+static uint8_t g_chunk[512];
+static uint8_t g_readback[512];
+static uint8_t g_page[PAGE_SIZE];
+
+static void put_le32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+/* A minimal MCUboot v1 header followed by a pattern that differs per offset. */
+static uint8_t image_byte(uint32_t off, uint32_t total)
+{
+    uint8_t hdr[IMAGE_HEADER_SIZE] = {0};
+
+    if (off >= IMAGE_HEADER_SIZE) {
+        return (uint8_t)((off * 31U) ^ (off >> 8));
+    }
+
+    put_le32(&hdr[0], IMAGE_MAGIC);
+    hdr[8] = (uint8_t)IMAGE_HEADER_SIZE;
+    put_le32(&hdr[12], total - IMAGE_HEADER_SIZE);
+    return hdr[off];
+}
+
+static void fill_chunk(uint32_t off, size_t len, uint32_t total)
+{
+    size_t i;
+
+    for (i = 0U; i < len; ++i) {
+        g_chunk[i] = image_byte(off + (uint32_t)i, total);
+    }
+}
+
+/* A failed transfer may leave the writer finishing a page; begin refuses until it is done. */
+static void begin(void)
+{
+    int rc;
+
+    while ((rc = gw_ota_begin(&g_ctx)) == -EBUSY) {
+        k_msleep(1);
+    }
+    zassert_ok(rc);
+}
+
+/* Streams an image of total bytes and pumps until the slot is marked or the transfer fails. */
+static void transfer(uint32_t total, size_t chunk)
+{
+    int64_t deadline;
+    uint32_t off;
+    size_t n;
+
+    begin();
+
+    for (off = 0U; off < total; off += (uint32_t)n) {
+        n = MIN(chunk, (size_t)(total - off));
+        fill_chunk(off, n, total);
+        zassert_ok(gw_ota_push_chunk(&g_ctx, g_chunk, n), "chunk at %u", off);
+    }
+
+    zassert_ok(gw_ota_finish(&g_ctx));
+
+    deadline = k_uptime_get() + READY_TIMEOUT_MS;
+    while (g_ctx.state == GW_OTA_STATE_VERIFYING && k_uptime_get() < deadline) {
+        zassert_ok(gw_ota_pump(&g_ctx));
+        k_msleep(1);
+    }
+}
+
+static void check_slot(uint32_t total)
+{
+    uint32_t off;
+    size_t n;
+
+    for (off = 0U; off < total; off += (uint32_t)n) {
+        n = MIN(sizeof(g_readback), (size_t)(total - off));
+        fill_chunk(off, n, total);
+        zassert_ok(flash_area_read(g_fa, off, g_readback, n));
+        zassert_mem_equal(g_readback, g_chunk, n, "slot differs at %u", off);
+    }
+}
+
+static void *suite_setup(void)
+{
+    zassert_ok(flash_area_open(flash_img_get_upload_slot(), &g_fa));
+    return NULL;
+}
+
+static void before(void *fixture)
+{
+    gw_ota_config_t cfg = { .chunk_size = sizeof(g_chunk), .timeout_ms = 1000U };
+
+    ARG_UNUSED(fixture);
+    zassert_ok(gw_ota_init(&g_ctx, &cfg));
+}
+
+ZTEST(gw_ota_flash, test_image_lands_in_slot)
+{
+    /* Not a multiple of the page or the chunk, so the padded tail is exercised. */
+    uint32_t total = 10U * PAGE_SIZE + 123U;
+
+    transfer(total, 200U);
+
+    zassert_equal(g_ctx.state, GW_OTA_STATE_READY_TO_APPLY, "state %d, error %d", g_ctx.state, g_ctx.last_error);
+    zassert_equal(mcuboot_swap_type(), BOOT_SWAP_TYPE_TEST);
+    zassert_true(g_ctx.stats.bytes_written >= total);
+    check_slot(total);
+}
+
+ZTEST(gw_ota_flash, test_stale_trailer_is_erased)
+{
+    ssize_t trailer = boot_get_area_trailer_status_offset(flash_img_get_upload_slot());
+    uint32_t start;
+    uint32_t off;
+
+    zassert_true(trailer > 0);
+
+    /* Leave programmed bytes where boot_request_upgrade() writes, as an old transfer would. */
+    start = ROUND_DOWN((uint32_t)trailer, PAGE_SIZE);
+    (void)memset(g_page, 0x00, sizeof(g_page));
+    for (off = start; off < g_fa->fa_size; off += PAGE_SIZE) {
+        zassert_ok(flash_area_erase(g_fa, off, PAGE_SIZE));
+        zassert_ok(flash_area_write(g_fa, off, g_page, PAGE_SIZE));
+    }
+
+    transfer(4U * PAGE_SIZE, 256U);
+
+    zassert_equal(g_ctx.state, GW_OTA_STATE_READY_TO_APPLY, "state %d, error %d", g_ctx.state, g_ctx.last_error);
+    zassert_equal(mcuboot_swap_type(), BOOT_SWAP_TYPE_TEST);
+}
+
+ZTEST(gw_ota_flash, test_oversized_image_fails)
+{
+    uint32_t off;
+
+    begin();
+
+    (void)memset(g_chunk, 0xA5, sizeof(g_chunk));
+    for (off = 0U; off + sizeof(g_chunk) <= g_fa->fa_size; off += sizeof(g_chunk)) {
+        zassert_ok(gw_ota_push_chunk(&g_ctx, g_chunk, sizeof(g_chunk)));
+    }
+
+    zassert_equal(gw_ota_push_chunk(&g_ctx, g_chunk, sizeof(g_chunk)), -EFBIG);
+    zassert_equal(g_ctx.state, GW_OTA_STATE_FAILED);
+    zassert_equal(gw_ota_push_chunk(&g_ctx, g_chunk, sizeof(g_chunk)), -EPERM);
+
+    /* Once the writer drains its last page a new transfer starts from scratch. */
+    begin();
+    zassert_equal(g_ctx.state, GW_OTA_STATE_RECEIVING);
+    zassert_equal(g_ctx.bytes_received, 0U);
+}
+
+/*
+ * Throughput with the flash simulator's timing model: link-sized chunks
+ * against plain erase + write of the same pages on the caller's thread.
+ */
+ZTEST(gw_ota_flash, test_throughput)
+{
+    int64_t start;
+    int64_t ota_ms;
+    int64_t serial_ms;
+    uint32_t off;
+
+    start = k_uptime_get();
+    transfer(BENCH_IMAGE_SIZE, BENCH_CHUNK_SIZE);
+    ota_ms = MAX(k_uptime_get() - start, 1);
+
+    zassert_equal(g_ctx.state, GW_OTA_STATE_READY_TO_APPLY, "state %d, error %d", g_ctx.state, g_ctx.last_error);
+
+    start = k_uptime_get();
+    for (off = 0U; off < BENCH_IMAGE_SIZE; off += PAGE_SIZE) {
+        zassert_ok(flash_area_erase(g_fa, off, PAGE_SIZE));
+        zassert_ok(flash_area_write(g_fa, off, g_page, PAGE_SIZE));
+    }
+    serial_ms = MAX(k_uptime_get() - start, 1);
+
+    TC_PRINT("ota: %u KiB in %lld ms (%lld KiB/s), %u stalls, %u ms stalled\n",
+             BENCH_IMAGE_SIZE / 1024U, (long long)ota_ms, (long long)((BENCH_IMAGE_SIZE / 1024U) * 1000LL / ota_ms),
+             g_ctx.stats.stalls, g_ctx.stats.stall_ms);
+    TC_PRINT("serial erase+write: %u KiB in %lld ms (%lld KiB/s)\n",
+             BENCH_IMAGE_SIZE / 1024U, (long long)serial_ms,
+             (long long)((BENCH_IMAGE_SIZE / 1024U) * 1000LL / serial_ms));
+}
+
+ZTEST_SUITE(gw_ota_flash, NULL, suite_setup, before, NULL, NULL);